@@ -0,0 +1,87 @@
+#ifndef CPP_TOOLS_ADD_OVERRIDE_AST_VISITOR_H
+#define CPP_TOOLS_ADD_OVERRIDE_AST_VISITOR_H
+
+#include "clang/AST/Attr.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "EditRecorder.h"
+#include <string>
+
+// Traverses the AST, adding explicit "virtual" and "override" where they
+// are implicit.
+class AddOverrideASTVisitor :
+  public clang::RecursiveASTVisitor<AddOverrideASTVisitor> {
+public:
+  AddOverrideASTVisitor(EditRecorder &E, std::string OverrideString)
+    : TheEdits(E)
+    , OverrideStringPreSpace(" " + OverrideString)
+    , OverrideStringPostSpace(std::move(OverrideString) + " ")
+    {}
+
+  bool VisitCXXMethodDecl(clang::CXXMethodDecl *MD) {
+    if (ShouldAddVirtual(MD)) {
+      MarkVirtual(MD);
+    }
+
+    if (ShouldAddOverride(MD)) {
+      MarkOverride(MD);
+    }
+
+    return true;
+  }
+
+private:
+  EditRecorder &TheEdits;
+  const std::string OverrideStringPreSpace,
+                    OverrideStringPostSpace;
+
+  // Decides whether a method needs "virtual" added to it.
+  bool ShouldAddVirtual(clang::CXXMethodDecl *MD) {
+    // We only care about declarations.
+    if (MD->getCanonicalDecl() != MD) return false;
+    // Only virtual functions should be marked virtual.
+    if (!MD->isVirtual()) return false;
+    // If it's already marked virtual, there's no problem.
+    if (MD->isVirtualAsWritten()) return false;
+
+    return true;
+  }
+
+  // Adds "virtual" to a method's declaration that lacks it.
+  void MarkVirtual(clang::CXXMethodDecl *MD) {
+    clang::SourceLocation Loc = clang::isa<clang::CXXDestructorDecl>(MD)
+      ? MD->getInnerLocStart()
+      : MD->getTypeSpecStartLoc();
+    
+    TheEdits.InsertTextBefore(Loc, "virtual ");
+  }
+
+  // Decides whether a method needs "override" added to it.
+  bool ShouldAddOverride(clang::CXXMethodDecl *MD) {
+    // We only care about declarations.
+    if (MD->getCanonicalDecl() != MD) return false;
+    // If it doesn't override anything, it shouldn't be marked.
+    if (!MD->size_overridden_methods()) return false;
+    // If it's marked override, it's good.
+    if (MD->getAttr<clang::OverrideAttr>()) return false;
+    // Destructors aren't need to be marked override.
+    if (clang::isa<clang::CXXDestructorDecl>(MD)) return false;
+    // Pure virtual functions don't need to be marked.
+    if (MD->isPure()) return false;
+
+    return true;
+  }
+
+  // Adds "override" to a method's declaration that lacks it.
+  void MarkOverride(clang::CXXMethodDecl *MD) {
+    if (MD->hasBody()) {
+      TheEdits.InsertTextAfter(MD->getBody()->getLocStart(),
+                               OverrideStringPostSpace);
+    } else {
+      TheEdits.InsertTextAfterToken(MD->getLocEnd(),
+                                    OverrideStringPreSpace);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,273 @@
+#!/usr/bin/env python
+"""Generates a synthetic C++ corpus for benchmarking the tools.
+
+The corpus has headers with class hierarchies whose overrides lack
+"virtual" and "override", source files with functions that have unused
+parameters, one long function for extract-method, and a source file that
+is compiled in two configurations whose header needs different edits in
+each. Along with the
+sources, it writes a compile_commands.json, and a corpus.json that says how
+the corpus was generated and how many edits each tool should make.
+"""
+
+import argparse
+import json
+import os
+
+
+DEFAULTS = {
+    'tus': 100,
+    'headers': 20,
+    'fan_in': 5,
+    'depth': 4,
+    'virtuals': 5,
+    'unused': 2,
+    'functions': 10,
+    'function_lines': 200,
+}
+
+
+def header_name(index):
+    return 'header%d.h' % index
+
+
+def write_header(path, index, params):
+    """Writes a header with a chain of classes params['depth'] deep. Each
+    class after the first overrides all of the virtual methods of its base
+    without saying so."""
+    guard = 'CORPUS_HEADER%d_H' % index
+    lines = ['#ifndef %s' % guard, '#define %s' % guard, '']
+    for level in range(params['depth']):
+        name = 'H%dC%d' % (index, level)
+        if level == 0:
+            lines.append('class %s {' % name)
+        else:
+            lines.append('class %s : public H%dC%d {' % (name, index, level - 1))
+        lines.append('public:')
+        if level == 0:
+            lines.append('  virtual ~%s() {}' % name)
+        for method in range(params['virtuals']):
+            if level == 0:
+                lines.append('  virtual int m%d() const;' % method)
+            else:
+                lines.append('  int m%d() const;' % method)
+        if level == 0:
+            lines.append('  int value;')
+        lines.append('};')
+        lines.append('')
+    lines.append('#endif')
+    with open(path, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+
+
+def write_source(path, index, params):
+    """Writes a source file that includes params['fan_in'] headers and has
+    params['functions'] functions with params['unused'] unused parameters
+    each."""
+    lines = []
+    for i in range(params['fan_in']):
+        header = (index + i) % params['headers']
+        lines.append('#include "%s"' % header_name(header))
+    lines.append('')
+    for function in range(params['functions']):
+        args = ['int used']
+        args += ['int unused%d' % i for i in range(params['unused'])]
+        lines.append('int tu%d_f%d(%s) {' % (index, function, ', '.join(args)))
+        lines.append('  int result = used;')
+        lines.append('  for (int i = 0; i < used; ++i) {')
+        lines.append('    result += i * %d;' % (function + 1))
+        lines.append('  }')
+        lines.append('  return result;')
+        lines.append('}')
+        lines.append('')
+    with open(path, 'w') as f:
+        f.write('\n'.join(lines))
+
+
+def write_config_files(header_path, source_path):
+    """Writes a header whose overrides depend on a macro, and a source file
+    that includes it. The source file is compiled once with CONFIG_FIRST
+    and once without, and each configuration overrides a different method,
+    so both have to be processed to make all of the edits. The source file
+    also has a parameter that only one configuration uses, which must be
+    left alone."""
+    lines = [
+        '#ifndef CORPUS_CONFIG_H',
+        '#define CORPUS_CONFIG_H',
+        '',
+        '#ifdef CONFIG_FIRST',
+        '#define CONFIG_VIRTUAL_FIRST virtual',
+        '#define CONFIG_VIRTUAL_SECOND',
+        '#else',
+        '#define CONFIG_VIRTUAL_FIRST',
+        '#define CONFIG_VIRTUAL_SECOND virtual',
+        '#endif',
+        '',
+        'class ConfigBase {',
+        'public:',
+        '  virtual ~ConfigBase() {}',
+        '  CONFIG_VIRTUAL_FIRST int first() const;',
+        '  CONFIG_VIRTUAL_SECOND int second() const;',
+        '};',
+        '',
+        'class ConfigDerived : public ConfigBase {',
+        'public:',
+        '  int first() const;',
+        '  int second() const;',
+        '};',
+        '',
+        '#endif',
+    ]
+    with open(header_path, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+    with open(source_path, 'w') as f:
+        f.write('#include "config.h"\n\n'
+                'int config_value(const ConfigBase &base) {\n'
+                '  return base.first() + base.second();\n'
+                '}\n'
+                '\n'
+                'int config_scale(int value, int factor) {\n'
+                '#ifdef CONFIG_FIRST\n'
+                '  return value * factor;\n'
+                '#else\n'
+                '  return value;\n'
+                '#endif\n'
+                '}\n')
+
+
+def write_extract_source(path, params):
+    """Writes a source file with one function params['function_lines'] long,
+    and returns the range of lines in the middle of it to extract."""
+    lines = ['int extract_me(int input) {']
+    num_locals = max(1, params['function_lines'] // 10)
+    for i in range(num_locals):
+        lines.append('  int local%d = input + %d;' % (i, i))
+    body_start = len(lines) + 1
+    for i in range(params['function_lines'] - num_locals):
+        a = i % num_locals
+        b = (i * 7 + 3) % num_locals
+        lines.append('  local%d = local%d * 3 + local%d;' % (a, a, b))
+    body_end = len(lines)
+    lines.append('  return local0;')
+    lines.append('}')
+    with open(path, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+
+    # Extract the middle half of the statements, which use the locals
+    # declared before them.
+    length = body_end - body_start + 1
+    first = body_start + length // 4
+    last = max(first, body_start + (3 * length) // 4 - 1)
+    return first, last
+
+
+def expected_edits(params):
+    """Returns the number of edits each tool should make on the corpus."""
+    fix_unused_args = params['tus'] * params['functions'] * params['unused']
+    # Every overriding method gets both "virtual" and "override", and each
+    # header is only edited once, however many files include it.
+    used_headers = min(params['headers'], params['tus'] + params['fan_in'] - 1)
+    add_virtual_override = (used_headers * (params['depth'] - 1)
+                            * params['virtuals'] * 2)
+    # ConfigDerived overrides first() in one configuration and second() in
+    # the other.
+    add_virtual_override += 2 * 2
+    return {
+        'fix-unused-args': fix_unused_args,
+        'add-virtual-override': add_virtual_override,
+        'cpp-cleanup': fix_unused_args + add_virtual_override,
+        'extract-method': 1,
+    }
+
+
+def generate(output_dir, params):
+    """Generates the corpus in output_dir, and returns its description."""
+    params = dict(params)
+    params['fan_in'] = min(params['fan_in'], params['headers'])
+    include_dir = os.path.join(output_dir, 'include')
+    src_dir = os.path.join(output_dir, 'src')
+    for directory in (include_dir, src_dir):
+        if not os.path.isdir(directory):
+            os.makedirs(directory)
+
+    for index in range(params['headers']):
+        write_header(os.path.join(include_dir, header_name(index)),
+                     index, params)
+
+    sources = []
+    for index in range(params['tus']):
+        path = os.path.join(src_dir, 'tu%d.cpp' % index)
+        write_source(path, index, params)
+        sources.append(path)
+
+    config_path = os.path.join(src_dir, 'config.cpp')
+    write_config_files(os.path.join(include_dir, 'config.h'), config_path)
+
+    extract_path = os.path.join(src_dir, 'extract.cpp')
+    first, last = write_extract_source(extract_path, params)
+
+    commands = []
+    for path in sources + [extract_path]:
+        commands.append({
+            'directory': output_dir,
+            'command': 'clang++ -std=c++11 -I%s -c %s' % (include_dir, path),
+            'file': path,
+        })
+    for define in ('-DCONFIG_FIRST ', ''):
+        commands.append({
+            'directory': output_dir,
+            'command': 'clang++ -std=c++11 %s-I%s -c %s' % (
+                define, include_dir, config_path),
+            'file': config_path,
+        })
+    sources.append(config_path)
+    with open(os.path.join(output_dir, 'compile_commands.json'), 'w') as f:
+        json.dump(commands, f, indent=2)
+
+    corpus = {
+        'params': params,
+        'sources': sources,
+        'extract': {'file': extract_path, 'first': first, 'last': last},
+        'expected_edits': expected_edits(params),
+    }
+    with open(os.path.join(output_dir, 'corpus.json'), 'w') as f:
+        json.dump(corpus, f, indent=2)
+    return corpus
+
+
+def add_corpus_arguments(parser):
+    parser.add_argument('--tus', type=int, default=DEFAULTS['tus'],
+                        help='number of translation units')
+    parser.add_argument('--headers', type=int, default=DEFAULTS['headers'],
+                        help='number of headers')
+    parser.add_argument('--fan-in', type=int, default=DEFAULTS['fan_in'],
+                        help='number of headers each translation unit '
+                             'includes')
+    parser.add_argument('--depth', type=int, default=DEFAULTS['depth'],
+                        help='depth of the class hierarchy in each header')
+    parser.add_argument('--virtuals', type=int, default=DEFAULTS['virtuals'],
+                        help='number of virtual methods per class')
+    parser.add_argument('--unused', type=int, default=DEFAULTS['unused'],
+                        help='number of unused parameters per function')
+    parser.add_argument('--functions', type=int,
+                        default=DEFAULTS['functions'],
+                        help='number of functions per translation unit')
+    parser.add_argument('--function-lines', type=int,
+                        default=DEFAULTS['function_lines'],
+                        help='length of the function extract-method works on')
+
+
+def corpus_params(args):
+    return dict((key, getattr(args, key)) for key in DEFAULTS)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('output_dir', help='directory to generate into')
+    add_corpus_arguments(parser)
+    args = parser.parse_args()
+    generate(os.path.abspath(args.output_dir), corpus_params(args))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,176 @@
+#!/usr/bin/env python
+"""Runs the tools on a synthetic corpus and records how they performed.
+
+For every tool, a fresh copy of the corpus is generated, the tool is run on
+it, and its wall time, peak resident set size and edits per second are
+appended as one line of JSON to the results file, along with the corpus
+parameters and the git commit the tools were built from. Results of
+different commits can then be compared line by line.
+
+The edits are counted by comparing the corpus before and after the run, so
+a tool that misses edits, or fails, shows up as such rather than being
+credited with the edits it should have made.
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+import generate_corpus
+
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+TOOLS = ['fix-unused-args', 'add-virtual-override', 'cpp-cleanup',
+         'extract-method']
+
+# What each edit a tool makes adds to a file: a commented out parameter, a
+# "virtual" or "override", or the definition of the extracted function.
+UNUSED_MARKERS = [re.compile(r'/\*')]
+OVERRIDE_MARKERS = [re.compile(r'\bvirtual\b'), re.compile(r'\boverride\b')]
+EDIT_MARKERS = {
+    'fix-unused-args': UNUSED_MARKERS,
+    'add-virtual-override': OVERRIDE_MARKERS,
+    'cpp-cleanup': UNUSED_MARKERS + OVERRIDE_MARKERS,
+    'extract-method': [re.compile(r'^\S.*\bextracted\(', re.MULTILINE)],
+}
+
+
+def tool_command(tool, corpus, jobs):
+    binary = os.path.join(REPO_DIR, tool, tool)
+    if tool == 'extract-method':
+        extract = corpus['extract']
+        return [binary, extract['file'],
+                '-first=%d' % extract['first'],
+                '-last=%d' % extract['last'],
+                '-name=extracted']
+    return [binary, '-j', str(jobs)] + corpus['sources']
+
+
+def read_sources(corpus_dir):
+    """Returns the contents of the corpus's headers and source files, by
+    path relative to corpus_dir."""
+    contents = {}
+    for subdir in ('include', 'src'):
+        directory = os.path.join(corpus_dir, subdir)
+        for name in sorted(os.listdir(directory)):
+            path = os.path.join(directory, name)
+            with open(path) as f:
+                contents[os.path.join(subdir, name)] = f.read()
+    return contents
+
+
+def count_edits(tool, before, after):
+    """Returns the number of edits the tool made to turn the sources before
+    into the sources after, counted as the number of times each of the
+    tool's markers was added to a file."""
+    edits = 0
+    for path in sorted(after):
+        old = before.get(path, '')
+        new = after[path]
+        if old == new:
+            continue
+        for marker in EDIT_MARKERS[tool]:
+            added = len(marker.findall(new)) - len(marker.findall(old))
+            edits += max(0, added)
+    return edits
+
+
+def run_and_measure(command, cwd):
+    """Runs a command, and returns its exit status, wall time in seconds and
+    peak resident set size in kilobytes."""
+    start = time.time()
+    process = subprocess.Popen(command, cwd=cwd)
+    _, status, usage = os.wait4(process.pid, 0)
+    wall = time.time() - start
+    # ru_maxrss is in bytes on Mac OS X, and in kilobytes elsewhere.
+    peak_rss = usage.ru_maxrss
+    if sys.platform == 'darwin':
+        peak_rss //= 1024
+    return os.WEXITSTATUS(status), wall, peak_rss
+
+
+def git_commit():
+    try:
+        with open(os.devnull, 'w') as devnull:
+            return subprocess.check_output(
+                ['git', 'rev-parse', 'HEAD'], cwd=REPO_DIR,
+                stderr=devnull).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return 'unknown'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--tools', default=','.join(TOOLS),
+                        help='comma-separated list of tools to run')
+    parser.add_argument('--jobs', type=int, default=1,
+                        help='value of -j for the tools that support it')
+    parser.add_argument('--results', default='results.jsonl',
+                        help='file to append the results to')
+    parser.add_argument('--keep', action='store_true',
+                        help="don't delete the corpus afterwards")
+    generate_corpus.add_corpus_arguments(parser)
+    args = parser.parse_args()
+
+    params = generate_corpus.corpus_params(args)
+    commit = git_commit()
+    failed = False
+    for tool in args.tools.split(','):
+        if tool not in TOOLS:
+            sys.exit('Unknown tool: %s' % tool)
+
+        # The tools change the corpus, so every tool gets its own.
+        corpus_dir = tempfile.mkdtemp(prefix='cpp-tools-corpus-')
+        try:
+            corpus = generate_corpus.generate(corpus_dir, params)
+            before = read_sources(corpus_dir)
+            command = tool_command(tool, corpus, args.jobs)
+            status, wall, peak_rss = run_and_measure(command, corpus_dir)
+            edits = count_edits(tool, before, read_sources(corpus_dir))
+        finally:
+            if args.keep:
+                print('Corpus for %s kept in %s' % (tool, corpus_dir))
+            else:
+                shutil.rmtree(corpus_dir)
+
+        # A run that failed has no meaningful rate, whatever it managed to
+        # write before failing.
+        succeeded = status == 0
+        rate = None
+        if succeeded and wall:
+            rate = round(edits / wall, 2)
+        result = {
+            'commit': commit,
+            'tool': tool,
+            'jobs': args.jobs if tool != 'extract-method' else 1,
+            'params': corpus['params'],
+            'exit_status': status,
+            'failed': not succeeded,
+            'wall_seconds': round(wall, 4),
+            'peak_rss_kb': peak_rss,
+            'edits': edits,
+            'expected_edits': corpus['expected_edits'][tool],
+            'edits_per_second': rate,
+        }
+        with open(args.results, 'a') as f:
+            f.write(json.dumps(result, sort_keys=True) + '\n')
+        if succeeded:
+            print('%-22s %8.3fs %10d KB %10.1f edits/s  (%d of %d edits)' % (
+                tool, wall, peak_rss, rate or 0, edits,
+                result['expected_edits']))
+        else:
+            print('%-22s %8.3fs %10d KB     FAILED  (exit status %d)' % (
+                tool, wall, peak_rss, status))
+            failed = True
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
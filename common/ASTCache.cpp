@@ -0,0 +1,302 @@
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclGroup.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemOptions.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Serialization/ASTWriter.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "ASTCache.h"
+#include "SourceFiles.h"
+#include "Trace.h"
+#include <algorithm>
+#include <dirent.h>
+#include <sstream>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+using namespace clang;
+using namespace clang::tooling;
+using namespace llvm;
+
+// Bump this whenever the format of the entries changes.
+static const char *const EntryHeader = "cpp-tools-ast-cache 1";
+
+namespace {
+  // Parses a translation unit for the tool's action, and writes its AST
+  // out as well.
+  class SaveASTAction : public WrapperFrontendAction {
+  public:
+    SaveASTAction(FrontendAction *ToolAction,
+                  const std::string &OutputPath,
+                  std::vector<FileDependency> &Deps)
+      : WrapperFrontendAction(ToolAction)
+      , OutputPath(OutputPath)
+      , Deps(Deps)
+      {}
+
+  protected:
+    virtual ASTConsumer *CreateASTConsumer(CompilerInstance &CI,
+                                           StringRef InFile) {
+      std::string ErrorInfo;
+      Out.reset(new raw_fd_ostream(OutputPath.c_str(), ErrorInfo,
+                                   raw_fd_ostream::F_Binary));
+      if (!ErrorInfo.empty()) return 0;
+
+      ASTConsumer *ToolConsumer =
+          WrapperFrontendAction::CreateASTConsumer(CI, InFile);
+      if (!ToolConsumer) return 0;
+
+      // Other tools, or this one with a different filter, may need the
+      // function bodies this one would rather skip.
+      CI.getFrontendOpts().SkipFunctionBodies = false;
+
+      std::vector<ASTConsumer*> Consumers;
+      Consumers.push_back(ToolConsumer);
+      Consumers.push_back(new PCHGenerator(CI.getPreprocessor(), OutputPath,
+                                           /*Module*/0, /*isysroot*/"",
+                                           Out.get()));
+      return new MultiplexConsumer(Consumers);
+    }
+
+    virtual void EndSourceFileAction() {
+      CollectDependencies(getCompilerInstance().getSourceManager(), Deps);
+      WrapperFrontendAction::EndSourceFileAction();
+    }
+
+  private:
+    const std::string OutputPath;
+    std::vector<FileDependency> &Deps;
+    OwningPtr<raw_ostream> Out;
+  };
+
+  // Runs the tool's action on an AST loaded from the cache. There's nothing
+  // to parse, so the AST's top-level decls are handed straight to the
+  // tool's consumer.
+  class LoadedASTAction : public WrapperFrontendAction {
+  public:
+    explicit LoadedASTAction(FrontendAction *ToolAction)
+      : WrapperFrontendAction(ToolAction)
+      {}
+
+  protected:
+    virtual void ExecuteAction() {
+      CompilerInstance &CI = getCompilerInstance();
+      ASTConsumer &Consumer = CI.getASTConsumer();
+      ASTContext &Context = CI.getASTContext();
+      Consumer.Initialize(Context);
+      TranslationUnitDecl *TU = Context.getTranslationUnitDecl();
+      for (auto DI = TU->decls_begin(), DE = TU->decls_end(); DI != DE; ++DI) {
+        // Skip the builtin typedefs the parser would never have handed over.
+        if ((*DI)->isImplicit()) continue;
+        Consumer.HandleTopLevelDecl(DeclGroupRef(*DI));
+      }
+      Consumer.HandleTranslationUnit(Context);
+    }
+  };
+}
+
+// Takes ownership of ToolAction.
+static bool RunActionOnSavedAST(FrontendAction *ToolAction,
+                                const std::string &ASTPath) {
+  LoadedASTAction Action(ToolAction);
+  CompilerInstance Compiler;
+  Compiler.createDiagnostics(0, 0);
+  if (!Action.BeginSourceFile(Compiler, FrontendInputFile(ASTPath, IK_AST))) {
+    return false;
+  }
+  Action.Execute();
+  Action.EndSourceFile();
+  return !Compiler.getDiagnostics().hasErrorOccurred();
+}
+
+ASTCache::ASTCache(std::string CacheDir, uint64_t MaxBytes)
+  : CacheDir(std::move(CacheDir))
+  , MaxBytes(MaxBytes) {
+  mkdir(this->CacheDir.c_str(), 0777);
+}
+
+std::string ASTCache::getEntryPath(const std::string &Key) const {
+  std::string Path;
+  raw_string_ostream Out(Path);
+  Out << CacheDir << "/"
+      << format("%llx", (unsigned long long)HashFileContents(Key));
+  return Out.str();
+}
+
+bool ASTCache::run(
+    const std::string &File,
+    const std::string &Directory,
+    const std::vector<std::string> &CommandLine,
+    const std::function<FrontendAction *()> &CreateAction,
+    std::vector<FileDependency> &Deps) {
+  std::string Key = File;
+  for (auto AI = CommandLine.begin(), AE = CommandLine.end(); AI != AE; ++AI) {
+    Key += '\0' + *AI;
+  }
+  const std::string ASTPath = getEntryPath(Key) + ".ast";
+
+  std::vector<FileDependency> StoredDeps;
+  if (lookup(Key, StoredDeps)) {
+    TraceSpan Span("load AST", File);
+    if (RunActionOnSavedAST(CreateAction(), ASTPath)) {
+      // Mark it as recently used.
+      utimes(ASTPath.c_str(), 0);
+      Deps.insert(Deps.end(), StoredDeps.begin(), StoredDeps.end());
+      return true;
+    }
+    // Clang refused the AST, e.g. because a file was touched after it was
+    // saved. Parse the translation unit instead, and save it again.
+  }
+
+  const std::string TempPath =
+      ASTPath + ".tmp" + utostr(getpid()) + "." +
+      utostr(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  std::vector<FileDependency> ParsedDeps;
+  bool Succeeded;
+  {
+    TraceSpan Span("frontend", File);
+    // The AST writer listens to the stat calls of the file manager it's
+    // given, so it gets one of its own rather than the worker's. It's the
+    // file manager, not the command line, that decides which directory
+    // relative paths are resolved against.
+    FileSystemOptions Options;
+    Options.WorkingDir = Directory;
+    FileManager Files(Options);
+    ToolInvocation Invocation(
+        CommandLine,
+        new SaveASTAction(CreateAction(), TempPath, ParsedDeps),
+        &Files);
+    Succeeded = Invocation.run();
+  }
+  if (!Succeeded || !store(Key, TempPath, ParsedDeps)) {
+    remove(TempPath.c_str());
+  }
+  Deps.insert(Deps.end(), ParsedDeps.begin(), ParsedDeps.end());
+  return Succeeded;
+}
+
+bool ASTCache::lookup(const std::string &Key,
+                      std::vector<FileDependency> &Deps) {
+  std::string Contents;
+  if (!ReadFileContents(getEntryPath(Key) + ".deps", Contents)) return false;
+  std::istringstream In(Contents);
+
+  std::string Header, StoredKey;
+  if (!std::getline(In, Header) || Header != EntryHeader) return false;
+  if (!ReadSizedString(In, StoredKey) || StoredKey != Key) return false;
+
+  for (std::string Tag; In >> Tag;) {
+    if (Tag == "end") return true;
+    if (Tag != "dep") return false;
+
+    FileDependency Dep;
+    int64_t StoredMTime = 0, MTime = 0;
+    uint64_t StoredSize = 0, Size = 0;
+    if (!(In >> Dep.ContentHash >> StoredMTime >> StoredSize)) return false;
+    if (In.get() != ' ') return false;
+    if (!ReadSizedString(In, Dep.FilePath)) return false;
+
+    // Clang won't load an AST if any of its files has a different
+    // modification time or size, so there's no point hashing them.
+    if (!StatFile(Dep.FilePath, MTime, Size)) return false;
+    if (MTime != StoredMTime || Size != StoredSize) return false;
+    Deps.push_back(std::move(Dep));
+  }
+  return false;
+}
+
+bool ASTCache::store(const std::string &Key,
+                     const std::string &TempPath,
+                     const std::vector<FileDependency> &Deps) {
+  std::string EntryContents;
+  raw_string_ostream Entry(EntryContents);
+  Entry << EntryHeader << "\n";
+  WriteSizedString(Entry, Key);
+  Entry << "\n";
+
+  for (auto DI = Deps.begin(), DE = Deps.end(); DI != DE; ++DI) {
+    // Make sure the modification time we record belongs to the contents
+    // the AST was parsed from.
+    int64_t MTime = 0;
+    uint64_t Size = 0;
+    std::string Contents;
+    if (!StatFile(DI->FilePath, MTime, Size)) return false;
+    if (!ReadFileContents(DI->FilePath, Contents) ||
+        HashFileContents(Contents) != DI->ContentHash) {
+      return false;
+    }
+
+    Entry << "dep " << DI->ContentHash << " " << MTime << " " << Size << " ";
+    WriteSizedString(Entry, DI->FilePath);
+    Entry << "\n";
+  }
+  Entry << "end\n";
+
+  // The AST goes into place first: a reader that finds the old list with
+  // the new AST only loads it if clang agrees that it's up to date.
+  const std::string EntryPath = getEntryPath(Key);
+  const std::string DepsTempPath = TempPath + ".deps";
+  if (!WriteFileContents(DepsTempPath, Entry.str())) {
+    remove(DepsTempPath.c_str());
+    return false;
+  }
+  if (rename(TempPath.c_str(), (EntryPath + ".ast").c_str()) != 0 ||
+      rename(DepsTempPath.c_str(), (EntryPath + ".deps").c_str()) != 0) {
+    remove(DepsTempPath.c_str());
+    return false;
+  }
+
+  evict();
+  return true;
+}
+
+void ASTCache::evict() {
+  std::lock_guard<std::mutex> Guard(EvictLock);
+  DIR *Dir = opendir(CacheDir.c_str());
+  if (!Dir) return;
+
+  struct CachedAST {
+    int64_t MTime;
+    uint64_t Size;
+    std::string Path;
+  };
+  std::vector<CachedAST> ASTs;
+  uint64_t TotalSize = 0;
+  while (struct dirent *Entry = readdir(Dir)) {
+    const std::string Name = Entry->d_name;
+    if (Name.size() < 4 || Name.compare(Name.size() - 4, 4, ".ast") != 0) {
+      continue;
+    }
+    CachedAST AST;
+    AST.Path = CacheDir + "/" + Name;
+    if (!StatFile(AST.Path, AST.MTime, AST.Size)) continue;
+    TotalSize += AST.Size;
+    ASTs.push_back(AST);
+  }
+  closedir(Dir);
+  if (TotalSize <= MaxBytes) return;
+
+  // Delete the least recently used ones until the rest fit. Another run
+  // sharing the cache may be doing the same, so failures are ignored.
+  std::sort(ASTs.begin(), ASTs.end(),
+            [](const CachedAST &LHS, const CachedAST &RHS) {
+              return LHS.MTime < RHS.MTime;
+            });
+  for (auto AI = ASTs.begin(), AE = ASTs.end();
+       AI != AE && TotalSize > MaxBytes; ++AI) {
+    const std::string Base = AI->Path.substr(0, AI->Path.size() - 4);
+    remove((Base + ".deps").c_str());
+    remove(AI->Path.c_str());
+    TotalSize -= AI->Size;
+  }
+}
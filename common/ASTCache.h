@@ -0,0 +1,59 @@
+#ifndef CPP_TOOLS_COMMON_AST_CACHE_H
+#define CPP_TOOLS_COMMON_AST_CACHE_H
+
+#include "Edits.h"
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace clang {
+class FrontendAction;
+}
+
+// Keeps the serialized AST of each translation unit between runs, so that
+// a later run over the same unchanged files, even of a different tool or
+// with different options, loads the AST instead of parsing the translation
+// unit again.
+//
+// Each entry is a pair of files in the cache directory, named after a hash
+// of the translation unit's compile command: the AST itself, and a list of
+// the files it was parsed from, with their content hashes and the
+// modification times and sizes they had then. The AST is only loaded if
+// none of those have changed, which is also what clang checks when it
+// loads it.
+//
+// The cache is kept under a size limit by deleting the least recently used
+// ASTs whenever one is added. Using an AST counts as touching it.
+class ASTCache {
+public:
+  ASTCache(std::string CacheDir, uint64_t MaxBytes);
+
+  // Runs an action created by CreateAction on a translation unit. If its
+  // AST is in the cache, the action runs on the AST. Otherwise the
+  // translation unit is parsed with CommandLine, resolving relative paths
+  // against Directory, and its AST is added to the cache. The command line
+  // must be complete, e.g. include -working-directory. Fills in every file
+  // the translation unit read. Safe to call from several threads at once.
+  bool run(const std::string &File,
+           const std::string &Directory,
+           const std::vector<std::string> &CommandLine,
+           const std::function<clang::FrontendAction *()> &CreateAction,
+           std::vector<FileDependency> &Deps);
+
+private:
+  const std::string CacheDir;
+  const uint64_t MaxBytes;
+  // Only one thread evicts at a time.
+  std::mutex EvictLock;
+
+  std::string getEntryPath(const std::string &Key) const;
+  bool lookup(const std::string &Key, std::vector<FileDependency> &Deps);
+  bool store(const std::string &Key,
+             const std::string &TempPath,
+             const std::vector<FileDependency> &Deps);
+  void evict();
+};
+
+#endif
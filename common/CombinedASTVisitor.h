@@ -0,0 +1,77 @@
+#ifndef CPP_TOOLS_COMMON_COMBINED_AST_VISITOR_H
+#define CPP_TOOLS_COMMON_COMBINED_AST_VISITOR_H
+
+#include "clang/AST/RecursiveASTVisitor.h"
+#include <utility>
+
+// Runs two AST visitors in a single traversal. The combined visitor does the
+// traversing, and forwards each Visit* callback to both visitors, first to
+// First and then to Second. The calls are resolved at compile time, so
+// there's no virtual dispatch per node. Traversal stops as soon as either
+// visitor returns false. To combine more than two visitors, nest them:
+//
+//   CombinedASTVisitor<A, CombinedASTVisitor<B, C> >
+//
+// Only the Visit* callbacks of the visitors are used. Overridden Traverse*
+// or WalkUpFrom* methods, the operator-specific callbacks like VisitBinAdd,
+// and the traversal options like shouldVisitTemplateInstantiations() are
+// ignored; the defaults of RecursiveASTVisitor apply.
+template <typename FirstT, typename SecondT>
+class CombinedASTVisitor :
+  public clang::RecursiveASTVisitor<CombinedASTVisitor<FirstT, SecondT> > {
+public:
+  CombinedASTVisitor(FirstT First, SecondT Second)
+    : First(std::move(First))
+    , Second(std::move(Second))
+    {}
+
+  FirstT &getFirst() { return First; }
+  SecondT &getSecond() { return Second; }
+
+  bool VisitDecl(clang::Decl *D) {
+    return First.VisitDecl(D) && Second.VisitDecl(D);
+  }
+  bool VisitStmt(clang::Stmt *S) {
+    return First.VisitStmt(S) && Second.VisitStmt(S);
+  }
+  bool VisitType(clang::Type *T) {
+    return First.VisitType(T) && Second.VisitType(T);
+  }
+  bool VisitTypeLoc(clang::TypeLoc TL) {
+    return First.VisitTypeLoc(TL) && Second.VisitTypeLoc(TL);
+  }
+  bool VisitUnqualTypeLoc(clang::UnqualTypeLoc TL) {
+    return First.VisitUnqualTypeLoc(TL) && Second.VisitUnqualTypeLoc(TL);
+  }
+
+#define DECL(CLASS, BASE) \
+  bool Visit##CLASS##Decl(clang::CLASS##Decl *D) { \
+    return First.Visit##CLASS##Decl(D) && Second.Visit##CLASS##Decl(D); \
+  }
+#include "clang/AST/DeclNodes.inc"
+
+#define STMT(CLASS, PARENT) \
+  bool Visit##CLASS(clang::CLASS *S) { \
+    return First.Visit##CLASS(S) && Second.Visit##CLASS(S); \
+  }
+#include "clang/AST/StmtNodes.inc"
+
+#define TYPE(CLASS, BASE) \
+  bool Visit##CLASS##Type(clang::CLASS##Type *T) { \
+    return First.Visit##CLASS##Type(T) && Second.Visit##CLASS##Type(T); \
+  }
+#include "clang/AST/TypeNodes.def"
+
+#define TYPELOC(CLASS, BASE) \
+  bool Visit##CLASS##TypeLoc(clang::CLASS##TypeLoc TL) { \
+    return First.Visit##CLASS##TypeLoc(TL) && \
+           Second.Visit##CLASS##TypeLoc(TL); \
+  }
+#include "clang/AST/TypeLocNodes.def"
+
+private:
+  FirstT First;
+  SecondT Second;
+};
+
+#endif
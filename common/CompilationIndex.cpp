@@ -0,0 +1,343 @@
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "CompilationIndex.h"
+#include "Edits.h"
+#include "SourceFiles.h"
+#include <fcntl.h>
+#include <map>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace clang::tooling;
+using namespace llvm;
+
+namespace {
+  // The index starts with this header. It's followed by the string
+  // entries, the files, the commands, the arguments, the hash table and
+  // finally the characters of all the strings, in that order.
+  struct IndexHeader {
+    char Magic[8];
+    // The compile_commands.json the index was built from.
+    int64_t JSONMTime;
+    uint64_t JSONSize;
+    uint64_t JSONHash;
+    uint32_t NumStrings;
+    uint32_t NumFiles;
+    uint32_t NumCommands;
+    uint32_t NumArgs;
+    // A power of two, at least twice the number of files.
+    uint32_t NumBuckets;
+    uint32_t NumChars;
+  };
+
+  struct StringEntry {
+    uint32_t Offset;
+    uint32_t Length;
+  };
+
+  // The strings are referred to by their index.
+  struct FileEntry {
+    uint32_t Path;
+    uint32_t FirstCommand;
+    uint32_t NumCommands;
+  };
+
+  struct CommandEntry {
+    uint32_t Directory;
+    uint32_t FirstArg;
+    uint32_t NumArgs;
+  };
+
+  // Where each part of the index starts.
+  struct IndexLayout {
+    explicit IndexLayout(const IndexHeader &Header) {
+      Strings = sizeof(IndexHeader);
+      Files = Strings + Header.NumStrings * sizeof(StringEntry);
+      Commands = Files + Header.NumFiles * sizeof(FileEntry);
+      Args = Commands + Header.NumCommands * sizeof(CommandEntry);
+      Buckets = Args + Header.NumArgs * sizeof(uint32_t);
+      Chars = Buckets + Header.NumBuckets * sizeof(uint32_t);
+      End = Chars + Header.NumChars;
+    }
+
+    uint64_t Strings, Files, Commands, Args, Buckets, Chars, End;
+  };
+}
+
+// Bump the last character whenever the format changes.
+static const char IndexMagic[8] = { 'c', 'p', 'p', 't', 'i', 'd', 'x', '1' };
+
+template <typename T>
+static const T *GetSection(const char *Data, uint64_t Offset) {
+  return reinterpret_cast<const T *>(Data + Offset);
+}
+
+static uint32_t HashPath(StringRef Path) {
+  return (uint32_t)HashFileContents(Path.data(), Path.size());
+}
+
+IndexedCompilationDatabase::IndexedCompilationDatabase(const char *Data,
+                                                       size_t Size)
+  : Data(Data)
+  , Size(Size)
+  {}
+
+IndexedCompilationDatabase::~IndexedCompilationDatabase() {
+  munmap(const_cast<char *>(Data), Size);
+}
+
+StringRef IndexedCompilationDatabase::getString(uint32_t Index) const {
+  const IndexHeader &Header = *GetSection<IndexHeader>(Data, 0);
+  const IndexLayout Layout(Header);
+  if (Index >= Header.NumStrings) return StringRef();
+  const StringEntry &Entry =
+      GetSection<StringEntry>(Data, Layout.Strings)[Index];
+  if ((uint64_t)Entry.Offset + Entry.Length > Header.NumChars) {
+    return StringRef();
+  }
+  return StringRef(Data + Layout.Chars + Entry.Offset, Entry.Length);
+}
+
+std::vector<CompileCommand> IndexedCompilationDatabase::getCompileCommands(
+    StringRef FilePath) const {
+  // Files are looked up by their native path, like the JSON database does.
+  SmallString<256> NativePath;
+  sys::path::native(FilePath, NativePath);
+
+  const IndexHeader &Header = *GetSection<IndexHeader>(Data, 0);
+  const IndexLayout Layout(Header);
+  const uint32_t *Buckets = GetSection<uint32_t>(Data, Layout.Buckets);
+  const FileEntry *Files = GetSection<FileEntry>(Data, Layout.Files);
+  const CommandEntry *Commands =
+      GetSection<CommandEntry>(Data, Layout.Commands);
+  const uint32_t *Args = GetSection<uint32_t>(Data, Layout.Args);
+
+  std::vector<CompileCommand> Result;
+  const uint32_t Mask = Header.NumBuckets - 1;
+  uint32_t Bucket = HashPath(NativePath.str()) & Mask;
+  for (uint32_t Probe = 0; Probe != Header.NumBuckets;
+       ++Probe, Bucket = (Bucket + 1) & Mask) {
+    // Buckets hold the index of a file plus one, or zero if empty.
+    const uint32_t Entry = Buckets[Bucket];
+    if (!Entry || Entry > Header.NumFiles) return Result;
+    const FileEntry &File = Files[Entry - 1];
+    if (getString(File.Path) != NativePath.str()) continue;
+
+    for (uint32_t CI = File.FirstCommand,
+                  CE = CI + File.NumCommands; CI != CE; ++CI) {
+      if (CI >= Header.NumCommands) break;
+      const CommandEntry &Command = Commands[CI];
+      std::vector<std::string> CommandLine;
+      for (uint32_t AI = Command.FirstArg,
+                    AE = AI + Command.NumArgs; AI != AE; ++AI) {
+        if (AI >= Header.NumArgs) break;
+        CommandLine.push_back(getString(Args[AI]).str());
+      }
+      Result.push_back(CompileCommand(getString(Command.Directory),
+                                      CommandLine));
+    }
+    return Result;
+  }
+  return Result;
+}
+
+std::vector<std::string> IndexedCompilationDatabase::getAllFiles() const {
+  const IndexHeader &Header = *GetSection<IndexHeader>(Data, 0);
+  const IndexLayout Layout(Header);
+  const FileEntry *Files = GetSection<FileEntry>(Data, Layout.Files);
+  std::vector<std::string> Result;
+  for (uint32_t I = 0; I != Header.NumFiles; ++I) {
+    Result.push_back(getString(Files[I].Path).str());
+  }
+  return Result;
+}
+
+// Maps the index into memory. Returns null if it doesn't exist, or isn't a
+// complete index.
+static const char *MapIndex(const std::string &IndexPath, size_t &Size) {
+  int FD = open(IndexPath.c_str(), O_RDONLY);
+  if (FD < 0) return 0;
+  struct stat Status;
+  void *Mapped = MAP_FAILED;
+  if (fstat(FD, &Status) == 0 &&
+      (size_t)Status.st_size >= sizeof(IndexHeader)) {
+    Size = Status.st_size;
+    Mapped = mmap(0, Size, PROT_READ, MAP_PRIVATE, FD, 0);
+  }
+  close(FD);
+  if (Mapped == MAP_FAILED) return 0;
+
+  const char *Data = static_cast<const char *>(Mapped);
+  const IndexHeader &Header = *GetSection<IndexHeader>(Data, 0);
+  if (memcmp(Header.Magic, IndexMagic, sizeof(IndexMagic)) != 0 ||
+      IndexLayout(Header).End != Size ||
+      Header.NumBuckets == 0 ||
+      (Header.NumBuckets & (Header.NumBuckets - 1)) != 0 ||
+      Header.NumBuckets < 2 * (uint64_t)Header.NumFiles) {
+    munmap(Mapped, Size);
+    return 0;
+  }
+  return Data;
+}
+
+template <typename T>
+static void WriteSection(raw_ostream &Out, const std::vector<T> &Section) {
+  if (Section.empty()) return;
+  Out.write(reinterpret_cast<const char *>(&Section[0]),
+            Section.size() * sizeof(T));
+}
+
+// Writes an index of the database, stamped with what the JSON it came from
+// looked like.
+static bool WriteIndex(const std::string &IndexPath,
+                       const CompilationDatabase &Database,
+                       IndexHeader Header) {
+  std::vector<StringEntry> Strings;
+  std::string Chars;
+  std::map<std::string, uint32_t> StringIds;
+  auto Intern = [&](const std::string &String) -> uint32_t {
+    auto Inserted = StringIds.insert(std::make_pair(String,
+                                                    Strings.size()));
+    if (Inserted.second) {
+      StringEntry Entry = { (uint32_t)Chars.size(), (uint32_t)String.size() };
+      Strings.push_back(Entry);
+      Chars += String;
+    }
+    return Inserted.first->second;
+  };
+
+  std::vector<FileEntry> Files;
+  std::vector<CommandEntry> Commands;
+  std::vector<uint32_t> Args;
+  const std::vector<std::string> AllFiles = Database.getAllFiles();
+  for (auto FI = AllFiles.begin(), FE = AllFiles.end(); FI != FE; ++FI) {
+    const std::vector<CompileCommand> FileCommands =
+        Database.getCompileCommands(*FI);
+    FileEntry File = { Intern(*FI), (uint32_t)Commands.size(),
+                       (uint32_t)FileCommands.size() };
+    Files.push_back(File);
+    for (auto CI = FileCommands.begin(), CE = FileCommands.end();
+         CI != CE; ++CI) {
+      CommandEntry Command = { Intern(CI->Directory), (uint32_t)Args.size(),
+                               (uint32_t)CI->CommandLine.size() };
+      Commands.push_back(Command);
+      for (auto AI = CI->CommandLine.begin(), AE = CI->CommandLine.end();
+           AI != AE; ++AI) {
+        Args.push_back(Intern(*AI));
+      }
+    }
+  }
+  // The offsets are 32-bit.
+  if (Chars.size() > UINT32_MAX) return false;
+
+  uint32_t NumBuckets = 1;
+  while (NumBuckets < 2 * Files.size()) NumBuckets *= 2;
+  std::vector<uint32_t> Buckets(NumBuckets);
+  for (uint32_t I = 0, E = Files.size(); I != E; ++I) {
+    uint32_t Bucket = HashPath(AllFiles[I]) & (NumBuckets - 1);
+    while (Buckets[Bucket]) Bucket = (Bucket + 1) & (NumBuckets - 1);
+    Buckets[Bucket] = I + 1;
+  }
+
+  memcpy(Header.Magic, IndexMagic, sizeof(IndexMagic));
+  Header.NumStrings = Strings.size();
+  Header.NumFiles = Files.size();
+  Header.NumCommands = Commands.size();
+  Header.NumArgs = Args.size();
+  Header.NumBuckets = NumBuckets;
+  Header.NumChars = Chars.size();
+
+  std::string Index;
+  raw_string_ostream Out(Index);
+  Out.write(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  WriteSection(Out, Strings);
+  WriteSection(Out, Files);
+  WriteSection(Out, Commands);
+  WriteSection(Out, Args);
+  WriteSection(Out, Buckets);
+  Out << Chars;
+  // Another run mustn't map half an index.
+  return WriteFileAtomically(IndexPath, Out.str());
+}
+
+// Records the JSON's new modification time and size in the index, after
+// it turned out to have the same contents.
+static bool RestampIndex(const std::string &IndexPath,
+                         int64_t MTime,
+                         uint64_t Size) {
+  int FD = open(IndexPath.c_str(), O_WRONLY);
+  if (FD < 0) return false;
+  const bool Written =
+      pwrite(FD, &MTime, sizeof(MTime), offsetof(IndexHeader, JSONMTime))
+          == sizeof(MTime) &&
+      pwrite(FD, &Size, sizeof(Size), offsetof(IndexHeader, JSONSize))
+          == sizeof(Size);
+  close(FD);
+  return Written;
+}
+
+CompilationDatabase *IndexedCompilationDatabase::loadFromDirectory(
+    StringRef Directory, std::string &ErrorMessage) {
+  SmallString<256> Path(Directory);
+  sys::path::append(Path, "compile_commands.json");
+  const std::string JSONPath = Path.str().str();
+  sys::path::remove_filename(Path);
+  sys::path::append(Path, "compile_commands.idx");
+  const std::string IndexPath = Path.str().str();
+
+  int64_t MTime = 0;
+  uint64_t Size = 0;
+  if (!StatFile(JSONPath, MTime, Size)) {
+    ErrorMessage = "Could not find " + JSONPath + ".";
+    return 0;
+  }
+
+  size_t MappedSize = 0;
+  const char *Mapped = MapIndex(IndexPath, MappedSize);
+  if (Mapped) {
+    const IndexHeader &Header = *GetSection<IndexHeader>(Mapped, 0);
+    if (Header.JSONMTime == MTime && Header.JSONSize == Size) {
+      return new IndexedCompilationDatabase(Mapped, MappedSize);
+    }
+  }
+
+  // The JSON was touched, e.g. by re-running CMake, which may not have
+  // changed anything.
+  std::string Contents;
+  if (!ReadFileContents(JSONPath, Contents)) {
+    if (Mapped) munmap(const_cast<char *>(Mapped), MappedSize);
+    ErrorMessage = "Could not read " + JSONPath + ".";
+    return 0;
+  }
+  const uint64_t Hash = HashFileContents(Contents);
+  if (Mapped) {
+    if (GetSection<IndexHeader>(Mapped, 0)->JSONHash == Hash) {
+      RestampIndex(IndexPath, MTime, Size);
+      return new IndexedCompilationDatabase(Mapped, MappedSize);
+    }
+    munmap(const_cast<char *>(Mapped), MappedSize);
+  }
+
+  OwningPtr<CompilationDatabase> JSON(
+      JSONCompilationDatabase::loadFromBuffer(Contents, ErrorMessage));
+  if (!JSON) return 0;
+
+  IndexHeader Stamp;
+  memset(&Stamp, 0, sizeof(Stamp));
+  Stamp.JSONMTime = MTime;
+  Stamp.JSONSize = Size;
+  Stamp.JSONHash = Hash;
+  if (WriteIndex(IndexPath, *JSON, Stamp)) {
+    Mapped = MapIndex(IndexPath, MappedSize);
+    if (Mapped) return new IndexedCompilationDatabase(Mapped, MappedSize);
+  }
+  // E.g. the build directory isn't writable. The JSON database refers to
+  // the contents it was parsed from, which go away here, so it has to be
+  // loaded again.
+  JSON.reset();
+  return JSONCompilationDatabase::loadFromFile(JSONPath, ErrorMessage);
+}
@@ -0,0 +1,46 @@
+#ifndef CPP_TOOLS_COMMON_COMPILATION_INDEX_H
+#define CPP_TOOLS_COMMON_COMPILATION_INDEX_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringRef.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A compilation database read from a compact binary index of a
+// compile_commands.json, so that a run doesn't have to parse the whole JSON
+// just to look up a few files.
+//
+// The index lives next to the JSON as compile_commands.idx. Every distinct
+// string, i.e. every path and flag, is stored once, and files are found
+// through a hash table, so the index is memory-mapped and used as it is.
+// It's rebuilt whenever the JSON's modification time and size no longer
+// match, unless its contents still hash the same.
+class IndexedCompilationDatabase
+  : public clang::tooling::CompilationDatabase {
+public:
+  // Loads the compile_commands.json in Directory through its index,
+  // building the index first if needed. If the index can't be written, the
+  // JSON is used directly. Returns null and sets ErrorMessage if there's no
+  // compile_commands.json, or it can't be parsed.
+  static clang::tooling::CompilationDatabase *loadFromDirectory(
+      llvm::StringRef Directory, std::string &ErrorMessage);
+
+  virtual ~IndexedCompilationDatabase();
+
+  virtual std::vector<clang::tooling::CompileCommand> getCompileCommands(
+      llvm::StringRef FilePath) const;
+  virtual std::vector<std::string> getAllFiles() const;
+
+private:
+  IndexedCompilationDatabase(const char *Data, size_t Size);
+
+  // The mapped index.
+  const char *Data;
+  size_t Size;
+
+  llvm::StringRef getString(uint32_t Index) const;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Path.h"
+#include "CompilationIndex.h"
+#include "CompileCommands.h"
+#include "SourceFiles.h"
+#include <set>
+using namespace clang::tooling;
+using namespace llvm;
+
+bool IsInputFileArgument(const CompileCommand &Command,
+                         StringRef Arg,
+                         StringRef File) {
+  if (Arg.empty() || Arg[0] == '-') return false;
+  if (Arg == File) return true;
+  if (sys::path::is_absolute(Arg)) return false;
+
+  SmallString<256> Path(Command.Directory);
+  sys::path::append(Path, Arg);
+  return Path.str() == File;
+}
+
+// Returns whether an argument only affects the compiler's diagnostics or
+// debug info, or what it does after parsing, so that leaving it out can't
+// change the AST.
+static bool IsNonSemanticArgument(StringRef Arg) {
+  // Debug info, but not -gcc-toolchain, which affects the include paths.
+  if (Arg.startswith("-g") && !Arg.startswith("-gcc-toolchain")) return true;
+  // Warnings, and options for the linker and assembler. Options passed to
+  // the preprocessor with -Wp, are kept.
+  if (Arg.startswith("-W") && !Arg.startswith("-Wp,")) return true;
+  if (Arg == "-w" || Arg == "-pipe" || Arg == "-MP") return true;
+  if (Arg.startswith("-fdiagnostics-") || Arg.startswith("-fmessage-length")) {
+    return true;
+  }
+  return Arg == "-fcolor-diagnostics" || Arg == "-fno-color-diagnostics" ||
+         Arg == "-ffunction-sections" || Arg == "-fdata-sections";
+}
+
+std::vector<std::string> GetSemanticArguments(const CompileCommand &Command,
+                                              StringRef File) {
+  std::vector<std::string> Args;
+  const std::vector<std::string> &CommandLine = Command.CommandLine;
+  // The first argument is the compiler itself.
+  for (size_t I = 1, E = CommandLine.size(); I < E; ++I) {
+    StringRef Arg = CommandLine[I];
+
+    // Options that name an output file, along with the file.
+    if (Arg == "-o" || Arg == "-MF" || Arg == "-MT" || Arg == "-MQ") {
+      ++I;
+      continue;
+    }
+    if (Arg.startswith("-o") && !Arg.startswith("-obj")) continue;
+    // Options that only say which outputs to produce.
+    if (Arg == "-c" || Arg == "-MD" || Arg == "-MMD") continue;
+    if (IsNonSemanticArgument(Arg)) continue;
+    if (IsInputFileArgument(Command, Arg, File)) continue;
+
+    Args.push_back(Arg);
+  }
+  return Args;
+}
+
+std::string GetFlagSetKey(const CompileCommand &Command, StringRef File) {
+  std::vector<std::string> Args = GetSemanticArguments(Command, File);
+  std::string Key = Command.Directory;
+  for (auto AI = Args.begin(), AE = Args.end(); AI != AE; ++AI) {
+    Key += '\0';
+    Key += *AI;
+  }
+  return Key;
+}
+
+std::vector<CompileCommand> GetDistinctCommands(
+    const std::vector<CompileCommand> &Commands,
+    StringRef File) {
+  std::vector<CompileCommand> Distinct;
+  std::set<std::string> Seen;
+  for (auto CI = Commands.begin(), CE = Commands.end(); CI != CE; ++CI) {
+    if (Seen.insert(GetFlagSetKey(*CI, File)).second) {
+      Distinct.push_back(*CI);
+    }
+  }
+  return Distinct;
+}
+
+// Loads the compilation database in a directory. A compile_commands.json is
+// read through its binary index.
+static CompilationDatabase *LoadFromDirectory(StringRef Directory,
+                                              std::string &ErrorMessage) {
+  if (CompilationDatabase *Indexed =
+          IndexedCompilationDatabase::loadFromDirectory(Directory,
+                                                        ErrorMessage)) {
+    return Indexed;
+  }
+  return CompilationDatabase::autoDetectFromDirectory(Directory,
+                                                      ErrorMessage);
+}
+
+std::string LoadCompilationDatabaseIfNotFound(
+    OwningPtr<CompilationDatabase> &Compilations,
+    StringRef BuildPath,
+    StringRef SourcePath) {
+
+  if (Compilations) return std::string();
+
+  std::string ErrorMessage;
+  if (!BuildPath.empty()) {
+    Compilations.reset(LoadFromDirectory(BuildPath, ErrorMessage));
+    if (Compilations) return BuildPath.str();
+  } else {
+    // Look in the source file's directory and then its parents, like
+    // autoDetectFromSource(), but remember where the database was, and
+    // use the index.
+    const std::string AbsolutePath = GetAbsolutePath(SourcePath);
+    for (StringRef Directory = sys::path::parent_path(AbsolutePath);
+         !Directory.empty();
+         Directory = sys::path::parent_path(Directory)) {
+      std::string LoadError;
+      Compilations.reset(LoadFromDirectory(Directory, LoadError));
+      if (Compilations) return Directory.str();
+    }
+    ErrorMessage = "Could not auto-detect compilation database for file \"" +
+                   SourcePath.str() + "\"";
+  }
+  llvm::report_fatal_error(ErrorMessage);
+}
@@ -0,0 +1,44 @@
+#ifndef CPP_TOOLS_COMMON_COMPILE_COMMANDS_H
+#define CPP_TOOLS_COMMON_COMPILE_COMMANDS_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
+#include <vector>
+
+// Returns whether a compile command argument names the given input file,
+// which must be absolute.
+bool IsInputFileArgument(const clang::tooling::CompileCommand &Command,
+                         llvm::StringRef Arg,
+                         llvm::StringRef File);
+
+// Returns the arguments of a compile command that affect how its input
+// file is parsed: the input file itself, output files, warnings, debug info
+// and options that only affect code generation or linking are left out.
+std::vector<std::string> GetSemanticArguments(
+    const clang::tooling::CompileCommand &Command,
+    llvm::StringRef File);
+
+// Returns a key that's the same for two compile commands exactly when they
+// parse their input files in the same way, from the same directory.
+std::string GetFlagSetKey(const clang::tooling::CompileCommand &Command,
+                          llvm::StringRef File);
+
+// Drops the commands that parse File the same way as an earlier one, e.g.
+// the same flags with different output paths, or in a debug and a release
+// build that only differ in debug info and warnings.
+std::vector<clang::tooling::CompileCommand> GetDistinctCommands(
+    const std::vector<clang::tooling::CompileCommand> &Commands,
+    llvm::StringRef File);
+
+// If no compilation database was given on the command line, loads one from
+// BuildPath, or if that's empty, finds one for SourcePath. Reports a fatal
+// error if there's none. Returns the directory the database was loaded
+// from, or an empty string if it was given on the command line.
+std::string LoadCompilationDatabaseIfNotFound(
+    llvm::OwningPtr<clang::tooling::CompilationDatabase> &Compilations,
+    llvm::StringRef BuildPath,
+    llvm::StringRef SourcePath);
+
+#endif
@@ -0,0 +1,172 @@
+#include "llvm/Support/raw_ostream.h"
+#include "CostModel.h"
+#include "Edits.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/file.h>
+#include <unistd.h>
+using namespace llvm;
+using namespace std;
+
+static const char StatsHeader[] = "cpp-tools-costs 1";
+
+// Roughly how much parsing an #include adds, in bytes of source.
+static const double IncludeCost = 16 * 1024;
+// Seconds per byte of source, for when nothing has been measured yet.
+static const double DefaultSecondsPerByte = 1e-6;
+
+// Reads the measurements in a stats file into Seconds. Returns false if
+// the file can't be read, or isn't a stats file.
+static bool ReadStats(const string &Path, map<string, double> &Seconds) {
+  string Contents;
+  if (!ReadFileContents(Path, Contents)) return false;
+  istringstream In(Contents);
+  string Header;
+  if (!getline(In, Header) || Header != StatsHeader) return false;
+
+  double Measured = 0;
+  string File;
+  while (In >> Measured && In.get() == ' ' && ReadSizedString(In, File)) {
+    Seconds[File] = Measured;
+  }
+  return true;
+}
+
+TUCostModel::TUCostModel(string StatsPath)
+  : StatsPath(std::move(StatsPath))
+  , SavePath(this->StatsPath) {
+  if (!this->StatsPath.empty()) ReadStats(this->StatsPath, Seconds);
+}
+
+// Estimates the cost of a file from its size and its number of #includes,
+// in bytes of source.
+static double EstimateSize(const string &File) {
+  string Contents;
+  if (!ReadFileContents(File, Contents)) return 0;
+
+  size_t Includes = 0;
+  for (size_t Pos = Contents.find("#include"); Pos != string::npos;
+       Pos = Contents.find("#include", Pos + 1)) {
+    ++Includes;
+  }
+  return Contents.size() + Includes * IncludeCost;
+}
+
+vector<double> TUCostModel::predict(const vector<string> &Files) const {
+  vector<double> Costs(Files.size(), -1);
+  bool AnyUnmeasured = false;
+  for (size_t I = 0, E = Files.size(); I != E; ++I) {
+    auto Found = Seconds.find(Files[I]);
+    if (Found != Seconds.end()) {
+      Costs[I] = Found->second;
+    } else {
+      AnyUnmeasured = true;
+    }
+  }
+  if (!AnyUnmeasured) return Costs;
+
+  // Work out how long a byte takes from the files that have been measured,
+  // so that the estimates can be compared with their measurements.
+  vector<double> Sizes(Files.size());
+  double MeasuredSeconds = 0, MeasuredSize = 0;
+  for (size_t I = 0, E = Files.size(); I != E; ++I) {
+    Sizes[I] = EstimateSize(Files[I]);
+    if (Costs[I] >= 0) {
+      MeasuredSeconds += Costs[I];
+      MeasuredSize += Sizes[I];
+    }
+  }
+  const double SecondsPerByte = MeasuredSize > 0 && MeasuredSeconds > 0
+                              ? MeasuredSeconds / MeasuredSize
+                              : DefaultSecondsPerByte;
+  for (size_t I = 0, E = Files.size(); I != E; ++I) {
+    if (Costs[I] < 0) Costs[I] = Sizes[I] * SecondsPerByte;
+  }
+  return Costs;
+}
+
+void TUCostModel::record(const string &File, double Seconds) {
+  auto Inserted = Measured.insert(make_pair(File, Seconds));
+  if (!Inserted.second) {
+    Inserted.first->second = (Inserted.first->second + Seconds) / 2;
+  }
+}
+
+bool TUCostModel::addMeasurements(const string &Path) {
+  map<string, double> Saved;
+  if (!ReadStats(Path, Saved)) return false;
+  for (auto SI = Saved.begin(), SE = Saved.end(); SI != SE; ++SI) {
+    record(SI->first, SI->second);
+  }
+  return true;
+}
+
+namespace {
+  // Holds an exclusive lock on a file for as long as it lives.
+  class FileLock {
+  public:
+    explicit FileLock(const string &Path)
+      : FD(open(Path.c_str(), O_RDWR | O_CREAT, 0666)) {
+      if (FD < 0) return;
+      while (flock(FD, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+          close(FD);
+          FD = -1;
+          return;
+        }
+      }
+    }
+    ~FileLock() {
+      if (FD >= 0) close(FD);
+    }
+
+    bool isLocked() const { return FD >= 0; }
+
+  private:
+    int FD;
+  };
+}
+
+bool TUCostModel::save() const {
+  if (SavePath.empty() || Measured.empty()) return true;
+
+  // The lock is on a file of its own, since the stats file is replaced
+  // rather than written in place.
+  FileLock Lock(SavePath + ".lock");
+  if (!Lock.isLocked()) return false;
+
+  // Average with the latest measurements, including those saved by other
+  // runs since this one started, so that a single slow run, e.g. on a busy
+  // machine, doesn't throw the order off.
+  map<string, double> Merged;
+  ReadStats(SavePath, Merged);
+  for (auto MI = Measured.begin(), ME = Measured.end(); MI != ME; ++MI) {
+    auto Inserted = Merged.insert(*MI);
+    if (!Inserted.second) {
+      Inserted.first->second = (Inserted.first->second + MI->second) / 2;
+    }
+  }
+
+  string Stats;
+  raw_string_ostream Out(Stats);
+  Out << StatsHeader << "\n";
+  for (auto SI = Merged.begin(), SE = Merged.end(); SI != SE; ++SI) {
+    Out << SI->second << ' ';
+    WriteSizedString(Out, SI->first);
+    Out << "\n";
+  }
+  return WriteFileAtomically(SavePath, Out.str());
+}
+
+vector<unsigned> GetLongestFirstOrder(const vector<double> &Costs) {
+  vector<unsigned> Order(Costs.size());
+  for (size_t I = 0, E = Costs.size(); I != E; ++I) {
+    Order[I] = I;
+  }
+  stable_sort(Order.begin(), Order.end(), [&](unsigned LHS, unsigned RHS) {
+    return Costs[LHS] > Costs[RHS];
+  });
+  return Order;
+}
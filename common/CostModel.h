@@ -0,0 +1,56 @@
+#ifndef CPP_TOOLS_COMMON_COST_MODEL_H
+#define CPP_TOOLS_COMMON_COST_MODEL_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Predicts how long each translation unit takes to parse and traverse, from
+// how long it took in earlier runs, so that the most expensive ones can be
+// started first and a big one picked up last doesn't leave the other
+// workers idle. The measurements are kept in a small stats file, normally
+// next to the compilation database.
+class TUCostModel {
+public:
+  // Loads the measurements in the stats file, if there is one. With an
+  // empty path, costs are only estimated and nothing is saved.
+  explicit TUCostModel(std::string StatsPath);
+
+  // Returns the predicted cost of each file, in seconds. Files that have
+  // never been measured are estimated from their size and number of
+  // #includes, scaled to match the measured ones.
+  std::vector<double> predict(const std::vector<std::string> &Files) const;
+
+  // Records how long a file took in this run.
+  void record(const std::string &File, double Seconds);
+
+  // Adds the measurements saved in another stats file, e.g. by a shard, to
+  // this run's. Returns false if it can't be read.
+  bool addMeasurements(const std::string &Path);
+
+  // Saves this run's measurements to another stats file instead of the one
+  // they were loaded from. A shard does, so that the costs the other
+  // shards pick their files by don't change under them.
+  void setSavePath(std::string Path) { SavePath = std::move(Path); }
+
+  // Merges this run's measurements into the stats file, or the one given
+  // with setSavePath(). The file is locked and read again first, so that
+  // runs saving at the same time each add their measurements instead of
+  // the last one's replacing the rest. Returns false if it can't be
+  // written.
+  bool save() const;
+
+private:
+  const std::string StatsPath;
+  std::string SavePath;
+  // The measurements loaded from the stats file, keyed by absolute path.
+  std::map<std::string, double> Seconds;
+  // The measurements made in this run, keyed by absolute path.
+  std::map<std::string, double> Measured;
+};
+
+// Returns the order to run the items in, most expensive first. Items that
+// cost the same keep their original order.
+std::vector<unsigned> GetLongestFirstOrder(const std::vector<double> &Costs);
+
+#endif
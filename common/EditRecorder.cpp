@@ -0,0 +1,86 @@
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "EditRecorder.h"
+#include "SourceFiles.h"
+using namespace clang;
+using namespace llvm;
+
+bool EditRecorder::InsertTextBefore(SourceLocation Loc, StringRef Str) {
+  return addEdit(Loc, 0, 0, Str, /*InsertBefore*/true);
+}
+
+bool EditRecorder::InsertTextAfter(SourceLocation Loc, StringRef Str) {
+  return addEdit(Loc, 0, 0, Str, /*InsertBefore*/false);
+}
+
+bool EditRecorder::InsertTextAfterToken(SourceLocation Loc, StringRef Str) {
+  if (!Loc.isFileID()) return true;
+  unsigned TokenLength = Lexer::MeasureTokenLength(Loc, SM, LangOpts);
+  return addEdit(Loc, TokenLength, 0, Str, /*InsertBefore*/false);
+}
+
+bool EditRecorder::ReplaceText(SourceRange Range, StringRef NewStr) {
+  SourceLocation Begin = Range.getBegin(), End = Range.getEnd();
+  if (!Begin.isFileID() || !End.isFileID()) return true;
+
+  std::pair<FileID, unsigned> BeginLoc = SM.getDecomposedLoc(Begin);
+  std::pair<FileID, unsigned> EndLoc = SM.getDecomposedLoc(End);
+  if (BeginLoc.first != EndLoc.first) return true;
+  if (EndLoc.second < BeginLoc.second) return true;
+
+  // Like the Rewriter, the range includes all of its last token.
+  unsigned Length = EndLoc.second - BeginLoc.second
+                  + Lexer::MeasureTokenLength(End, SM, LangOpts);
+  return addEdit(Begin, 0, Length, NewStr, /*InsertBefore*/false);
+}
+
+void EditRecorder::takeEdits(std::vector<FileEdits> &Out) {
+  for (auto FI = Files.begin(), FE = Files.end(); FI != FE; ++FI) {
+    Out.push_back(std::move(*FI));
+  }
+  Files.clear();
+  FileIndex.clear();
+}
+
+bool EditRecorder::addEdit(SourceLocation Loc,
+                           unsigned ExtraOffset,
+                           unsigned Length,
+                           StringRef Text,
+                           bool InsertBefore) {
+  // Only locations that are spelled out in a file can be edited; the
+  // Rewriter has the same restriction.
+  if (!Loc.isFileID()) return true;
+
+  std::pair<FileID, unsigned> Decomposed = SM.getDecomposedLoc(Loc);
+  FileEdits *Edits = getFileEdits(Decomposed.first);
+  if (!Edits) return true;
+
+  Edits->Edits.push_back(Edit(Decomposed.second + ExtraOffset,
+                              Length,
+                              Text,
+                              InsertBefore));
+  Edits->Edits.back().RequiresAllConfigurations = RequiresAllConfigurations;
+  return false;
+}
+
+FileEdits *EditRecorder::getFileEdits(FileID FID) {
+  auto Found = FileIndex.find(FID);
+  if (Found != FileIndex.end()) return &Files[Found->second];
+
+  std::string FilePath = GetCanonicalFilePath(SM, FID);
+  if (FilePath.empty()) return 0;
+
+  bool Invalid = false;
+  const MemoryBuffer *Buffer = SM.getBuffer(FID, &Invalid);
+  if (Invalid) return 0;
+
+  FileEdits NewFile;
+  NewFile.FilePath = FilePath;
+  NewFile.ContentHash = HashFileContents(Buffer->getBufferStart(),
+                                         Buffer->getBufferSize());
+  FileIndex[FID] = Files.size();
+  Files.push_back(std::move(NewFile));
+  return &Files.back();
+}
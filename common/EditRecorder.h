@@ -0,0 +1,58 @@
+#ifndef CPP_TOOLS_COMMON_EDIT_RECORDER_H
+#define CPP_TOOLS_COMMON_EDIT_RECORDER_H
+
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "Edits.h"
+#include <vector>
+
+namespace clang {
+class LangOptions;
+class SourceManager;
+}
+
+// Records edits as offset/length/text replacements instead of applying
+// them. It has the same interface as the parts of clang::Rewriter that
+// the tools use, and, like the Rewriter, each method returns true if the
+// location can't be edited.
+class EditRecorder {
+public:
+  EditRecorder(clang::SourceManager &SM, const clang::LangOptions &LangOpts)
+    : SM(SM)
+    , LangOpts(LangOpts)
+    , RequiresAllConfigurations(false)
+    {}
+
+  bool InsertTextBefore(clang::SourceLocation Loc, llvm::StringRef Str);
+  bool InsertTextAfter(clang::SourceLocation Loc, llvm::StringRef Str);
+  bool InsertTextAfterToken(clang::SourceLocation Loc, llvm::StringRef Str);
+  bool ReplaceText(clang::SourceRange Range, llvm::StringRef NewStr);
+
+  // Marks the edits recorded from now on as ones that are only made if
+  // every configuration of the translation unit makes them.
+  void setRequiresAllConfigurations(bool Requires) {
+    RequiresAllConfigurations = Requires;
+  }
+
+  // Moves all the recorded edits into Out, one entry per file.
+  void takeEdits(std::vector<FileEdits> &Out);
+
+private:
+  clang::SourceManager &SM;
+  const clang::LangOptions &LangOpts;
+  bool RequiresAllConfigurations;
+
+  // Index into Files for each file that has edits.
+  llvm::DenseMap<clang::FileID, unsigned> FileIndex;
+  std::vector<FileEdits> Files;
+
+  bool addEdit(clang::SourceLocation Loc,
+               unsigned ExtraOffset,
+               unsigned Length,
+               llvm::StringRef Text,
+               bool InsertBefore);
+  FileEdits *getFileEdits(clang::FileID FID);
+};
+
+#endif
@@ -0,0 +1,493 @@
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Edits.h"
+#include "FileOverlay.h"
+#include <algorithm>
+#include <istream>
+#include <stdio.h>
+#include <unistd.h>
+using namespace llvm;
+using namespace std;
+
+bool operator<(const Edit &LHS, const Edit &RHS) {
+  if (LHS.Offset != RHS.Offset) return LHS.Offset < RHS.Offset;
+  if (LHS.Length != RHS.Length) return LHS.Length < RHS.Length;
+  if (LHS.InsertBefore != RHS.InsertBefore) return LHS.InsertBefore;
+  return LHS.Text < RHS.Text;
+}
+
+bool operator==(const Edit &LHS, const Edit &RHS) {
+  return LHS.Offset == RHS.Offset
+      && LHS.Length == RHS.Length
+      && LHS.InsertBefore == RHS.InsertBefore
+      && LHS.Text == RHS.Text;
+}
+
+uint64_t HashFileContents(const char *Data, size_t Size) {
+  // 64-bit FNV-1a.
+  uint64_t Hash = 14695981039346656037ULL;
+  for (size_t I = 0; I != Size; ++I) {
+    Hash ^= (unsigned char)Data[I];
+    Hash *= 1099511628211ULL;
+  }
+  return Hash;
+}
+
+void EditMerger::addEdits(const vector<FileEdits> &TUEdits) {
+  for (auto FI = TUEdits.begin(), FE = TUEdits.end(); FI != FE; ++FI) {
+    auto Inserted = Files.insert(make_pair(FI->FilePath, MergedFile()));
+    MergedFile &File = Inserted.first->second;
+    if (Inserted.second) {
+      File.ContentHash = FI->ContentHash;
+    } else if (File.ContentHash != FI->ContentHash) {
+      // The offsets only mean something against the contents they were
+      // computed for.
+      errs() << "Warning: " << FI->FilePath << " changed while it was "
+             << "being processed; dropping the edits made against the new "
+             << "contents.\n";
+      continue;
+    }
+
+    for (auto EI = FI->Edits.begin(), EE = FI->Edits.end(); EI != EE; ++EI) {
+      if (File.Seen.insert(*EI).second) {
+        File.Edits.push_back(*EI);
+      }
+    }
+  }
+}
+
+// Returns whether an edit must be applied before another edit at the same
+// offset. Text inserted before everything else comes first; otherwise the
+// edits keep the order in which they were made.
+static bool ComesBefore(const Edit &LHS, const Edit &RHS) {
+  if (LHS.Offset != RHS.Offset) return LHS.Offset < RHS.Offset;
+  return LHS.InsertBefore && !RHS.InsertBefore;
+}
+
+bool EditMerger::sortAndDropConflicts(const string &FilePath,
+                                      vector<Edit> &Edits) {
+  stable_sort(Edits.begin(), Edits.end(), ComesBefore);
+
+  // Drop any edit that overlaps text that an earlier edit replaces. Since
+  // edits are added in a deterministic order, so is the choice of which
+  // one is kept.
+  vector<Edit> Kept;
+  unsigned ReplacedUntil = 0;
+  for (auto EI = Edits.begin(), EE = Edits.end(); EI != EE; ++EI) {
+    if (EI->Offset < ReplacedUntil) {
+      errs() << "Warning: conflicting edits to " << FilePath << " at offset "
+             << EI->Offset << "; dropping \"" << EI->Text << "\".\n";
+      continue;
+    }
+    ReplacedUntil = max(ReplacedUntil, EI->Offset + EI->Length);
+    Kept.push_back(*EI);
+  }
+  bool Dropped = Kept.size() != Edits.size();
+  Edits.swap(Kept);
+  return Dropped;
+}
+
+bool EditMerger::hasConflicts(const string &FilePath) const {
+  auto Found = Files.find(FilePath);
+  if (Found == Files.end()) return false;
+
+  vector<Edit> Edits = Found->second.Edits;
+  stable_sort(Edits.begin(), Edits.end(), ComesBefore);
+  unsigned ReplacedUntil = 0;
+  for (auto EI = Edits.begin(), EE = Edits.end(); EI != EE; ++EI) {
+    if (EI->Offset < ReplacedUntil) return true;
+    ReplacedUntil = max(ReplacedUntil, EI->Offset + EI->Length);
+  }
+  return false;
+}
+
+void EditMerger::getMergedEdits(vector<FileEdits> &Merged) const {
+  for (auto FI = Files.begin(), FE = Files.end(); FI != FE; ++FI) {
+    FileEdits Entry;
+    Entry.FilePath = FI->first;
+    Entry.ContentHash = FI->second.ContentHash;
+    Entry.Edits = FI->second.Edits;
+    sortAndDropConflicts(Entry.FilePath, Entry.Edits);
+    Merged.push_back(std::move(Entry));
+  }
+}
+
+string ApplyEdits(const string &Contents, const vector<Edit> &Edits) {
+  string Result;
+  Result.reserve(Contents.size());
+  size_t Pos = 0;
+  for (auto EI = Edits.begin(), EE = Edits.end(); EI != EE; ++EI) {
+    Result.append(Contents, Pos, EI->Offset - Pos);
+    Result += EI->Text;
+    Pos = EI->Offset + EI->Length;
+  }
+  Result.append(Contents, Pos, string::npos);
+  return Result;
+}
+
+// Writes a line of a diff, marking the last line of a file that doesn't
+// end with a newline the way diff does.
+static void WriteDiffLine(raw_ostream &Out,
+                          char Prefix,
+                          const char *Data,
+                          size_t Size) {
+  Out << Prefix;
+  Out.write(Data, Size);
+  if (!Size || Data[Size - 1] != '\n') {
+    Out << "\n\\ No newline at end of file\n";
+  }
+}
+
+namespace {
+  // Lines of the original file, [OldBegin, OldEnd), that are replaced by
+  // NewLines.
+  struct ChangedLines {
+    size_t OldBegin;
+    size_t OldEnd;
+    vector<string> NewLines;
+  };
+}
+
+void WriteUnifiedDiff(raw_ostream &Out,
+                      const string &FilePath,
+                      const string &Contents,
+                      const vector<Edit> &Edits) {
+  const size_t Context = 3;
+
+  vector<size_t> LineStarts;
+  for (size_t Pos = 0; Pos < Contents.size();) {
+    LineStarts.push_back(Pos);
+    const size_t End = Contents.find('\n', Pos);
+    Pos = End == string::npos ? Contents.size() : End + 1;
+  }
+  const size_t NumLines = LineStarts.size();
+  auto LineOf = [&](size_t Offset) -> size_t {
+    if (!NumLines) return 0;
+    return upper_bound(LineStarts.begin(), LineStarts.end(), Offset)
+         - LineStarts.begin() - 1;
+  };
+  auto LineStart = [&](size_t Line) -> size_t {
+    return Line < NumLines ? LineStarts[Line] : Contents.size();
+  };
+  // The line after the last one an edit touches. An empty file has no
+  // lines to touch.
+  auto EndLineOf = [&](const Edit &E) -> size_t {
+    if (!NumLines) return 0;
+    return LineOf(E.Length ? E.Offset + E.Length - 1 : E.Offset) + 1;
+  };
+
+  // Work out which lines each group of edits that touch the same lines
+  // replaces, leaving out the lines at either end that stay the same.
+  vector<ChangedLines> Changes;
+  for (auto EI = Edits.begin(), EE = Edits.end(); EI != EE;) {
+    size_t Begin = LineOf(EI->Offset);
+    size_t End = EndLineOf(*EI);
+    auto Next = EI + 1;
+    for (; Next != EE && (!NumLines || LineOf(Next->Offset) < End); ++Next) {
+      End = max(End, EndLineOf(*Next));
+    }
+
+    const size_t ChunkBegin = LineStart(Begin);
+    const size_t ChunkEnd = LineStart(End);
+    string NewText;
+    size_t Pos = ChunkBegin;
+    for (; EI != Next; ++EI) {
+      NewText.append(Contents, Pos, EI->Offset - Pos);
+      NewText += EI->Text;
+      Pos = EI->Offset + EI->Length;
+    }
+    NewText.append(Contents, Pos, ChunkEnd - Pos);
+
+    ChangedLines Change;
+    for (size_t LinePos = 0; LinePos < NewText.size();) {
+      size_t LineEnd = NewText.find('\n', LinePos);
+      LineEnd = LineEnd == string::npos ? NewText.size() : LineEnd + 1;
+      Change.NewLines.push_back(NewText.substr(LinePos, LineEnd - LinePos));
+      LinePos = LineEnd;
+    }
+    auto OldLine = [&](size_t Line) -> string {
+      return Contents.substr(LineStart(Line),
+                             LineStart(Line + 1) - LineStart(Line));
+    };
+    size_t Kept = 0;
+    while (Begin < End && Kept < Change.NewLines.size()
+           && OldLine(Begin) == Change.NewLines[Kept]) {
+      ++Begin;
+      ++Kept;
+    }
+    Change.NewLines.erase(Change.NewLines.begin(),
+                          Change.NewLines.begin() + Kept);
+    while (Begin < End && !Change.NewLines.empty()
+           && OldLine(End - 1) == Change.NewLines.back()) {
+      --End;
+      Change.NewLines.pop_back();
+    }
+    if (Begin == End && Change.NewLines.empty()) continue;
+
+    Change.OldBegin = Begin;
+    Change.OldEnd = End;
+    Changes.push_back(std::move(Change));
+  }
+  if (Changes.empty()) return;
+
+  Out << "--- " << FilePath << "\n+++ " << FilePath << "\n";
+  // How many more lines the new file has than the old one, before the
+  // current hunk.
+  long Delta = 0;
+  for (size_t I = 0, E = Changes.size(); I != E;) {
+    // Changes close enough for their context to overlap share a hunk.
+    size_t J = I + 1;
+    while (J != E && Changes[J].OldBegin - Changes[J - 1].OldEnd
+                         <= 2 * Context) {
+      ++J;
+    }
+    const size_t HunkBegin =
+        Changes[I].OldBegin > Context ? Changes[I].OldBegin - Context : 0;
+    const size_t HunkEnd = min(NumLines, Changes[J - 1].OldEnd + Context);
+
+    long HunkDelta = 0;
+    for (size_t K = I; K != J; ++K) {
+      HunkDelta += (long)Changes[K].NewLines.size()
+                 - (long)(Changes[K].OldEnd - Changes[K].OldBegin);
+    }
+    const long OldCount = HunkEnd - HunkBegin;
+    const long NewCount = OldCount + HunkDelta;
+    // An empty range is given by the line before it.
+    Out << "@@ -" << HunkBegin + (OldCount ? 1 : 0) << ',' << OldCount
+        << " +" << (long)HunkBegin + Delta + (NewCount ? 1 : 0)
+        << ',' << NewCount << " @@\n";
+
+    auto WriteOldLines = [&](char Prefix, size_t Begin, size_t End) {
+      for (size_t Line = Begin; Line < End; ++Line) {
+        WriteDiffLine(Out, Prefix, Contents.data() + LineStart(Line),
+                      LineStart(Line + 1) - LineStart(Line));
+      }
+    };
+    size_t Line = HunkBegin;
+    for (size_t K = I; K != J; ++K) {
+      const ChangedLines &Change = Changes[K];
+      WriteOldLines(' ', Line, Change.OldBegin);
+      WriteOldLines('-', Change.OldBegin, Change.OldEnd);
+      for (auto NI = Change.NewLines.begin(), NE = Change.NewLines.end();
+           NI != NE; ++NI) {
+        WriteDiffLine(Out, '+', NI->data(), NI->size());
+      }
+      Line = Change.OldEnd;
+    }
+    WriteOldLines(' ', Line, HunkEnd);
+
+    Delta += HunkDelta;
+    I = J;
+  }
+}
+
+void WriteSizedString(raw_ostream &Out, const string &Str) {
+  Out << Str.size() << ' ' << Str;
+}
+
+bool ReadSizedString(istream &In, string &Str) {
+  size_t Size = 0;
+  if (!(In >> Size)) return false;
+  if (In.get() != ' ') return false;
+  Str.resize(Size);
+  if (Size) In.read(&Str[0], Size);
+  return !In.fail();
+}
+
+void WriteFileEdits(raw_ostream &Out, const vector<FileEdits> &Files) {
+  for (auto FI = Files.begin(), FE = Files.end(); FI != FE; ++FI) {
+    Out << "file " << FI->ContentHash << ' ';
+    WriteSizedString(Out, FI->FilePath);
+    Out << '\n';
+    for (auto EI = FI->Edits.begin(), EE = FI->Edits.end(); EI != EE; ++EI) {
+      Out << "edit " << EI->Offset << ' ' << EI->Length << ' '
+          << (EI->InsertBefore ? 1 : 0) << ' ';
+      WriteSizedString(Out, EI->Text);
+      Out << '\n';
+    }
+  }
+  Out << "end\n";
+}
+
+bool ReadFileEdits(istream &In, vector<FileEdits> &Files) {
+  FileEdits *Current = 0;
+  for (string Tag; In >> Tag;) {
+    if (Tag == "end") return true;
+
+    if (Tag == "file") {
+      Files.push_back(FileEdits());
+      Current = &Files.back();
+      if (!(In >> Current->ContentHash)) return false;
+      if (In.get() != ' ') return false;
+      if (!ReadSizedString(In, Current->FilePath)) return false;
+    } else if (Tag == "edit" && Current) {
+      Edit E;
+      int InsertBefore = 0;
+      if (!(In >> E.Offset >> E.Length >> InsertBefore)) return false;
+      if (In.get() != ' ') return false;
+      if (!ReadSizedString(In, E.Text)) return false;
+      E.InsertBefore = InsertBefore != 0;
+      Current->Edits.push_back(std::move(E));
+    } else {
+      return false;
+    }
+  }
+  return false;
+}
+
+void KeepUnanimousEdits(vector<FileEdits> &Files,
+                        const vector<size_t> &ConfigStarts) {
+  // How many configurations made each edit that needs all of them.
+  typedef pair<string, Edit> FileEdit;
+  map<FileEdit, unsigned> Counts;
+  for (size_t C = 0, CE = ConfigStarts.size(); C != CE; ++C) {
+    const size_t End = C + 1 == CE ? Files.size() : ConfigStarts[C + 1];
+    set<FileEdit> Made;
+    for (size_t F = ConfigStarts[C]; F != End; ++F) {
+      const vector<Edit> &Edits = Files[F].Edits;
+      for (auto EI = Edits.begin(), EE = Edits.end(); EI != EE; ++EI) {
+        if (EI->RequiresAllConfigurations) {
+          Made.insert(make_pair(Files[F].FilePath, *EI));
+        }
+      }
+    }
+    for (auto MI = Made.begin(), ME = Made.end(); MI != ME; ++MI) {
+      ++Counts[*MI];
+    }
+  }
+
+  vector<FileEdits> Kept;
+  for (auto FI = Files.begin(), FE = Files.end(); FI != FE; ++FI) {
+    FileEdits File;
+    File.FilePath = FI->FilePath;
+    File.ContentHash = FI->ContentHash;
+    for (auto EI = FI->Edits.begin(), EE = FI->Edits.end(); EI != EE; ++EI) {
+      if (!EI->RequiresAllConfigurations ||
+          Counts[make_pair(FI->FilePath, *EI)] == ConfigStarts.size()) {
+        File.Edits.push_back(*EI);
+      }
+    }
+    if (!File.Edits.empty()) Kept.push_back(std::move(File));
+  }
+  Files.swap(Kept);
+}
+
+bool ReadFileContents(const string &FilePath, string &Contents) {
+  OwningPtr<MemoryBuffer> Buffer;
+  if (MemoryBuffer::getFile(FilePath, Buffer)) return false;
+  Contents.assign(Buffer->getBufferStart(), Buffer->getBufferSize());
+  return true;
+}
+
+bool WriteFileContents(const string &FilePath, StringRef Contents) {
+  string ErrorInfo;
+  raw_fd_ostream Out(FilePath.c_str(), ErrorInfo, raw_fd_ostream::F_Binary);
+  if (!ErrorInfo.empty()) return false;
+  Out << Contents;
+  Out.close();
+  if (Out.has_error()) {
+    Out.clear_error();
+    return false;
+  }
+  return true;
+}
+
+bool WriteFileAtomically(const string &FilePath, StringRef Contents) {
+  const string TempPath = FilePath + ".tmp" + utostr(getpid());
+  if (!WriteFileContents(TempPath, Contents) ||
+      rename(TempPath.c_str(), FilePath.c_str()) != 0) {
+    remove(TempPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool EditMerger::writeDiff(raw_ostream &Out,
+                           const FileOverlay &Overlay) const {
+  vector<FileEdits> Merged;
+  getMergedEdits(Merged);
+
+  bool Succeeded = true;
+  for (auto FI = Merged.begin(), FE = Merged.end(); FI != FE; ++FI) {
+    if (FI->Edits.empty()) continue;
+
+    string Contents;
+    if (!Overlay.getContents(FI->FilePath, Contents)) {
+      errs() << "Error reading " << FI->FilePath << "\n";
+      Succeeded = false;
+      continue;
+    }
+    if (HashFileContents(Contents) != FI->ContentHash) {
+      errs() << "Error: " << FI->FilePath << " changed since it was parsed; "
+             << "not showing its edits.\n";
+      Succeeded = false;
+      continue;
+    }
+    WriteUnifiedDiff(Out, FI->FilePath, Contents, FI->Edits);
+  }
+  Out.flush();
+  return Succeeded;
+}
+
+bool EditMerger::output(EditOutputMode Mode,
+                        const FileOverlay &Overlay,
+                        raw_ostream &Out,
+                        map<string, FileUpdate> *Updates) const {
+  switch (Mode) {
+  case OutputInPlace:
+    // The files on disk aren't what the edits were made to.
+    if (!Overlay.empty()) {
+      errs() << "Error: edits to unsaved files can't be written in place.\n";
+      return false;
+    }
+    return applyToDisk(Updates);
+  case OutputDiff:
+    return writeDiff(Out, Overlay);
+  case OutputReplacements: {
+    vector<FileEdits> Merged;
+    getMergedEdits(Merged);
+    WriteFileEdits(Out, Merged);
+    Out.flush();
+    return true;
+  }
+  }
+  return false;
+}
+
+bool EditMerger::applyToDisk(map<string, FileUpdate> *Updates) const {
+  vector<FileEdits> Merged;
+  getMergedEdits(Merged);
+
+  bool Succeeded = true;
+  for (auto FI = Merged.begin(), FE = Merged.end(); FI != FE; ++FI) {
+    if (FI->Edits.empty()) continue;
+
+    string Contents;
+    if (!ReadFileContents(FI->FilePath, Contents)) {
+      errs() << "Error reading " << FI->FilePath << "\n";
+      Succeeded = false;
+      continue;
+    }
+    if (HashFileContents(Contents) != FI->ContentHash) {
+      errs() << "Error: " << FI->FilePath << " changed on disk since it was "
+             << "parsed; not applying its edits.\n";
+      Succeeded = false;
+      continue;
+    }
+
+    const string NewContents = ApplyEdits(Contents, FI->Edits);
+    if (!WriteFileContents(FI->FilePath, NewContents)) {
+      errs() << "Error writing " << FI->FilePath << "\n";
+      Succeeded = false;
+      continue;
+    }
+    if (Updates) {
+      FileUpdate &Update = (*Updates)[FI->FilePath];
+      Update.OldHash = FI->ContentHash;
+      Update.NewHash = HashFileContents(NewContents);
+    }
+  }
+  return Succeeded;
+}
@@ -0,0 +1,192 @@
+#ifndef CPP_TOOLS_COMMON_EDITS_H
+#define CPP_TOOLS_COMMON_EDITS_H
+
+#include "llvm/ADT/StringRef.h"
+#include <iosfwd>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+class FileOverlay;
+
+namespace llvm {
+class raw_ostream;
+}
+
+// A single change to a file: Length bytes starting at Offset are replaced by
+// Text. Insertions have a length of zero.
+struct Edit {
+  Edit()
+    : Offset(0), Length(0), InsertBefore(false),
+      RequiresAllConfigurations(false) {}
+  Edit(unsigned Offset, unsigned Length, std::string Text, bool InsertBefore)
+    : Offset(Offset)
+    , Length(Length)
+    , Text(std::move(Text))
+    , InsertBefore(InsertBefore)
+    , RequiresAllConfigurations(false)
+    {}
+
+  unsigned Offset;
+  unsigned Length;
+  std::string Text;
+  // Whether an insertion goes in front of other text inserted at the same
+  // offset, like Rewriter::InsertTextBefore.
+  bool InsertBefore;
+  // Whether the edit is only made if every configuration of the
+  // translation unit makes it, because it would break the build of one
+  // that doesn't, e.g. commenting out a parameter that's only unused in
+  // some of them. KeepUnanimousEdits() drops the ones that aren't; it isn't
+  // stored with the edits, since they're only kept or dropped once.
+  bool RequiresAllConfigurations;
+};
+
+bool operator<(const Edit &LHS, const Edit &RHS);
+bool operator==(const Edit &LHS, const Edit &RHS);
+
+// All the edits that a translation unit made to one file, along with a hash
+// of the file contents that the offsets refer to.
+struct FileEdits {
+  FileEdits() : ContentHash(0) {}
+
+  std::string FilePath;
+  uint64_t ContentHash;
+  std::vector<Edit> Edits;
+};
+
+// A file that a translation unit read, with a hash of the contents it saw.
+struct FileDependency {
+  FileDependency() : ContentHash(0) {}
+  FileDependency(std::string FilePath, uint64_t ContentHash)
+    : FilePath(std::move(FilePath))
+    , ContentHash(ContentHash)
+    {}
+
+  std::string FilePath;
+  uint64_t ContentHash;
+};
+
+// Returns a hash of a file's contents. It is stable between runs and
+// machines, so it can be stored alongside the edits.
+uint64_t HashFileContents(const char *Data, size_t Size);
+inline uint64_t HashFileContents(const std::string &Contents) {
+  return HashFileContents(Contents.data(), Contents.size());
+}
+
+// Drops the edits that need every configuration of a translation unit but
+// weren't made by all of them. Files holds the edits of each configuration
+// in turn, the I-th configuration's starting at ConfigStarts[I].
+void KeepUnanimousEdits(std::vector<FileEdits> &Files,
+                        const std::vector<size_t> &ConfigStarts);
+
+// Reads a whole file into a string. Returns false if it can't be read.
+bool ReadFileContents(const std::string &FilePath, std::string &Contents);
+
+// Replaces a file's contents in place. Returns false if it can't be
+// written.
+bool WriteFileContents(const std::string &FilePath,
+                       llvm::StringRef Contents);
+
+// Writes a file's contents to a temporary file and renames it into place,
+// so that another process reading the file never sees half of it. Returns
+// false if it can't be written.
+bool WriteFileAtomically(const std::string &FilePath,
+                         llvm::StringRef Contents);
+
+// Writes a string prefixed by its length, so that it can contain any
+// characters, and reads it back.
+void WriteSizedString(llvm::raw_ostream &Out, const std::string &Str);
+bool ReadSizedString(std::istream &In, std::string &Str);
+
+// Writes edits in a line-based text format that ReadFileEdits() can read
+// back, for storing them in caches and passing them between processes.
+void WriteFileEdits(llvm::raw_ostream &Out,
+                    const std::vector<FileEdits> &Files);
+// Reads edits written by WriteFileEdits(), appending them to Files. Returns
+// false if the input is malformed.
+bool ReadFileEdits(std::istream &In, std::vector<FileEdits> &Files);
+
+// What a run does with the edits it made.
+enum EditOutputMode {
+  // Write the changed files.
+  OutputInPlace,
+  // Print a unified diff of the changes, and leave the files alone.
+  OutputDiff,
+  // Print the edits themselves, in the format of WriteFileEdits(), and
+  // leave the files alone.
+  OutputReplacements
+};
+
+// Collects edits from many translation units, and applies them with a single
+// write per file at the end of the run. Edits must be added in a
+// deterministic order; the same edit made by several translation units, e.g.
+// in a header they all include, is only applied once.
+class EditMerger {
+public:
+  void addEdits(const std::vector<FileEdits> &TUEdits);
+
+  // How a file's contents changed when the edits were applied to it.
+  struct FileUpdate {
+    uint64_t OldHash;
+    uint64_t NewHash;
+  };
+
+  // Applies all the merged edits, writing each changed file once. Files
+  // that were changed on disk since they were parsed are left alone.
+  // Returns false if any file couldn't be updated. If Updates is given,
+  // it's filled in for every file that was written.
+  bool applyToDisk(std::map<std::string, FileUpdate> *Updates = 0) const;
+
+  // Writes a unified diff of the merged edits to Out, reading only the
+  // files that changed, and only from disk if Overlay doesn't have them.
+  // Returns false if any of them couldn't be read, or changed since they
+  // were parsed.
+  bool writeDiff(llvm::raw_ostream &Out, const FileOverlay &Overlay) const;
+
+  // Outputs the merged edits as Mode asks for. Only OutputInPlace touches
+  // the files, and it can't be used for edits made to unsaved contents.
+  bool output(EditOutputMode Mode,
+              const FileOverlay &Overlay,
+              llvm::raw_ostream &Out,
+              std::map<std::string, FileUpdate> *Updates = 0) const;
+
+  // Returns whether any edits to the file were dropped because they
+  // conflicted with others.
+  bool hasConflicts(const std::string &FilePath) const;
+
+  // Returns the merged edits for each file, in the order they're applied.
+  void getMergedEdits(std::vector<FileEdits> &Merged) const;
+
+private:
+  struct MergedFile {
+    MergedFile() : ContentHash(0) {}
+
+    uint64_t ContentHash;
+    std::vector<Edit> Edits;
+    // The edits we've already seen, to drop duplicates.
+    std::set<Edit> Seen;
+  };
+  // Keyed by path, so the files are processed in a deterministic order.
+  std::map<std::string, MergedFile> Files;
+
+  // Returns whether any edits were dropped.
+  static bool sortAndDropConflicts(const std::string &FilePath,
+                                   std::vector<Edit> &Edits);
+};
+
+// Applies sorted, non-overlapping edits to the contents of a file.
+std::string ApplyEdits(const std::string &Contents,
+                       const std::vector<Edit> &Edits);
+
+// Writes the changes that sorted, non-overlapping edits make to a file as a
+// unified diff, with three lines of context. Only the lines the edits touch
+// are copied.
+void WriteUnifiedDiff(llvm::raw_ostream &Out,
+                      const std::string &FilePath,
+                      const std::string &Contents,
+                      const std::vector<Edit> &Edits);
+
+#endif
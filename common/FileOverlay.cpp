@@ -0,0 +1,70 @@
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "Edits.h"
+#include "FileOverlay.h"
+#include "SourceFiles.h"
+#include <string.h>
+using namespace llvm;
+
+void FileOverlay::add(StringRef Path, std::string Contents) {
+  // Edits are recorded against canonical paths, so that's what the
+  // contents are looked up by.
+  Files[GetRealPath(Path)].swap(Contents);
+}
+
+bool FileOverlay::parseHeader(StringRef Line,
+                              size_t &Size,
+                              std::string &Path) {
+  if (!Line.startswith("unsaved ")) return false;
+  Line = Line.drop_front(strlen("unsaved "));
+
+  // The path is the rest of the line, so it can contain spaces.
+  std::pair<StringRef, StringRef> Split = Line.split(' ');
+  unsigned long long Parsed = 0;
+  if (Split.first.getAsInteger(10, Parsed) || Split.second.empty() ||
+      Parsed > MaxFileSize) {
+    return false;
+  }
+  Size = Parsed;
+  Path = Split.second.str();
+  return true;
+}
+
+bool FileOverlay::read(StringRef Input) {
+  while (!Input.empty()) {
+    std::pair<StringRef, StringRef> Line = Input.split('\n');
+    Input = Line.second;
+    if (Line.first.empty()) continue;
+
+    size_t Size = 0;
+    std::string Path;
+    if (!parseHeader(Line.first, Size, Path)) return false;
+    if (Size > Input.size()) return false;
+    add(Path, Input.substr(0, Size).str());
+    Input = Input.drop_front(Size);
+  }
+  return true;
+}
+
+bool FileOverlay::readFile(const std::string &Path) {
+  OwningPtr<MemoryBuffer> Buffer;
+  if (Path == "-" ? MemoryBuffer::getSTDIN(Buffer)
+                  : MemoryBuffer::getFile(Path, Buffer)) {
+    return false;
+  }
+  return read(Buffer->getBuffer());
+}
+
+const std::string *FileOverlay::find(const std::string &FilePath) const {
+  auto Found = Files.find(FilePath);
+  return Found == Files.end() ? 0 : &Found->second;
+}
+
+bool FileOverlay::getContents(const std::string &FilePath,
+                              std::string &Contents) const {
+  if (const std::string *Unsaved = find(FilePath)) {
+    Contents = *Unsaved;
+    return true;
+  }
+  return ReadFileContents(FilePath, Contents);
+}
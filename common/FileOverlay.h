@@ -0,0 +1,59 @@
+#ifndef CPP_TOOLS_COMMON_FILE_OVERLAY_H
+#define CPP_TOOLS_COMMON_FILE_OVERLAY_H
+
+#include "llvm/ADT/StringRef.h"
+#include <map>
+#include <string>
+
+// Unsaved contents of files, e.g. the buffers open in an editor, which are
+// parsed and edited instead of what's on disk. The contents are handed to
+// the compiler as remapped files, so the files themselves are never read.
+//
+// Unsaved files are passed in as a header line followed by the contents:
+//
+//   unsaved <size in bytes> <path>
+//   <contents>
+//
+// where the contents are exactly as long as the size says, and needn't end
+// with a newline. Sizes over MaxFileSize are rejected.
+class FileOverlay {
+public:
+  typedef std::map<std::string, std::string>::const_iterator iterator;
+
+  // The largest unsaved file accepted, far beyond any real source file, so
+  // that a corrupt or hostile size is rejected instead of allocated.
+  enum { MaxFileSize = 256 << 20 };
+
+  // Adds the unsaved contents of a file, replacing any given earlier.
+  void add(llvm::StringRef Path, std::string Contents);
+
+  // Reads unsaved files until the end of the input. Returns false if the
+  // input is malformed.
+  bool read(llvm::StringRef Input);
+  // Reads unsaved files from a file, or from stdin if Path is "-".
+  bool readFile(const std::string &Path);
+
+  // Parses the header line of an unsaved file. Returns false if it isn't
+  // one, or its size is over MaxFileSize.
+  static bool parseHeader(llvm::StringRef Line,
+                          size_t &Size,
+                          std::string &Path);
+
+  bool empty() const { return Files.empty(); }
+  iterator begin() const { return Files.begin(); }
+  iterator end() const { return Files.end(); }
+
+  // Returns the unsaved contents of a file, or null if it has none. Paths
+  // are canonical, like the ones edits are recorded with.
+  const std::string *find(const std::string &FilePath) const;
+
+  // Gets the contents of a file, from the overlay if it's there, or else
+  // from disk. Returns false if the file can't be read.
+  bool getContents(const std::string &FilePath, std::string &Contents) const;
+
+private:
+  // Keyed by canonical path.
+  std::map<std::string, std::string> Files;
+};
+
+#endif
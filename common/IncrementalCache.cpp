@@ -0,0 +1,161 @@
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "IncrementalCache.h"
+#include <sstream>
+#include <sys/stat.h>
+using namespace llvm;
+using namespace std;
+
+// Bump this whenever the format of the entries changes.
+static const char *const EntryHeader = "cpp-tools-incremental-cache 1";
+
+IncrementalCache::IncrementalCache(string CacheDir, string ToolConfig)
+  : CacheDir(std::move(CacheDir))
+  , ToolConfig(std::move(ToolConfig)) {
+  mkdir(this->CacheDir.c_str(), 0777);
+}
+
+string IncrementalCache::getEntryPath(const string &Key) const {
+  string Path;
+  raw_string_ostream Out(Path);
+  Out << CacheDir << "/"
+      << format("%llx", (unsigned long long)HashFileContents(
+                            ToolConfig + '\0' + Key))
+      << ".tu";
+  return Out.str();
+}
+
+// Returns a file's modification time in nanoseconds.
+static int64_t GetModificationTime(const struct stat &Status) {
+#if defined(__APPLE__)
+  const struct timespec &Time = Status.st_mtimespec;
+#else
+  const struct timespec &Time = Status.st_mtim;
+#endif
+  return (int64_t)Time.tv_sec * 1000000000 + Time.tv_nsec;
+}
+
+IncrementalCache::FileState
+IncrementalCache::getFileState(const string &FilePath, bool NeedHash) {
+  {
+    lock_guard<mutex> Guard(FileStatesLock);
+    auto Found = FileStates.find(FilePath);
+    if (Found != FileStates.end()
+        && (!NeedHash || Found->second.Hashed || !Found->second.Exists)) {
+      return Found->second;
+    }
+  }
+
+  // Do the I/O without holding the lock. Two threads may end up hashing
+  // the same file, but they'll agree on the result.
+  FileState State;
+  struct stat Status;
+  if (stat(FilePath.c_str(), &Status) == 0) {
+    State.Exists = true;
+    State.MTime = GetModificationTime(Status);
+    State.Size = Status.st_size;
+    if (NeedHash) {
+      string Contents;
+      if (ReadFileContents(FilePath, Contents)) {
+        State.Hashed = true;
+        State.ContentHash = HashFileContents(Contents);
+      } else {
+        State.Exists = false;
+      }
+    }
+  }
+
+  lock_guard<mutex> Guard(FileStatesLock);
+  FileStates[FilePath] = State;
+  return State;
+}
+
+bool IncrementalCache::isUnchanged(const FileDependency &Dep,
+                                   int64_t MTime,
+                                   uint64_t Size) {
+  FileState State = getFileState(Dep.FilePath, /*NeedHash*/false);
+  if (!State.Exists) return false;
+  // If it looks untouched, trust the hash we stored. Otherwise it may have
+  // been touched without changing, e.g. by switching branches, so check.
+  if (State.MTime == MTime && State.Size == Size) return true;
+
+  State = getFileState(Dep.FilePath, /*NeedHash*/true);
+  return State.Hashed && State.ContentHash == Dep.ContentHash;
+}
+
+bool IncrementalCache::lookup(const string &Key,
+                              vector<FileDependency> &Deps,
+                              vector<FileEdits> &Edits) {
+  string Contents;
+  if (!ReadFileContents(getEntryPath(Key), Contents)) return false;
+  istringstream In(Contents);
+
+  string Header, StoredKey;
+  if (!getline(In, Header) || Header != EntryHeader) return false;
+  if (!ReadSizedString(In, StoredKey) || StoredKey != ToolConfig + '\0' + Key) {
+    return false;
+  }
+
+  vector<FileDependency> StoredDeps;
+  for (string Tag; In >> Tag;) {
+    if (Tag == "edits") {
+      vector<FileEdits> StoredEdits;
+      if (!ReadFileEdits(In, StoredEdits)) return false;
+
+      Deps.insert(Deps.end(), StoredDeps.begin(), StoredDeps.end());
+      Edits.insert(Edits.end(), StoredEdits.begin(), StoredEdits.end());
+      return true;
+    }
+    if (Tag != "dep") return false;
+
+    FileDependency Dep;
+    int64_t MTime = 0;
+    uint64_t Size = 0;
+    if (!(In >> Dep.ContentHash >> MTime >> Size)) return false;
+    if (In.get() != ' ') return false;
+    if (!ReadSizedString(In, Dep.FilePath)) return false;
+
+    if (!isUnchanged(Dep, MTime, Size)) return false;
+    StoredDeps.push_back(std::move(Dep));
+  }
+  return false;
+}
+
+void IncrementalCache::invalidateFile(const string &FilePath) {
+  lock_guard<mutex> Guard(FileStatesLock);
+  FileStates.erase(FilePath);
+}
+
+bool IncrementalCache::store(const string &Key,
+                             const vector<FileDependency> &Deps,
+                             const vector<FileEdits> &Edits) {
+  string Contents;
+  raw_string_ostream Entry(Contents);
+  Entry << EntryHeader << "\n";
+  WriteSizedString(Entry, ToolConfig + '\0' + Key);
+  Entry << "\n";
+
+  for (auto DI = Deps.begin(), DE = Deps.end(); DI != DE; ++DI) {
+    // The stored modification time must belong to the contents we're
+    // vouching for; if the file has changed since, leave this translation
+    // unit out of the cache, so that it's parsed again next time.
+    FileState State = getFileState(DI->FilePath, /*NeedHash*/true);
+    if (!State.Hashed || State.ContentHash != DI->ContentHash) return false;
+
+    Entry << "dep " << DI->ContentHash << " " << State.MTime << " "
+          << State.Size << " ";
+    WriteSizedString(Entry, DI->FilePath);
+    Entry << "\n";
+  }
+  Entry << "edits\n";
+  WriteFileEdits(Entry, Edits);
+
+  // A run that's interrupted mustn't leave half an entry behind, nor may
+  // another run sharing the cache read one.
+  const string EntryPath = getEntryPath(Key);
+  if (!WriteFileAtomically(EntryPath, Entry.str())) {
+    errs() << "Error writing cache entry " << EntryPath << "\n";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,66 @@
+#ifndef CPP_TOOLS_COMMON_INCREMENTAL_CACHE_H
+#define CPP_TOOLS_COMMON_INCREMENTAL_CACHE_H
+
+#include "Edits.h"
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Remembers, between runs, which files each translation unit read and which
+// edits it still had to make, so that a translation unit whose compile
+// command and files haven't changed doesn't have to be parsed again.
+//
+// Entries describe the state of the files at the end of a run: if the run
+// applied a translation unit's edits, its entry records the new file hashes
+// and no edits, since parsing it again would find nothing left to do.
+//
+// There's one file per translation unit in the cache directory, named after
+// a hash of its key. The key is made up of the translation unit's source
+// path and compile commands, plus the tool's own configuration, since
+// e.g. a different -override string produces different edits.
+class IncrementalCache {
+public:
+  IncrementalCache(std::string CacheDir, std::string ToolConfig);
+
+  // Looks up the entry for a translation unit. If there is one, and none of
+  // the files it depends on have changed, fills in its dependencies and
+  // edits and returns true. Safe to call from several threads at once.
+  bool lookup(const std::string &Key,
+              std::vector<FileDependency> &Deps,
+              std::vector<FileEdits> &Edits);
+
+  // Forgets what we know about a file, e.g. because we've just written it.
+  void invalidateFile(const std::string &FilePath);
+
+  // Stores the entry for a translation unit.
+  bool store(const std::string &Key,
+             const std::vector<FileDependency> &Deps,
+             const std::vector<FileEdits> &Edits);
+
+private:
+  const std::string CacheDir;
+  const std::string ToolConfig;
+
+  // What we know about a file on disk during this run. The hash is only
+  // computed when its modification time or size doesn't match the cache.
+  struct FileState {
+    FileState()
+      : Exists(false), MTime(0), Size(0), Hashed(false), ContentHash(0) {}
+
+    bool Exists;
+    int64_t MTime;
+    uint64_t Size;
+    bool Hashed;
+    uint64_t ContentHash;
+  };
+  std::mutex FileStatesLock;
+  std::map<std::string, FileState> FileStates;
+
+  std::string getEntryPath(const std::string &Key) const;
+  FileState getFileState(const std::string &FilePath, bool NeedHash);
+  bool isUnchanged(const FileDependency &Dep, int64_t MTime, uint64_t Size);
+};
+
+#endif
@@ -0,0 +1,658 @@
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemOptions.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+#include "ASTCache.h"
+#include "CompileCommands.h"
+#include "CostModel.h"
+#include "FileOverlay.h"
+#include "IncrementalCache.h"
+#include "ParallelTool.h"
+#include "SharedFileCache.h"
+#include "SharedPreamble.h"
+#include "SourceFiles.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+using namespace clang;
+using namespace clang::tooling;
+using namespace llvm;
+
+typedef std::chrono::steady_clock Clock;
+
+ParallelClangTool::ParallelClangTool(const CompilationDatabase &Compilations,
+                                     ArrayRef<std::string> SourcePaths,
+                                     unsigned NumThreads)
+  : Compilations(Compilations)
+  , SourcePaths(SourcePaths.begin(), SourcePaths.end())
+  , NumThreads(NumThreads ? NumThreads : 1)
+  , Cache(0)
+  , ASTs(0)
+  , UseSharedPreambles(false)
+  , UseWorkerProcesses(false)
+  , CostModel(0)
+  , Overlay(0)
+  , FileCache(0)
+  , OutputMode(OutputInPlace)
+  , Out(&outs())
+  {}
+
+ParallelClangTool::WorkerFiles::~WorkerFiles() {
+  for (auto MI = Managers.begin(), ME = Managers.end(); MI != ME; ++MI) {
+    delete MI->second;
+  }
+}
+
+FileManager &ParallelClangTool::WorkerFiles::get(
+    const std::string &Directory) {
+  FileManager *&Manager = Managers[Directory];
+  if (!Manager) {
+    // ToolInvocation keeps the options of the FileManager it's given, so
+    // this is what makes -working-directory take effect. The FileManager
+    // also caches relative paths as it resolved them, so commands from
+    // different directories mustn't share one.
+    FileSystemOptions Options;
+    Options.WorkingDir = Directory;
+    Manager = new FileManager(Options);
+    if (FileCache) Manager->addStatCache(FileCache->createStatCache());
+  }
+  return *Manager;
+}
+
+void ParallelClangTool::forEachInParallel(
+    unsigned NumItems,
+    const std::function<void(unsigned, WorkerFiles &)> &Body) {
+  WorkStealingScheduler Scheduler(NumItems, NumThreads);
+  RunOnWorkerThreads(NumThreads, [&](unsigned Worker) {
+    // FileManager isn't thread-safe, so every worker gets its own, which
+    // it shares between all the items it runs.
+    WorkerFiles Files(FileCache);
+    for (unsigned Index; Scheduler.getNextItem(Worker, Index);) {
+      Body(Index, Files);
+    }
+  });
+}
+
+void ParallelClangTool::forEachInParallel(
+    const std::vector<unsigned> &Order,
+    const std::function<void(unsigned, WorkerFiles &)> &Body) {
+  WorkStealingScheduler Scheduler(Order, NumThreads);
+  RunOnWorkerThreads(NumThreads, [&](unsigned Worker) {
+    WorkerFiles Files(FileCache);
+    for (unsigned Index; Scheduler.getNextItem(Worker, Index);) {
+      Body(Index, Files);
+    }
+  });
+}
+
+int ParallelClangTool::run(TUActionFactory &Factory) {
+  // LLVM's global state is only safe to touch from several threads once
+  // this has been called.
+  llvm_start_multithreaded();
+
+  if (Overlay && !Overlay->empty()) {
+    Cache = 0;
+    ASTs = 0;
+    UseSharedPreambles = false;
+  }
+  if (ASTs) UseSharedPreambles = false;
+
+  // The files don't change until the edits are written at the end, so
+  // every worker can share what the others found out about them.
+  SharedFileCache SharedFiles;
+  FileCache = &SharedFiles;
+
+  // The same file may be given more than once, e.g. by a glob and by name.
+  std::vector<std::string> Files;
+  {
+    std::set<std::string> Seen;
+    for (auto SI = SourcePaths.begin(), SE = SourcePaths.end();
+         SI != SE; ++SI) {
+      std::string File = GetAbsolutePath(*SI);
+      if (Seen.insert(File).second) Files.push_back(File);
+    }
+  }
+
+  std::vector<TUJob> Jobs(Files.size());
+  std::vector<TUResult> Results(Files.size());
+  {
+    TraceSpan Span("get compile commands");
+    for (size_t I = 0, E = Files.size(); I != E; ++I) {
+      prepareJob(Files[I], Jobs[I], Results[I]);
+    }
+  }
+
+  // Find out which translation units are unchanged before doing anything
+  // else, so that no preambles are built for them.
+  if (Cache) {
+    forEachInParallel(Jobs.size(), [&](unsigned Index, WorkerFiles &) {
+      TUResult &Result = Results[Index];
+      if (Result.CacheKey.empty()) return;
+      TraceSpan Span("cache lookup", Jobs[Index].File);
+      if (Cache->lookup(Result.CacheKey, Result.Dependencies, Result.Edits)) {
+        Result.FromCache = true;
+        Result.Succeeded = true;
+      }
+    });
+  }
+
+  std::vector<SharedPreamble*> Preambles;
+  std::string PreambleDir;
+  if (UseSharedPreambles) {
+    char DirTemplate[] = "/tmp/cpp-tools-preamble-XXXXXX";
+    if (mkdtemp(DirTemplate)) {
+      PreambleDir = DirTemplate;
+      buildSharedPreambles(Jobs, Results, Factory, PreambleDir, Preambles);
+    } else {
+      errs() << "Couldn't create a directory for shared preambles.\n";
+    }
+  }
+
+  const std::vector<unsigned> Order = getJobOrder(Jobs, Results);
+  const bool HasBudget = Budget.Seconds || Budget.MemoryBytes;
+  if (UseWorkerProcesses || HasBudget) {
+    runJobsInWorkerProcesses(Jobs, Order, Factory, Results);
+  } else {
+    auto RunJob = [&](unsigned Index, WorkerFiles &Files) {
+      if (Results[Index].FromCache) return;
+      TraceSpan Span("translation unit", Jobs[Index].File);
+      const Clock::time_point Start = Clock::now();
+      Results[Index].Succeeded = runJob(Jobs[Index],
+                                        Factory,
+                                        Files,
+                                        Results[Index]);
+      Results[Index].Seconds =
+          std::chrono::duration<double>(Clock::now() - Start).count();
+    };
+    // Without a cost model, each worker keeps to a contiguous block of the
+    // files, which tend to share headers.
+    if (CostModel) {
+      forEachInParallel(Order, RunJob);
+    } else {
+      forEachInParallel(Jobs.size(), RunJob);
+    }
+  }
+  if (HasBudget) reportCostliestJobs(Jobs, Results);
+  if (CostModel) recordCosts(Jobs, Results);
+
+  for (auto PI = Preambles.begin(), PE = Preambles.end(); PI != PE; ++PI) {
+    unlink((*PI)->HeaderPath.c_str());
+    unlink((*PI)->PCHPath.c_str());
+    delete *PI;
+  }
+  if (!PreambleDir.empty()) rmdir(PreambleDir.c_str());
+  FileCache = 0;
+
+  bool Succeeded;
+  {
+    TraceSpan Span("apply edits");
+    Succeeded = applyMergedEdits(Results);
+  }
+  for (auto RI = Results.begin(), RE = Results.end(); RI != RE; ++RI) {
+    if (!RI->Succeeded) Succeeded = false;
+  }
+  return Succeeded ? 0 : 1;
+}
+
+ProcessedDeclSet *ParallelClangTool::getProcessedDecls(
+    const std::string &FlagSetKey) {
+  std::lock_guard<std::mutex> Guard(ProcessedDeclsLock);
+  std::shared_ptr<ProcessedDeclSet> &Decls = ProcessedDecls[FlagSetKey];
+  if (!Decls) Decls = std::make_shared<ProcessedDeclSet>();
+  return Decls.get();
+}
+
+void ParallelClangTool::prepareJob(const std::string &SourcePath,
+                                   TUJob &Job,
+                                   TUResult &Result) {
+  Job.File = GetAbsolutePath(SourcePath);
+  // A file that's listed several times with flags that parse it the same
+  // way is only parsed once. Where the flags really differ, every
+  // configuration is parsed, and their edits are merged.
+  Job.Commands = GetDistinctCommands(Compilations.getCompileCommands(Job.File),
+                                     Job.File);
+
+  if (Cache && !Job.Commands.empty()) {
+    // The key covers everything that determines how the TU is parsed,
+    // except for the contents of the files, which the cache checks itself.
+    Result.CacheKey = Job.File;
+    for (auto CI = Job.Commands.begin(), CE = Job.Commands.end();
+         CI != CE; ++CI) {
+      Result.CacheKey += '\0' + CI->Directory;
+      for (auto AI = CI->CommandLine.begin(), AE = CI->CommandLine.end();
+           AI != AE; ++AI) {
+        Result.CacheKey += '\0' + *AI;
+      }
+    }
+  }
+}
+
+void ParallelClangTool::buildSharedPreambles(
+    std::vector<TUJob> &Jobs,
+    const std::vector<TUResult> &Results,
+    TUActionFactory &Factory,
+    const std::string &PreambleDir,
+    std::vector<SharedPreamble*> &Preambles) {
+  // Group the translation units that still need to be parsed by their
+  // flags. Quoted includes are found relative to the main file, so its
+  // directory is part of the group too.
+  std::map<std::string, std::vector<unsigned> > Groups;
+  for (size_t I = 0, E = Jobs.size(); I != E; ++I) {
+    if (Results[I].FromCache || Jobs[I].Commands.size() != 1) continue;
+    std::string Key = GetFlagSetKey(Jobs[I].Commands[0], Jobs[I].File);
+    Key += '\0' + sys::path::parent_path(Jobs[I].File).str();
+    Groups[Key].push_back(I);
+  }
+
+  for (auto GI = Groups.begin(), GE = Groups.end(); GI != GE; ++GI) {
+    const std::vector<unsigned> &Members = GI->second;
+    // A preamble only pays for itself if it's used more than once.
+    if (Members.size() < 2) continue;
+
+    // Find the #includes that all the members start with.
+    std::vector<std::string> Common;
+    bool First = true;
+    for (auto MI = Members.begin(), ME = Members.end(); MI != ME; ++MI) {
+      OwningPtr<MemoryBuffer> Buffer;
+      if (MemoryBuffer::getFile(Jobs[*MI].File, Buffer)) {
+        Common.clear();
+        break;
+      }
+      std::vector<std::string> Includes =
+          GetLeadingIncludes(Buffer->getBuffer());
+      if (First) {
+        Common.swap(Includes);
+        First = false;
+        continue;
+      }
+      size_t Length = 0;
+      while (Length < Common.size() && Length < Includes.size()
+             && Common[Length] == Includes[Length]) {
+        ++Length;
+      }
+      Common.resize(Length);
+      if (Common.empty()) break;
+    }
+    if (Common.empty()) continue;
+
+    SharedPreamble *Preamble = new SharedPreamble;
+    Preamble->Includes.swap(Common);
+    Preamble->Command = Jobs[Members[0]].Commands[0];
+    Preamble->MainFile = Jobs[Members[0]].File;
+    std::string Name = PreambleDir + "/preamble"
+                     + llvm::utostr(Preambles.size());
+    Preamble->HeaderPath = Name + ".h";
+    Preamble->PCHPath = Name + ".pch";
+    Preambles.push_back(Preamble);
+
+    for (auto MI = Members.begin(), ME = Members.end(); MI != ME; ++MI) {
+      Jobs[*MI].Preamble = Preamble;
+    }
+  }
+
+  forEachInParallel(Preambles.size(),
+                    [&](unsigned Index, WorkerFiles &Files) {
+    // The preamble doesn't claim the decls it processes: if it fails to
+    // build, the translation units have to process them themselves.
+    SharedPreamble &Preamble = *Preambles[Index];
+    TraceSpan Span("build preamble", Preamble.MainFile);
+    TUContext Context(&Preamble.Result, /*ProcessedDecls*/0, Cache != 0);
+    if (!BuildSharedPreamble(Preamble, Factory.create(Context),
+                             Files.get(Preamble.Command.Directory))) {
+      errs() << "Couldn't build a shared preamble for "
+             << Preamble.MainFile << "; parsing without it.\n";
+    }
+  });
+}
+
+// Writes what a worker process produced for a translation unit, for the
+// parent to read back with ReadTUResult().
+static void WriteTUResult(raw_ostream &Out, const TUResult &Result) {
+  Out << (Result.Succeeded ? 1 : 0) << "\n";
+  for (auto DI = Result.Dependencies.begin(), DE = Result.Dependencies.end();
+       DI != DE; ++DI) {
+    Out << "dep " << DI->ContentHash << " ";
+    WriteSizedString(Out, DI->FilePath);
+    Out << "\n";
+  }
+  Out << "edits\n";
+  WriteFileEdits(Out, Result.Edits);
+}
+
+static bool ReadTUResult(std::istream &In, TUResult &Result) {
+  int Succeeded = 0;
+  if (!(In >> Succeeded)) return false;
+  Result.Succeeded = Succeeded != 0;
+  for (std::string Tag; In >> Tag;) {
+    if (Tag == "edits") return ReadFileEdits(In, Result.Edits);
+    if (Tag != "dep") return false;
+
+    FileDependency Dep;
+    if (!(In >> Dep.ContentHash)) return false;
+    if (In.get() != ' ') return false;
+    if (!ReadSizedString(In, Dep.FilePath)) return false;
+    Result.Dependencies.push_back(std::move(Dep));
+  }
+  return false;
+}
+
+std::vector<unsigned> ParallelClangTool::getJobOrder(
+    const std::vector<TUJob> &Jobs,
+    const std::vector<TUResult> &Results) {
+  std::vector<unsigned> Pending;
+  for (size_t I = 0, E = Jobs.size(); I != E; ++I) {
+    if (!Results[I].FromCache) Pending.push_back(I);
+  }
+  if (!CostModel) return Pending;
+
+  // Starting the longest translation units first means the run doesn't end
+  // with a single worker busy on a big one that it picked up last.
+  TraceSpan Span("predict costs");
+  std::vector<std::string> Files;
+  for (auto PI = Pending.begin(), PE = Pending.end(); PI != PE; ++PI) {
+    Files.push_back(Jobs[*PI].File);
+  }
+  std::vector<unsigned> ByCost =
+      GetLongestFirstOrder(CostModel->predict(Files));
+  std::vector<unsigned> Order;
+  for (auto BI = ByCost.begin(), BE = ByCost.end(); BI != BE; ++BI) {
+    Order.push_back(Pending[*BI]);
+  }
+  return Order;
+}
+
+void ParallelClangTool::recordCosts(const std::vector<TUJob> &Jobs,
+                                    const std::vector<TUResult> &Results) {
+  for (size_t I = 0, E = Jobs.size(); I != E; ++I) {
+    const TUResult &Result = Results[I];
+    if (Result.FromCache || Jobs[I].Commands.empty()) continue;
+    // A translation unit that was cancelled took at least as long as it was
+    // allowed to.
+    double Seconds = Result.Seconds;
+    if (Result.OverBudget) Seconds = std::max(Seconds, Budget.Seconds);
+    CostModel->record(Jobs[I].File, Seconds);
+  }
+  if (!CostModel->save()) {
+    errs() << "Couldn't save the translation unit costs.\n";
+  }
+}
+
+void ParallelClangTool::runJobsInWorkerProcesses(
+    const std::vector<TUJob> &Jobs,
+    const std::vector<unsigned> &Pending,
+    TUActionFactory &Factory,
+    std::vector<TUResult> &Results) {
+  // Each worker process creates its own file managers, and keeps them for
+  // all the translation units it runs.
+  OwningPtr<WorkerFiles> Files;
+  RunInWorkerProcesses(Pending.size(), NumThreads, Budget,
+    [&](unsigned Index) -> std::string {
+      if (!Files) Files.reset(new WorkerFiles(FileCache));
+      const TUJob &Job = Jobs[Pending[Index]];
+      TUResult Result;
+      {
+        TraceSpan Span("translation unit", Job.File);
+        Result.Succeeded = runJob(Job, Factory, *Files, Result);
+      }
+      std::string Output;
+      raw_string_ostream Out(Output);
+      WriteTUResult(Out, Result);
+      return Out.str();
+    },
+    [&](unsigned Index, const WorkerItemResult &Item) {
+      const TUJob &Job = Jobs[Pending[Index]];
+      TUResult &Result = Results[Pending[Index]];
+      Result.Seconds = Item.Seconds;
+      Result.PeakMemoryBytes = Item.PeakMemoryBytes;
+      std::istringstream In(Item.Output);
+      if (Item.State != WorkerItemResult::Finished ||
+          !ReadTUResult(In, Result)) {
+        if (Item.State == WorkerItemResult::TimedOut) {
+          errs() << "Cancelled " << Job.File << " after " << Budget.Seconds
+                 << " s.\n";
+        } else if (Item.State == WorkerItemResult::OutOfMemory) {
+          errs() << "Cancelled " << Job.File << " for using more than "
+                 << (Budget.MemoryBytes >> 20) << " MB.\n";
+        } else {
+          errs() << "Crashed while processing " << Job.File << ".\n";
+        }
+        Result.Succeeded = false;
+        Result.OverBudget = Item.State == WorkerItemResult::TimedOut ||
+                            Item.State == WorkerItemResult::OutOfMemory;
+        Result.Edits.clear();
+        Result.Dependencies.clear();
+        return;
+      }
+      if (Cache && Result.Succeeded && !Result.CacheKey.empty()) {
+        Cache->store(Result.CacheKey, Result.Dependencies, Result.Edits);
+      }
+    });
+}
+
+void ParallelClangTool::reportCostliestJobs(
+    const std::vector<TUJob> &Jobs,
+    const std::vector<TUResult> &Results) {
+  std::vector<unsigned> Ran;
+  unsigned NumOverBudget = 0;
+  for (size_t I = 0, E = Jobs.size(); I != E; ++I) {
+    if (Results[I].FromCache) continue;
+    Ran.push_back(I);
+    if (Results[I].OverBudget) ++NumOverBudget;
+  }
+  if (Ran.empty()) return;
+
+  // The ones that were cancelled come first, then the slowest.
+  std::stable_sort(Ran.begin(), Ran.end(), [&](unsigned LHS, unsigned RHS) {
+    if (Results[LHS].OverBudget != Results[RHS].OverBudget) {
+      return Results[LHS].OverBudget;
+    }
+    return Results[LHS].Seconds > Results[RHS].Seconds;
+  });
+  const size_t NumShown = std::max<size_t>(std::min<size_t>(Ran.size(), 10),
+                                           NumOverBudget);
+  errs() << NumOverBudget << " of " << Ran.size() << " translation units "
+         << "went over budget. The costliest were:\n";
+  for (size_t I = 0; I != NumShown; ++I) {
+    const TUResult &Result = Results[Ran[I]];
+    errs() << format("  %8.2f s", Result.Seconds);
+    if (Budget.MemoryBytes) {
+      errs() << format(" %6llu MB",
+                       (unsigned long long)(Result.PeakMemoryBytes >> 20));
+    }
+    errs() << (Result.OverBudget ? "  cancelled  " : "  ")
+           << Jobs[Ran[I]].File << "\n";
+  }
+}
+
+bool ParallelClangTool::runJob(const TUJob &Job,
+                               TUActionFactory &Factory,
+                               WorkerFiles &Files,
+                               TUResult &Result) {
+  if (Job.Commands.empty()) {
+    // FIXME: There are two use cases here: doing a fuzzy
+    // "find . -name '*.cc' |xargs tool" match, where as a user I don't care
+    // about the .cc files that were not found, and the use case where I
+    // specify all files I want to run over explicitly, where this should
+    // be an error. We'll want to add an option for this.
+    errs() << "Skipping " << Job.File << ". Command line not found.\n";
+    return true;
+  }
+
+  bool Succeeded = true;
+  // Where each configuration's edits start in Result.Edits.
+  std::vector<size_t> ConfigStarts;
+  for (auto CI = Job.Commands.begin(), CE = Job.Commands.end();
+       CI != CE; ++CI) {
+    ConfigStarts.push_back(Result.Edits.size());
+    // ClangTool changes the process's working directory to the one the
+    // command was recorded in, which would race with the other workers.
+    // Have the compiler resolve relative paths against it instead.
+    std::vector<std::string> CommandLine = CI->CommandLine;
+    CommandLine.push_back("-fsyntax-only");
+    CommandLine.push_back("-working-directory=" + CI->Directory);
+    FileManager &FM = Files.get(CI->Directory);
+    // Each configuration of the file only skips the header decls that were
+    // processed with the same flags.
+    ProcessedDeclSet *Claims =
+        getProcessedDecls(GetFlagSetKey(*CI, Job.File));
+
+    if (Job.Preamble && Job.Preamble->Built) {
+      std::vector<std::string> WithPreamble = CommandLine;
+      WithPreamble.push_back("-include-pch");
+      WithPreamble.push_back(Job.Preamble->PCHPath);
+
+      TUResult Attempt;
+      TUContext Context(&Attempt, Claims, Cache != 0);
+      if (runCommand(Job.File, WithPreamble, Factory, FM, Context)) {
+        const TUResult &FromPreamble = Job.Preamble->Result;
+        Result.Edits.insert(Result.Edits.end(),
+                            Attempt.Edits.begin(), Attempt.Edits.end());
+        Result.Edits.insert(Result.Edits.end(),
+                            FromPreamble.Edits.begin(),
+                            FromPreamble.Edits.end());
+        Result.Dependencies.insert(Result.Dependencies.end(),
+                                   Attempt.Dependencies.begin(),
+                                   Attempt.Dependencies.end());
+        Result.Dependencies.insert(Result.Dependencies.end(),
+                                   FromPreamble.Dependencies.begin(),
+                                   FromPreamble.Dependencies.end());
+        continue;
+      }
+
+      // Headers without include guards can't be loaded from a preamble and
+      // then included again. Start over without the preamble, and without
+      // skipping the decls the failed attempt claimed.
+      TUContext RetryContext(&Result, /*ProcessedDecls*/0, Cache != 0);
+      if (!runCommand(Job.File, CommandLine, Factory, FM, RetryContext)) {
+        errs() << "Error while processing " << Job.File << ".\n";
+        Succeeded = false;
+      }
+      continue;
+    }
+
+    if (ASTs) {
+      // The AST cache finds out which files the TU read itself, whether
+      // it loads the AST or parses it.
+      TUContext Context(&Result, Claims, /*CollectDependencies*/false);
+      std::vector<FileDependency> Deps;
+      if (!ASTs->run(Job.File, CI->Directory, CommandLine,
+                     [&] { return Factory.create(Context); }, Deps)) {
+        errs() << "Error while processing " << Job.File << ".\n";
+        Succeeded = false;
+      }
+      if (Cache) {
+        Result.Dependencies.insert(Result.Dependencies.end(),
+                                   Deps.begin(), Deps.end());
+      }
+      continue;
+    }
+
+    TUContext Context(&Result, Claims, Cache != 0);
+    if (!runCommand(Job.File, CommandLine, Factory, FM, Context)) {
+      errs() << "Error while processing " << Job.File << ".\n";
+      Succeeded = false;
+    }
+  }
+  if (ConfigStarts.size() > 1) KeepUnanimousEdits(Result.Edits, ConfigStarts);
+  return Succeeded;
+}
+
+bool ParallelClangTool::runCommand(const std::string &File,
+                                   const std::vector<std::string> &CommandLine,
+                                   TUActionFactory &Factory,
+                                   FileManager &Files,
+                                   const TUContext &Context) {
+  // Preprocessing, parsing, Sema and the tool's traversal are interleaved,
+  // so they're all part of this span.
+  TraceSpan Span("frontend", File);
+  FrontendAction *Action = Factory.create(Context);
+  // Unsaved files are already handed to the compiler as buffers of their
+  // own.
+  if (FileCache && (!Overlay || Overlay->empty())) {
+    Action = FileCache->wrapAction(Action);
+  }
+  ToolInvocation Invocation(CommandLine, Action, &Files);
+  if (Overlay) {
+    for (auto OI = Overlay->begin(), OE = Overlay->end(); OI != OE; ++OI) {
+      Invocation.mapVirtualFile(OI->first, OI->second);
+    }
+  }
+  return Invocation.run();
+}
+
+bool ParallelClangTool::applyMergedEdits(
+    const std::vector<TUResult> &Results) {
+  EditMerger Merger;
+  for (auto RI = Results.begin(), RE = Results.end(); RI != RE; ++RI) {
+    Merger.addEdits(RI->Edits);
+  }
+
+  const FileOverlay NoOverlay;
+  std::map<std::string, EditMerger::FileUpdate> Updates;
+  bool Succeeded = Merger.output(OutputMode,
+                                 Overlay ? *Overlay : NoOverlay,
+                                 *Out,
+                                 &Updates);
+  if (Cache) {
+    TraceSpan Span("update cache");
+    updateIncrementalCache(Results, Merger, Updates);
+  }
+  return Succeeded;
+}
+
+void ParallelClangTool::updateIncrementalCache(
+    const std::vector<TUResult> &Results,
+    const EditMerger &Merger,
+    const std::map<std::string, EditMerger::FileUpdate> &Updates) {
+  for (auto UI = Updates.begin(), UE = Updates.end(); UI != UE; ++UI) {
+    Cache->invalidateFile(UI->first);
+  }
+
+  for (auto RI = Results.begin(), RE = Results.end(); RI != RE; ++RI) {
+    if (!RI->Succeeded || RI->CacheKey.empty()) continue;
+
+    // Describe the files as they are now. A file we wrote from the
+    // contents this TU saw now has the new contents, and this TU's edits
+    // to it are done.
+    bool Changed = !RI->FromCache;
+    std::vector<FileDependency> Deps = RI->Dependencies;
+    for (auto DI = Deps.begin(), DE = Deps.end(); DI != DE; ++DI) {
+      auto Update = Updates.find(DI->FilePath);
+      if (Update == Updates.end()) continue;
+      if (Update->second.OldHash != DI->ContentHash) continue;
+      DI->ContentHash = Update->second.NewHash;
+      Changed = true;
+    }
+    if (!Changed) continue;
+
+    std::vector<FileEdits> PendingEdits;
+    bool HasConflicts = false;
+    for (auto FI = RI->Edits.begin(), FE = RI->Edits.end(); FI != FE; ++FI) {
+      // If some of its edits lost out to conflicting ones, parse the TU
+      // again next time rather than forgetting about them.
+      if (Merger.hasConflicts(FI->FilePath)) HasConflicts = true;
+      auto Update = Updates.find(FI->FilePath);
+      if (Update != Updates.end()
+          && Update->second.OldHash == FI->ContentHash) {
+        continue;
+      }
+      PendingEdits.push_back(*FI);
+    }
+    if (HasConflicts) continue;
+
+    Cache->store(RI->CacheKey, Deps, PendingEdits);
+  }
+}
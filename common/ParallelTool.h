@@ -0,0 +1,267 @@
+#ifndef CPP_TOOLS_COMMON_PARALLEL_TOOL_H
+#define CPP_TOOLS_COMMON_PARALLEL_TOOL_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "Edits.h"
+#include "ProcessedDecls.h"
+#include "WorkerPool.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class ASTCache;
+class FileOverlay;
+class IncrementalCache;
+class SharedFileCache;
+class TUCostModel;
+struct SharedPreamble;
+
+namespace clang {
+class FileManager;
+class FrontendAction;
+}
+
+namespace llvm {
+class raw_ostream;
+}
+
+// Everything a single translation unit produced. Each TU gets its own
+// result, which is filled in by whichever worker ran it.
+struct TUResult {
+  TUResult()
+    : Succeeded(false), FromCache(false), OverBudget(false), Seconds(0),
+      PeakMemoryBytes(0) {}
+
+  bool Succeeded;
+  // Whether the result was taken from the incremental cache instead of
+  // parsing the TU.
+  bool FromCache;
+  // Whether the TU was cancelled for going over its time or memory budget.
+  bool OverBudget;
+  // How long running the TU took, and, with a memory budget, the most
+  // memory its worker process used.
+  double Seconds;
+  uint64_t PeakMemoryBytes;
+  // Identifies the TU and its compile commands in the incremental cache.
+  std::string CacheKey;
+  // The edits the TU made, which are applied once all TUs are done.
+  std::vector<FileEdits> Edits;
+  // Every file the TU read. Only collected when there's a cache.
+  std::vector<FileDependency> Dependencies;
+};
+
+// What a frontend action running on one translation unit shares with the
+// rest of the run.
+struct TUContext {
+  TUContext(TUResult *Result,
+            ProcessedDeclSet *ProcessedDecls,
+            bool CollectDependencies)
+    : Result(Result)
+    , ProcessedDecls(ProcessedDecls)
+    , CollectDependencies(CollectDependencies)
+    {}
+
+  // Where the action puts what it produced.
+  TUResult *Result;
+  // Header decls that some translation unit has already processed.
+  ProcessedDeclSet *ProcessedDecls;
+  // Whether the action should record the files the TU read in its result.
+  bool CollectDependencies;
+};
+
+// Creates a frontend action for one run over a translation unit.
+class TUActionFactory {
+public:
+  virtual ~TUActionFactory() {}
+  virtual clang::FrontendAction *create(const TUContext &Context) = 0;
+};
+
+// Returns a factory for an action type that takes a TUContext in its
+// constructor.
+template <typename T>
+TUActionFactory *newTUActionFactory() {
+  class SimpleTUActionFactory : public TUActionFactory {
+  public:
+    virtual clang::FrontendAction *create(const TUContext &Context) {
+      return new T(Context);
+    }
+  };
+  return new SimpleTUActionFactory;
+}
+
+// Like ClangTool, but runs the translation units on a pool of worker
+// threads. Each worker has its own FileManagers, and each translation unit
+// gets its own CompilerInstance and frontend action, but they all share the
+// results of stat calls and the contents of the headers they read. No
+// files are written until every translation unit is done; then the edits
+// are merged in the order of the source paths, duplicates are dropped, and
+// each changed file is written once from the calling thread. The output
+// doesn't depend on how the work was scheduled.
+class ParallelClangTool {
+public:
+  ParallelClangTool(const clang::tooling::CompilationDatabase &Compilations,
+                    llvm::ArrayRef<std::string> SourcePaths,
+                    unsigned NumThreads);
+
+  // Reuses the results of unchanged translation units from earlier runs,
+  // and records this run's results for the next one.
+  void setIncrementalCache(IncrementalCache *Cache) {
+    this->Cache = Cache;
+  }
+
+  // Loads each translation unit's AST from the cache if it's there, and
+  // saves the ones that had to be parsed. Shared preambles aren't used with
+  // it, since a loaded AST has its headers in it already.
+  void setASTCache(ASTCache *ASTs) {
+    this->ASTs = ASTs;
+  }
+
+  // Before running the translation units, builds a precompiled header for
+  // each group of them that have the same flags and start with the same
+  // #includes, and has them load it instead of parsing those headers.
+  void setUseSharedPreambles(bool UseSharedPreambles) {
+    this->UseSharedPreambles = UseSharedPreambles;
+  }
+
+  // Runs the translation units in forked worker processes instead of
+  // threads, so that one that crashes, e.g. on an assertion, is reported
+  // as failed without losing the rest of the run. With an incremental
+  // cache, each translation unit's result is stored as soon as it's done,
+  // so that a run that's interrupted can pick up where it left off.
+  void setUseWorkerProcesses(bool UseWorkerProcesses) {
+    this->UseWorkerProcesses = UseWorkerProcesses;
+  }
+
+  // Starts the translation units that the model predicts are the most
+  // expensive first, and records how long each one took in it.
+  void setCostModel(TUCostModel *CostModel) {
+    this->CostModel = CostModel;
+  }
+
+  // Cancels any translation unit that takes longer than Seconds, or whose
+  // worker process uses more than MemoryBytes, and reports it along with
+  // the costliest ones that did finish. Zero means no limit. Cancelling
+  // needs worker processes, so a budget turns them on.
+  void setBudget(double Seconds, uint64_t MemoryBytes) {
+    Budget.Seconds = Seconds;
+    Budget.MemoryBytes = MemoryBytes;
+  }
+
+  // Parses the unsaved contents of the files in the overlay instead of
+  // what's on disk. The incremental cache and shared preambles describe the
+  // files on disk, so they aren't used with unsaved files.
+  void setFileOverlay(const FileOverlay *Overlay) {
+    this->Overlay = Overlay;
+  }
+
+  // Prints a diff of the merged edits, or the edits themselves, to Out
+  // instead of writing the changed files.
+  void setOutputMode(EditOutputMode Mode, llvm::raw_ostream *Out) {
+    this->OutputMode = Mode;
+    this->Out = Out;
+  }
+
+  // Runs an action created by Factory on every translation unit, then
+  // outputs the merged edits. Returns 0 on success, 1 if any
+  // translation unit failed or any file couldn't be written.
+  int run(TUActionFactory &Factory);
+
+private:
+  const clang::tooling::CompilationDatabase &Compilations;
+  std::vector<std::string> SourcePaths;
+  const unsigned NumThreads;
+  // The header decls processed so far, a set for each set of flags, so
+  // that which translation unit claims a decl first can't change its edits.
+  std::mutex ProcessedDeclsLock;
+  std::map<std::string, std::shared_ptr<ProcessedDeclSet> > ProcessedDecls;
+  IncrementalCache *Cache;
+  ASTCache *ASTs;
+  bool UseSharedPreambles;
+  bool UseWorkerProcesses;
+  WorkerBudget Budget;
+  TUCostModel *CostModel;
+  const FileOverlay *Overlay;
+  // Only set while running.
+  SharedFileCache *FileCache;
+  EditOutputMode OutputMode;
+  llvm::raw_ostream *Out;
+
+  // A translation unit to run, and how to run it.
+  struct TUJob {
+    TUJob() : Preamble(0) {}
+
+    std::string File;
+    std::vector<clang::tooling::CompileCommand> Commands;
+    // The shared preamble to load, if any.
+    const SharedPreamble *Preamble;
+  };
+
+  // The FileManagers of one worker, one for each directory that compile
+  // commands run in, all answering stat calls from the run's shared cache.
+  class WorkerFiles {
+  public:
+    explicit WorkerFiles(SharedFileCache *FileCache) : FileCache(FileCache) {}
+    ~WorkerFiles();
+
+    // Returns the FileManager for commands that run in Directory.
+    clang::FileManager &get(const std::string &Directory);
+
+  private:
+    SharedFileCache *FileCache;
+    std::map<std::string, clang::FileManager *> Managers;
+  };
+
+  // Calls Body with each index in [0, NumItems) on the worker threads,
+  // along with the worker's own FileManagers.
+  void forEachInParallel(
+      unsigned NumItems,
+      const std::function<void(unsigned, WorkerFiles &)> &Body);
+  // Likewise, starting the indices in the given order.
+  void forEachInParallel(
+      const std::vector<unsigned> &Order,
+      const std::function<void(unsigned, WorkerFiles &)> &Body);
+
+  // Returns the processed decls shared by the commands with these flags.
+  ProcessedDeclSet *getProcessedDecls(const std::string &FlagSetKey);
+  void prepareJob(const std::string &SourcePath,
+                  TUJob &Job,
+                  TUResult &Result);
+  void buildSharedPreambles(std::vector<TUJob> &Jobs,
+                            const std::vector<TUResult> &Results,
+                            TUActionFactory &Factory,
+                            const std::string &PreambleDir,
+                            std::vector<SharedPreamble*> &Preambles);
+  // Returns the jobs that weren't found in the cache, in the order to run
+  // them in.
+  std::vector<unsigned> getJobOrder(const std::vector<TUJob> &Jobs,
+                                    const std::vector<TUResult> &Results);
+  void runJobsInWorkerProcesses(const std::vector<TUJob> &Jobs,
+                                const std::vector<unsigned> &Pending,
+                                TUActionFactory &Factory,
+                                std::vector<TUResult> &Results);
+  void recordCosts(const std::vector<TUJob> &Jobs,
+                   const std::vector<TUResult> &Results);
+  void reportCostliestJobs(const std::vector<TUJob> &Jobs,
+                           const std::vector<TUResult> &Results);
+  bool runJob(const TUJob &Job,
+              TUActionFactory &Factory,
+              WorkerFiles &Files,
+              TUResult &Result);
+  bool runCommand(const std::string &File,
+                  const std::vector<std::string> &CommandLine,
+                  TUActionFactory &Factory,
+                  clang::FileManager &Files,
+                  const TUContext &Context);
+  bool applyMergedEdits(const std::vector<TUResult> &Results);
+  void updateIncrementalCache(
+      const std::vector<TUResult> &Results,
+      const EditMerger &Merger,
+      const std::map<std::string, EditMerger::FileUpdate> &Updates);
+};
+
+#endif
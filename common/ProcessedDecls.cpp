@@ -0,0 +1,59 @@
+#include "clang/AST/DeclBase.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "Edits.h"
+#include "ProcessedDecls.h"
+#include "SourceFiles.h"
+using namespace clang;
+using namespace llvm;
+
+bool ProcessedDeclSet::claim(uint64_t FileKey, unsigned Offset) {
+  Key K = { FileKey, Offset };
+  Shard &S = Shards[KeyHash()(K) % NumShards];
+  std::lock_guard<std::mutex> Guard(S.Lock);
+  return S.Keys.insert(K).second;
+}
+
+uint64_t ProcessedDeclSet::getFileKey(const std::string &FilePath,
+                                      uint64_t ContentHash) {
+  return (uint64_t)HashString(FilePath) * 31 + ContentHash;
+}
+
+bool ProcessedDeclTracker::shouldProcess(const Decl *D) {
+  if (!Shared) return true;
+
+  // Every decl from one macro expansion is at the same expansion location,
+  // so they can't be told apart; each translation unit processes them all,
+  // and the duplicate edits are dropped when they're merged.
+  if (D->getLocation().isMacroID()) return true;
+  SourceLocation Loc = D->getLocation();
+  if (Loc.isInvalid()) return true;
+
+  std::pair<FileID, unsigned> Decomposed = SM.getDecomposedLoc(Loc);
+  if (Decomposed.first == SM.getMainFileID()) return true;
+
+  uint64_t FileKey = getFileKey(Decomposed.first);
+  if (!FileKey) return true;
+  return Shared->claim(FileKey, Decomposed.second);
+}
+
+uint64_t ProcessedDeclTracker::getFileKey(FileID FID) {
+  auto Found = FileKeys.find(FID);
+  if (Found != FileKeys.end()) return Found->second;
+
+  // Files without a path on disk, like the predefines buffer, get a key of
+  // zero, which means they're never shared.
+  uint64_t Key = 0;
+  std::string FilePath = GetCanonicalFilePath(SM, FID);
+  bool Invalid = false;
+  const MemoryBuffer *Buffer = SM.getBuffer(FID, &Invalid);
+  if (!FilePath.empty() && !Invalid) {
+    Key = ProcessedDeclSet::getFileKey(
+        FilePath,
+        HashFileContents(Buffer->getBufferStart(), Buffer->getBufferSize()));
+  }
+
+  FileKeys[FID] = Key;
+  return Key;
+}
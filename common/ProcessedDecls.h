@@ -0,0 +1,82 @@
+#ifndef CPP_TOOLS_COMMON_PROCESSED_DECLS_H
+#define CPP_TOOLS_COMMON_PROCESSED_DECLS_H
+
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/DenseMap.h"
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_set>
+
+namespace clang {
+class Decl;
+class SourceManager;
+}
+
+// The set of header decls that have already been processed by some
+// translation unit in this run, shared by all the workers. A decl is
+// identified by the file it's in, the hash of that file's contents, and its
+// offset in the file, so the same inline function or class seen by two
+// translation units maps to the same entry. Decls expanded from macros
+// aren't shared. A macro or flag can change what a decl means, so only
+// translation units parsed with the same flags may share a set.
+class ProcessedDeclSet {
+public:
+  // Marks a decl as processed. Returns true if this call was the first to
+  // do so, i.e. if the caller should process it.
+  bool claim(uint64_t FileKey, unsigned Offset);
+
+  // Combines a file's path and content hash into the key used by claim().
+  static uint64_t getFileKey(const std::string &FilePath,
+                             uint64_t ContentHash);
+
+private:
+  struct Key {
+    uint64_t FileKey;
+    unsigned Offset;
+
+    bool operator==(const Key &RHS) const {
+      return FileKey == RHS.FileKey && Offset == RHS.Offset;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key &K) const {
+      return K.FileKey ^ (K.Offset * 0x9E3779B97F4A7C15ULL);
+    }
+  };
+
+  // The set is split into shards with their own locks, so that workers
+  // claiming decls at the same time rarely wait on each other.
+  enum { NumShards = 64 };
+  struct Shard {
+    std::mutex Lock;
+    std::unordered_set<Key, KeyHash> Keys;
+  };
+  Shard Shards[NumShards];
+};
+
+// Answers, for one translation unit, whether a decl has already been
+// processed by another translation unit, claiming it for this one if not.
+// Decls in the main file are never shared, so they're always processed.
+class ProcessedDeclTracker {
+public:
+  ProcessedDeclTracker(const clang::SourceManager &SM,
+                       ProcessedDeclSet *Shared)
+    : SM(SM)
+    , Shared(Shared)
+    {}
+
+  bool shouldProcess(const clang::Decl *D);
+
+private:
+  const clang::SourceManager &SM;
+  ProcessedDeclSet *Shared;
+
+  // Working out a file's key needs its canonical path and a hash of its
+  // contents, so only do it once per file.
+  llvm::DenseMap<clang::FileID, uint64_t> FileKeys;
+
+  uint64_t getFileKey(clang::FileID FID);
+};
+
+#endif
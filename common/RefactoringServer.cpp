@@ -0,0 +1,360 @@
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/AST/DeclGroup.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "CompileCommands.h"
+#include "EditRecorder.h"
+#include "FileOverlay.h"
+#include "RefactoringServer.h"
+#include "SourceFiles.h"
+#include <chrono>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+using namespace clang;
+using namespace clang::tooling;
+using namespace llvm;
+
+bool ConsumerRequestHandler::handle(ASTUnit &AST,
+                                    const ServerRequest &Request,
+                                    std::vector<FileEdits> &Edits,
+                                    std::string &Error) {
+  if (!Request.Args.empty()) {
+    Error = "Expected nothing after the file name.";
+    return false;
+  }
+
+  SourceManager &SM = AST.getSourceManager();
+  EditRecorder Recorder(SM, AST.getASTContext().getLangOpts());
+  OwningPtr<ASTConsumer> Consumer(createConsumer(SM, Recorder));
+  for (auto DI = AST.top_level_begin(), DE = AST.top_level_end();
+       DI != DE; ++DI) {
+    // Top-level decls from the preamble can be in the headers, which are
+    // left alone.
+    if (!SM.isFromMainFile((*DI)->getLocation())) continue;
+    Consumer->HandleTopLevelDecl(DeclGroupRef(*DI));
+  }
+  Consumer->HandleTranslationUnit(AST.getASTContext());
+  Recorder.takeEdits(Edits);
+  return true;
+}
+
+// Finds clang's builtin headers relative to the executable. Any function
+// in it will do for finding it.
+static std::string GetResourcesPath(const char *Argv0) {
+  void *MainAddr = reinterpret_cast<void*>(
+      reinterpret_cast<intptr_t>(&GetResourcesPath));
+  return CompilerInvocation::GetResourcesPath(Argv0, MainAddr);
+}
+
+RefactoringServer::RefactoringServer(const CompilationDatabase &Compilations,
+                                     ServerRequestHandler &Handler,
+                                     const char *Argv0)
+  : Compilations(Compilations)
+  , Handler(Handler)
+  , ResourcesPath(GetResourcesPath(Argv0))
+  , OutputMode(OutputInPlace)
+  {}
+
+RefactoringServer::~RefactoringServer() {
+  for (auto AI = ASTs.begin(), AE = ASTs.end(); AI != AE; ++AI) {
+    delete AI->second;
+  }
+}
+
+namespace {
+  // Reads a request from a connection. What's read is buffered, since the
+  // unsaved files that come before the request line can end anywhere.
+  class ConnectionReader {
+  public:
+    explicit ConnectionReader(int Connection) : Connection(Connection) {}
+
+    // Reads up to the end of the next line. Returns false if the
+    // connection was closed first, or the line is unreasonably long.
+    bool readLine(std::string &Line) {
+      size_t Searched = 0;
+      for (;;) {
+        size_t End = Buffer.find('\n', Searched);
+        if (End != std::string::npos) {
+          Line.assign(Buffer, 0, End);
+          Buffer.erase(0, End + 1);
+          return true;
+        }
+        Searched = Buffer.size();
+        if (Buffer.size() >= (1 << 20) || !fill()) return false;
+      }
+    }
+
+    // Reads exactly Size bytes. Returns false if the connection was closed
+    // first, or Size is more than an unsaved file can be.
+    bool read(size_t Size, std::string &Data) {
+      if (Size > FileOverlay::MaxFileSize) return false;
+      while (Buffer.size() < Size) {
+        if (!fill()) return false;
+      }
+      Data.assign(Buffer, 0, Size);
+      Buffer.erase(0, Size);
+      return true;
+    }
+
+  private:
+    int Connection;
+    std::string Buffer;
+
+    bool fill() {
+      char Chunk[4096];
+      for (;;) {
+        ssize_t Read = ::read(Connection, Chunk, sizeof(Chunk));
+        if (Read < 0 && errno == EINTR) continue;
+        if (Read <= 0) return false;
+        Buffer.append(Chunk, Read);
+        return true;
+      }
+    }
+  };
+}
+
+static void WriteAll(int Connection, StringRef Data) {
+  while (!Data.empty()) {
+    ssize_t Written = write(Connection, Data.data(), Data.size());
+    if (Written < 0 && errno == EINTR) continue;
+    if (Written <= 0) return;
+    Data = Data.drop_front(Written);
+  }
+}
+
+bool RefactoringServer::serve(const std::string &SocketPath) {
+  sockaddr_un Address;
+  memset(&Address, 0, sizeof(Address));
+  Address.sun_family = AF_UNIX;
+  if (SocketPath.size() >= sizeof(Address.sun_path)) {
+    errs() << "The socket path " << SocketPath << " is too long.\n";
+    return false;
+  }
+  strcpy(Address.sun_path, SocketPath.c_str());
+
+  // A socket left behind by a server that was killed would make bind()
+  // fail. Anything else at the path is left alone.
+  struct stat Status;
+  if (lstat(SocketPath.c_str(), &Status) == 0 && S_ISSOCK(Status.st_mode)) {
+    unlink(SocketPath.c_str());
+  }
+
+  int Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Listener < 0 ||
+      bind(Listener, reinterpret_cast<sockaddr*>(&Address),
+           sizeof(Address)) != 0 ||
+      listen(Listener, SOMAXCONN) != 0) {
+    errs() << "Couldn't listen on " << SocketPath << ": " << strerror(errno)
+           << "\n";
+    if (Listener >= 0) close(Listener);
+    return false;
+  }
+
+  // A client that hangs up before reading its response mustn't take the
+  // server down with it.
+  signal(SIGPIPE, SIG_IGN);
+  errs() << "Listening on " << SocketPath << "\n";
+
+  for (;;) {
+    int Connection = accept(Listener, 0, 0);
+    if (Connection < 0) {
+      if (errno == EINTR) continue;
+      errs() << "Couldn't accept a connection: " << strerror(errno) << "\n";
+      break;
+    }
+
+    // Unsaved files come first, then the request line.
+    ConnectionReader Reader(Connection);
+    FileOverlay Overlay;
+    for (std::string Line; Reader.readLine(Line);) {
+      size_t Size = 0;
+      std::string Path;
+      if (!FileOverlay::parseHeader(Line, Size, Path)) {
+        // What follows a bad header can't be told apart from a request.
+        if (StringRef(Line).startswith("unsaved ")) {
+          WriteAll(Connection, "error: Malformed unsaved file header, or the "
+                               "file is over " +
+                               utostr(FileOverlay::MaxFileSize) +
+                               " bytes.\n");
+          break;
+        }
+        WriteAll(Connection, handleRequest(Line, Overlay));
+        break;
+      }
+      std::string Contents;
+      if (!Reader.read(Size, Contents)) break;
+      Overlay.add(Path, std::move(Contents));
+    }
+    close(Connection);
+  }
+
+  close(Listener);
+  unlink(SocketPath.c_str());
+  return false;
+}
+
+std::string RefactoringServer::handleRequest(StringRef Line,
+                                             const FileOverlay &Overlay) {
+  typedef std::chrono::steady_clock Clock;
+  const Clock::time_point Start = Clock::now();
+
+  SmallVector<StringRef, 8> Fields;
+  SplitString(Line, Fields);
+  if (Fields.empty()) return "error: Expected a file name.\n";
+  if (OutputMode == OutputInPlace && !Overlay.empty()) {
+    return "error: Unsaved files can't be written in place; start the "
+           "server with -output=diff or -output=replacements.\n";
+  }
+
+  ServerRequest Request;
+  Request.File = GetAbsolutePath(Fields[0]);
+  for (unsigned I = 1, E = Fields.size(); I < E; ++I) {
+    Request.Args.push_back(Fields[I]);
+  }
+
+  std::string Error;
+  std::vector<FileEdits> Edits;
+  ASTUnit *AST = getAST(Request.File, Overlay, Error);
+  if (!AST || !Handler.handle(*AST, Request, Edits, Error)) {
+    errs() << Request.File << ": " << Error << "\n";
+    return "error: " + Error + "\n";
+  }
+
+  EditMerger Merger;
+  Merger.addEdits(Edits);
+  std::string Output;
+  raw_string_ostream OutputStream(Output);
+  std::map<std::string, EditMerger::FileUpdate> Updates;
+  if (!Merger.output(OutputMode, Overlay, OutputStream, &Updates)) {
+    return "error: Couldn't read or update the files, or they changed while "
+           "they were being parsed.\n";
+  }
+
+  std::string Response = "ok\n";
+  if (OutputMode != OutputInPlace) {
+    Response += OutputStream.str();
+  }
+  for (auto UI = Updates.begin(), UE = Updates.end(); UI != UE; ++UI) {
+    Response += UI->first + "\n";
+  }
+  errs() << Request.File << ": "
+         << std::chrono::duration_cast<std::chrono::milliseconds>(
+                Clock::now() - Start).count()
+         << " ms\n";
+  return Response;
+}
+
+// Remaps the main file to Contents, and every other unsaved file to its
+// contents. The AST takes ownership of the buffers.
+static void GetRemappedFiles(const std::string &File,
+                             StringRef Contents,
+                             const FileOverlay &Overlay,
+                             std::vector<ASTUnit::RemappedFile> &Remapped) {
+  Remapped.push_back(ASTUnit::RemappedFile(
+      File, MemoryBuffer::getMemBufferCopy(Contents, File)));
+  for (auto OI = Overlay.begin(), OE = Overlay.end(); OI != OE; ++OI) {
+    if (OI->first == File) continue;
+    Remapped.push_back(ASTUnit::RemappedFile(
+        OI->first, MemoryBuffer::getMemBufferCopy(OI->second, OI->first)));
+  }
+}
+
+ASTUnit *RefactoringServer::getAST(const std::string &File,
+                                   const FileOverlay &Overlay,
+                                   std::string &Error) {
+  // The file is read here, and handed to the AST as an unsaved buffer, since
+  // the AST's file manager remembers the size the file had when it was
+  // first read.
+  std::string Contents;
+  if (!Overlay.getContents(File, Contents)) {
+    Error = "Couldn't read " + File + ".";
+    return 0;
+  }
+
+  auto Found = ASTs.find(File);
+  if (Found == ASTs.end()) {
+    return loadAST(File, Contents, Overlay, Error);
+  }
+
+  // Only what comes after the preamble is parsed again, unless the
+  // includes at the top of the file, or the headers, have changed.
+  std::vector<ASTUnit::RemappedFile> Remapped;
+  GetRemappedFiles(File, Contents, Overlay, Remapped);
+  if (Found->second->Reparse(Remapped.data(), Remapped.size())) {
+    Error = "Couldn't parse " + File + ".";
+    delete Found->second;
+    ASTs.erase(Found);
+    return 0;
+  }
+  return Found->second;
+}
+
+ASTUnit *RefactoringServer::loadAST(const std::string &File,
+                                    StringRef Contents,
+                                    const FileOverlay &Overlay,
+                                    std::string &Error) {
+  std::vector<CompileCommand> Commands = Compilations.getCompileCommands(File);
+  if (Commands.empty()) {
+    Error = "Command line not found for " + File + ".";
+    return 0;
+  }
+
+  // Like ParallelClangTool, have the compiler resolve relative paths
+  // against the command's directory.
+  const CompileCommand &Command = Commands.front();
+  std::vector<std::string> CommandLine;
+  CommandLine.push_back(Command.CommandLine.front());
+  std::vector<std::string> Args = GetSemanticArguments(Command, File);
+  CommandLine.insert(CommandLine.end(), Args.begin(), Args.end());
+  CommandLine.push_back("-fsyntax-only");
+  CommandLine.push_back("-working-directory=" + Command.Directory);
+  CommandLine.push_back(File);
+
+  std::vector<const char*> Argv;
+  for (auto AI = CommandLine.begin(), AE = CommandLine.end(); AI != AE; ++AI) {
+    Argv.push_back(AI->c_str());
+  }
+
+  IntrusiveRefCntPtr<DiagnosticsEngine> Diags(
+      CompilerInstance::createDiagnostics(new DiagnosticOptions(),
+                                          Argv.size(), Argv.data()));
+  std::vector<ASTUnit::RemappedFile> Remapped;
+  GetRemappedFiles(File, Contents, Overlay, Remapped);
+  OwningPtr<ASTUnit> AST(ASTUnit::LoadFromCommandLine(
+      Argv.data(), Argv.data() + Argv.size(), Diags, ResourcesPath,
+      /*OnlyLocalDecls*/false, /*CaptureDiagnostics*/false,
+      Remapped.data(), Remapped.size(),
+      /*RemappedFilesKeepOriginalName*/true, /*PrecompilePreamble*/true));
+  if (!AST) {
+    Error = "Couldn't parse " + File + ".";
+    return 0;
+  }
+
+  // The preamble is only built when the AST is first reparsed. Do that now,
+  // so that the next request for the file is already fast.
+  std::vector<ASTUnit::RemappedFile> Again;
+  GetRemappedFiles(File, Contents, Overlay, Again);
+  if (AST->Reparse(Again.data(), Again.size())) {
+    Error = "Couldn't parse " + File + ".";
+    return 0;
+  }
+
+  ASTs[File] = AST.get();
+  return AST.take();
+}
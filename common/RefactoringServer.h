@@ -0,0 +1,110 @@
+#ifndef CPP_TOOLS_COMMON_REFACTORING_SERVER_H
+#define CPP_TOOLS_COMMON_REFACTORING_SERVER_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringRef.h"
+#include "Edits.h"
+#include <map>
+#include <string>
+#include <vector>
+
+class EditRecorder;
+class FileOverlay;
+
+namespace clang {
+class ASTConsumer;
+class ASTUnit;
+class SourceManager;
+}
+
+// A request to a tool's server: the file to work on, and whatever else the
+// tool needs to know, e.g. which lines to extract.
+struct ServerRequest {
+  std::string File;
+  std::vector<std::string> Args;
+};
+
+// What a tool does with a request, given the freshly parsed AST of the
+// file. Only the main file is edited.
+class ServerRequestHandler {
+public:
+  virtual ~ServerRequestHandler() {}
+
+  // Appends the edits to make to Edits. Returns false, with a message in
+  // Error, if the request can't be handled.
+  virtual bool handle(clang::ASTUnit &AST,
+                      const ServerRequest &Request,
+                      std::vector<FileEdits> &Edits,
+                      std::string &Error) = 0;
+};
+
+// Handles requests that take no arguments by running a tool's AST consumer
+// over the top-level decls of the main file, like its frontend action would
+// over a whole translation unit.
+class ConsumerRequestHandler : public ServerRequestHandler {
+public:
+  virtual bool handle(clang::ASTUnit &AST,
+                      const ServerRequest &Request,
+                      std::vector<FileEdits> &Edits,
+                      std::string &Error);
+
+protected:
+  // Creates the consumer that makes the tool's edits with Recorder.
+  virtual clang::ASTConsumer *createConsumer(const clang::SourceManager &SM,
+                                             EditRecorder &Recorder) = 0;
+};
+
+// Serves requests over a Unix socket, one at a time, keeping an ASTUnit for
+// every file it has seen. The includes at the top of each file are
+// precompiled into a preamble the first time the file is requested, so
+// later requests only parse the rest of the file again.
+//
+// A request is a single line with the file and its arguments, separated by
+// whitespace. It can be preceded by the unsaved contents of any files, in
+// the format FileOverlay reads, which are parsed instead of what's on disk.
+// The response is "ok" followed by the files that were changed, one per
+// line, or by the diff or edits if the server doesn't write the files; or
+// "error: " followed by what went wrong.
+class RefactoringServer {
+public:
+  // Argv0 is used to find clang's builtin headers.
+  RefactoringServer(const clang::tooling::CompilationDatabase &Compilations,
+                    ServerRequestHandler &Handler,
+                    const char *Argv0);
+  ~RefactoringServer();
+
+  // Responds with a diff of the edits, or the edits themselves, instead of
+  // writing the changed files. Requests with unsaved files need this.
+  void setOutputMode(EditOutputMode Mode) {
+    OutputMode = Mode;
+  }
+
+  // Listens on the socket and handles requests until the server is killed.
+  // Returns false if the socket can't be set up.
+  bool serve(const std::string &SocketPath);
+
+  // Handles a request line, along with the unsaved files that came before
+  // it, and returns the response.
+  std::string handleRequest(llvm::StringRef Line, const FileOverlay &Overlay);
+
+private:
+  const clang::tooling::CompilationDatabase &Compilations;
+  ServerRequestHandler &Handler;
+  const std::string ResourcesPath;
+  EditOutputMode OutputMode;
+  // Keyed by absolute path. Each AST has its own file manager, which keeps
+  // what it has read about the file's headers between requests.
+  std::map<std::string, clang::ASTUnit*> ASTs;
+
+  // Returns the AST of the file, parsed again from the unsaved files and
+  // what's on disk now, or null with a message in Error.
+  clang::ASTUnit *getAST(const std::string &File,
+                         const FileOverlay &Overlay,
+                         std::string &Error);
+  clang::ASTUnit *loadAST(const std::string &File,
+                          llvm::StringRef Contents,
+                          const FileOverlay &Overlay,
+                          std::string &Error);
+};
+
+#endif
@@ -0,0 +1,269 @@
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "CompileCommands.h"
+#include "CostModel.h"
+#include "FileOverlay.h"
+#include "Shards.h"
+#include "SharedPreamble.h"
+#include "SourceFiles.h"
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <set>
+#include <sstream>
+#include <stdio.h>
+using namespace clang::tooling;
+using namespace llvm;
+
+static const char ShardHeader[] = "cpp-tools-shard 2";
+
+// Every file takes some time, however little it's predicted to, so that a
+// run of files that are all predicted to be free still gets split.
+static const double MinFileCost = 1e-3;
+
+bool ParseShard(StringRef Spec, unsigned &Index, unsigned &Count) {
+  std::pair<StringRef, StringRef> Parts = Spec.split('/');
+  if (Parts.first.getAsInteger(10, Index)) return false;
+  if (Parts.second.getAsInteger(10, Count)) return false;
+  return Count > 0 && Index < Count;
+}
+
+namespace {
+  // A source file, and what decides which shard it goes in.
+  struct ShardFile {
+    std::string Path;
+    std::string FlagSetKey;
+    std::vector<std::string> Includes;
+    double Cost;
+  };
+
+  // Orders files so that the ones with the same flags and the longest
+  // common run of leading #includes are next to each other.
+  bool operator<(const ShardFile &LHS, const ShardFile &RHS) {
+    if (LHS.FlagSetKey != RHS.FlagSetKey) {
+      return LHS.FlagSetKey < RHS.FlagSetKey;
+    }
+    if (LHS.Includes != RHS.Includes) return LHS.Includes < RHS.Includes;
+    return LHS.Path < RHS.Path;
+  }
+}
+
+// Returns how much two files have in common: nothing if they're built with
+// different flags, and otherwise more the more leading #includes they
+// share, and if they're in the same directory, where their quoted includes
+// are looked up first.
+static unsigned GetAffinity(const ShardFile &LHS, const ShardFile &RHS) {
+  if (LHS.FlagSetKey != RHS.FlagSetKey) return 0;
+  unsigned Shared = 0;
+  while (Shared < LHS.Includes.size() && Shared < RHS.Includes.size() &&
+         LHS.Includes[Shared] == RHS.Includes[Shared]) {
+    ++Shared;
+  }
+  const bool SameDir = sys::path::parent_path(LHS.Path) ==
+                       sys::path::parent_path(RHS.Path);
+  return 1 + Shared + (SameDir ? 1 : 0);
+}
+
+std::vector<std::string> SelectShard(const CompilationDatabase &Compilations,
+                                     const TUCostModel &Costs,
+                                     ArrayRef<std::string> SourcePaths,
+                                     unsigned Index,
+                                     unsigned Count) {
+  std::set<std::string> Paths;
+  for (auto SI = SourcePaths.begin(), SE = SourcePaths.end(); SI != SE; ++SI) {
+    Paths.insert(GetAbsolutePath(*SI));
+  }
+  const std::vector<std::string> Sorted(Paths.begin(), Paths.end());
+  const std::vector<double> Predicted = Costs.predict(Sorted);
+
+  std::vector<ShardFile> Files(Sorted.size());
+  for (size_t I = 0, E = Sorted.size(); I != E; ++I) {
+    ShardFile &File = Files[I];
+    File.Path = Sorted[I];
+    File.Cost = std::max(Predicted[I], MinFileCost);
+    std::vector<CompileCommand> Commands =
+        Compilations.getCompileCommands(File.Path);
+    if (!Commands.empty()) {
+      File.FlagSetKey = GetFlagSetKey(Commands.front(), File.Path);
+    }
+    std::string Contents;
+    if (ReadFileContents(File.Path, Contents)) {
+      File.Includes = GetLeadingIncludes(Contents);
+    }
+  }
+  std::sort(Files.begin(), Files.end());
+
+  // Cut the files into Count runs of about the same cost. Each cut is made
+  // within a quarter of a share of where the costs balance, between the
+  // two files there that have the least in common.
+  const size_t NumFiles = Files.size();
+  std::vector<double> CostBefore(NumFiles + 1);
+  for (size_t I = 0; I != NumFiles; ++I) {
+    CostBefore[I + 1] = CostBefore[I] + Files[I].Cost;
+  }
+  const double Share = CostBefore[NumFiles] / Count;
+  std::vector<size_t> Cuts(1, 0);
+  for (unsigned Shard = 1; Shard != Count; ++Shard) {
+    const double Target = Share * Shard;
+    const size_t Begin =
+        std::lower_bound(CostBefore.begin() + Cuts.back(), CostBefore.end(),
+                         Target - Share / 4) - CostBefore.begin();
+    size_t Best = Begin;
+    unsigned BestAffinity = ~0U;
+    double BestDistance = 0;
+    for (size_t Cut = Begin;
+         Cut <= NumFiles && CostBefore[Cut] <= Target + Share / 4; ++Cut) {
+      const unsigned Affinity = Cut == 0 || Cut == NumFiles
+                              ? 0
+                              : GetAffinity(Files[Cut - 1], Files[Cut]);
+      const double Distance = fabs(CostBefore[Cut] - Target);
+      if (Affinity < BestAffinity ||
+          (Affinity == BestAffinity && Distance < BestDistance)) {
+        Best = Cut;
+        BestAffinity = Affinity;
+        BestDistance = Distance;
+      }
+    }
+    // A file that's more than half a share can leave nowhere to cut within
+    // the quarter; then cut on whichever side of it is closer.
+    if (BestAffinity == ~0U) {
+      Best = std::min(Begin, NumFiles);
+      if (Best > Cuts.back() &&
+          Target - CostBefore[Best - 1] < CostBefore[Best] - Target) {
+        --Best;
+      }
+    }
+    Cuts.push_back(Best);
+  }
+  Cuts.push_back(NumFiles);
+
+  std::vector<std::string> Selected;
+  for (size_t I = Cuts[Index], E = Cuts[Index + 1]; I != E; ++I) {
+    Selected.push_back(Files[I].Path);
+  }
+  std::sort(Selected.begin(), Selected.end());
+  return Selected;
+}
+
+std::string GetDefaultShardPath(const std::string &DatabaseDir,
+                                unsigned Index,
+                                unsigned Count) {
+  return (DatabaseDir.empty() ? std::string(".") : DatabaseDir) +
+         "/cpp-tools-shard-" + utostr(Index) + "-of-" + utostr(Count) +
+         ".txt";
+}
+
+std::string GetShardCostPath(const std::string &CostPath,
+                             unsigned Index,
+                             unsigned Count) {
+  return CostPath + ".shard-" + utostr(Index) + "-of-" + utostr(Count);
+}
+
+bool WriteShardFile(const std::string &Path,
+                    unsigned Index,
+                    unsigned Count,
+                    const std::string &CostPath,
+                    const std::string &Replacements) {
+  std::string Contents;
+  raw_string_ostream Out(Contents);
+  Out << ShardHeader << " " << Index << " " << Count << "\n";
+  Out << "costs ";
+  WriteSizedString(Out, CostPath);
+  Out << "\n" << Replacements;
+  return WriteFileAtomically(Path, Out.str());
+}
+
+// Merges the costs each shard measured into the cost file the shards were
+// split by, and deletes the shards' own files.
+static void MergeShardCosts(
+    const std::map<std::string, std::vector<unsigned> > &ShardsByCostPath,
+    unsigned Count) {
+  for (auto CI = ShardsByCostPath.begin(), CE = ShardsByCostPath.end();
+       CI != CE; ++CI) {
+    TUCostModel Costs(CI->first);
+    std::vector<std::string> ShardCostPaths;
+    for (auto SI = CI->second.begin(), SE = CI->second.end(); SI != SE; ++SI) {
+      const std::string Path = GetShardCostPath(CI->first, *SI, Count);
+      // A shard that measured nothing didn't save anything.
+      if (Costs.addMeasurements(Path)) ShardCostPaths.push_back(Path);
+    }
+    if (!Costs.save()) {
+      errs() << "Couldn't merge the shards' costs into " << CI->first
+             << ".\n";
+      continue;
+    }
+    for (auto PI = ShardCostPaths.begin(), PE = ShardCostPaths.end();
+         PI != PE; ++PI) {
+      remove(PI->c_str());
+    }
+  }
+}
+
+bool MergeShards(const std::vector<std::string> &Paths,
+                 EditOutputMode Mode,
+                 raw_ostream &Out) {
+  if (Paths.empty()) {
+    errs() << "Error: no shard files given.\n";
+    return false;
+  }
+
+  // Merge in the order of the shards, not of the paths, so that the output
+  // doesn't depend on how the files were named.
+  std::map<unsigned, std::vector<FileEdits> > Shards;
+  std::map<std::string, std::vector<unsigned> > ShardsByCostPath;
+  unsigned Count = 0;
+  for (auto PI = Paths.begin(), PE = Paths.end(); PI != PE; ++PI) {
+    std::string Contents;
+    if (!ReadFileContents(*PI, Contents)) {
+      errs() << "Error: couldn't read " << *PI << ".\n";
+      return false;
+    }
+    std::istringstream In(Contents);
+    std::string Header;
+    unsigned Index = 0, ShardCount = 0;
+    if (!std::getline(In, Header)) {
+      errs() << "Error: " << *PI << " is empty.\n";
+      return false;
+    }
+    std::istringstream HeaderIn(Header);
+    std::string Magic, Version;
+    if (!(HeaderIn >> Magic >> Version >> Index >> ShardCount) ||
+        Magic + " " + Version != ShardHeader || Index >= ShardCount) {
+      errs() << "Error: " << *PI << " isn't the output of a shard.\n";
+      return false;
+    }
+    if (Count && ShardCount != Count) {
+      errs() << "Error: " << *PI << " is shard " << Index << " of "
+             << ShardCount << ", but the others are of " << Count << ".\n";
+      return false;
+    }
+    Count = ShardCount;
+    if (Shards.count(Index)) {
+      errs() << "Error: shard " << Index << " was given twice.\n";
+      return false;
+    }
+    std::string Tag, CostPath;
+    if (!(In >> Tag) || Tag != "costs" || In.get() != ' ' ||
+        !ReadSizedString(In, CostPath) || !ReadFileEdits(In, Shards[Index])) {
+      errs() << "Error: " << *PI << " is malformed.\n";
+      return false;
+    }
+    if (!CostPath.empty()) ShardsByCostPath[CostPath].push_back(Index);
+  }
+  for (unsigned Index = 0; Index != Count; ++Index) {
+    if (!Shards.count(Index)) {
+      errs() << "Error: shard " << Index << " of " << Count
+             << " is missing.\n";
+      return false;
+    }
+  }
+  MergeShardCosts(ShardsByCostPath, Count);
+
+  EditMerger Merger;
+  for (auto SI = Shards.begin(), SE = Shards.end(); SI != SE; ++SI) {
+    Merger.addEdits(SI->second);
+  }
+  return Merger.output(Mode, FileOverlay(), Out);
+}
@@ -0,0 +1,77 @@
+#ifndef CPP_TOOLS_COMMON_SHARDS_H
+#define CPP_TOOLS_COMMON_SHARDS_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "Edits.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace tooling {
+class CompilationDatabase;
+}
+}
+
+namespace llvm {
+class raw_ostream;
+}
+
+class TUCostModel;
+
+// Splitting a run into shards, e.g. to run it in several processes or on
+// several machines with a shared filesystem. Each shard runs its own part
+// of the translation units and writes its edits to a file, and a separate
+// merge step reads them all and outputs the merged edits.
+
+// Parses a shard given as "i/N", the i-th of N counting from 0. Returns
+// false if it's malformed.
+bool ParseShard(llvm::StringRef Spec, unsigned &Index, unsigned &Count);
+
+// Splits the source files into Count shards of about the same predicted
+// cost, and returns the files in shard Index, sorted. The files are
+// ordered by their flags and leading #includes, and each shard is a run of
+// them, cut where neighbours have the least in common within a quarter of
+// a share of the balance, so that each shard's shared preambles and file
+// cache are reused as much as they can be. The split only depends on the
+// compilation database, the files' #includes and the cost file, so every
+// shard agrees on it, whichever order the files were given in.
+std::vector<std::string> SelectShard(
+    const clang::tooling::CompilationDatabase &Compilations,
+    const TUCostModel &Costs,
+    llvm::ArrayRef<std::string> SourcePaths,
+    unsigned Index,
+    unsigned Count);
+
+// Returns where a shard writes its edits if it isn't told: next to the
+// compilation database, or in the current directory if there's none.
+std::string GetDefaultShardPath(const std::string &DatabaseDir,
+                                unsigned Index,
+                                unsigned Count);
+
+// Returns where a shard saves the costs it measured, for MergeShards() to
+// merge into CostPath. Shards don't save into CostPath themselves, so that
+// a shard that starts late is split by the same costs as the others.
+std::string GetShardCostPath(const std::string &CostPath,
+                             unsigned Index,
+                             unsigned Count);
+
+// Writes the edits a shard made, as output with OutputReplacements, to a
+// file for MergeShards(), along with the cost file the run was split by,
+// if any. The file is written in one go, so that a merge never reads half
+// of it. Returns false if it can't be written.
+bool WriteShardFile(const std::string &Path,
+                    unsigned Index,
+                    unsigned Count,
+                    const std::string &CostPath,
+                    const std::string &Replacements);
+
+// Reads the files written by every shard of a run, merges the costs the
+// shards measured into the run's cost file, merges their edits, and
+// outputs them as Mode asks for. Returns false if a file can't be read, a
+// shard is missing, or the edits can't be output.
+bool MergeShards(const std::vector<std::string> &Paths,
+                 EditOutputMode Mode,
+                 llvm::raw_ostream &Out);
+
+#endif
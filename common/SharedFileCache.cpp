@@ -0,0 +1,149 @@
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemStatCache.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "SharedFileCache.h"
+#include "SourceFiles.h"
+using namespace clang;
+using namespace llvm;
+
+namespace {
+  // Answers a FileManager's stat calls from the shared cache.
+  class SharedStatCache : public FileSystemStatCache {
+  public:
+    explicit SharedStatCache(SharedFileCache &Cache) : Cache(Cache) {}
+
+  protected:
+    virtual LookupResult getStat(const char *Path, struct stat &StatBuf,
+                                 int *FileDescriptor) {
+      // The file isn't opened even if FileDescriptor asks for it: the
+      // FileManager opens it itself if it needs the contents after all. A
+      // descriptor it never used would stay open as long as it does.
+      const bool Exists = Cache.getStat(Path, StatBuf, [&](struct stat &S) {
+        return ::stat(Path, &S) == 0;
+      });
+      return Exists ? CacheExists : CacheMissing;
+    }
+
+  private:
+    SharedFileCache &Cache;
+  };
+
+  // Hands the SourceManager the cached contents of each header before the
+  // preprocessor enters it.
+  class SharedContentsCallbacks : public PPCallbacks {
+  public:
+    SharedContentsCallbacks(SharedFileCache &Cache, CompilerInstance &CI)
+      : Cache(Cache)
+      , CI(CI)
+      {}
+
+    virtual void InclusionDirective(SourceLocation HashLoc,
+                                    const Token &IncludeTok,
+                                    StringRef FileName,
+                                    bool IsAngled,
+                                    CharSourceRange FilenameRange,
+                                    const FileEntry *File,
+                                    StringRef SearchPath,
+                                    StringRef RelativePath,
+                                    const Module *Imported) {
+      if (!File || Imported) return;
+      // A file that was entered before, e.g. from a precompiled header,
+      // may have its own buffer already, which mustn't be replaced.
+      Preprocessor &PP = CI.getPreprocessor();
+      if (PP.getHeaderSearchInfo().getFileInfo(File).NumIncludes) return;
+      if (!Overridden.insert(File)) return;
+
+      const MemoryBuffer *Buffer =
+          Cache.getBuffer(CI.getFileManager(), *File);
+      if (!Buffer || Buffer->getBufferSize() != (size_t)File->getSize()) {
+        return;
+      }
+      CI.getSourceManager().overrideFileContents(File, Buffer,
+                                                 /*DoNotFree*/true);
+    }
+
+  private:
+    SharedFileCache &Cache;
+    CompilerInstance &CI;
+    SmallPtrSet<const FileEntry *, 64> Overridden;
+  };
+
+  class SharedContentsAction : public WrapperFrontendAction {
+  public:
+    SharedContentsAction(FrontendAction *ToolAction, SharedFileCache &Cache)
+      : WrapperFrontendAction(ToolAction)
+      , Cache(Cache)
+      {}
+
+  protected:
+    virtual bool BeginSourceFileAction(CompilerInstance &CI,
+                                       StringRef Filename) {
+      if (!WrapperFrontendAction::BeginSourceFileAction(CI, Filename)) {
+        return false;
+      }
+      if (CI.hasPreprocessor()) {
+        CI.getPreprocessor().addPPCallbacks(
+            new SharedContentsCallbacks(Cache, CI));
+      }
+      return true;
+    }
+
+  private:
+    SharedFileCache &Cache;
+  };
+}
+
+SharedFileCache::~SharedFileCache() {}
+
+FileSystemStatCache *SharedFileCache::createStatCache() {
+  return new SharedStatCache(*this);
+}
+
+FrontendAction *SharedFileCache::wrapAction(FrontendAction *ToolAction) {
+  return new SharedContentsAction(ToolAction, *this);
+}
+
+bool SharedFileCache::getStat(
+    const std::string &Path,
+    struct stat &Status,
+    const std::function<bool(struct stat &)> &Stat) {
+  StatShard &Shard = StatShards[HashString(Path) % NumShards];
+  std::shared_ptr<CachedStat> Entry;
+  {
+    std::lock_guard<std::mutex> Guard(Shard.Lock);
+    std::shared_ptr<CachedStat> &Slot = Shard.Stats[Path];
+    if (!Slot) Slot = std::make_shared<CachedStat>();
+    Entry = Slot;
+  }
+  std::call_once(Entry->Once, [&] {
+    Entry->Exists = Stat(Entry->Status);
+  });
+  if (Entry->Exists) Status = Entry->Status;
+  return Entry->Exists;
+}
+
+const MemoryBuffer *SharedFileCache::getBuffer(const FileManager &FM,
+                                               const FileEntry &File) {
+  std::shared_ptr<CachedBuffer> Entry;
+  {
+    std::lock_guard<std::mutex> Guard(BufferLock);
+    std::shared_ptr<CachedBuffer> &Slot =
+        Buffers[std::make_pair(File.getDevice(), File.getInode())];
+    if (!Slot) Slot = std::make_shared<CachedBuffer>();
+    Entry = Slot;
+  }
+  std::call_once(Entry->Once, [&] {
+    // MemoryBuffer maps the file if it's large enough to be worth it.
+    const std::string Path = GetCanonicalFilePath(FM, File);
+    if (MemoryBuffer::getFile(Path, Entry->Buffer)) Entry->Buffer.reset();
+  });
+  return Entry->Buffer.get();
+}
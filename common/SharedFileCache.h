@@ -0,0 +1,86 @@
+#ifndef CPP_TOOLS_COMMON_SHARED_FILE_CACHE_H
+#define CPP_TOOLS_COMMON_SHARED_FILE_CACHE_H
+
+#include "llvm/ADT/OwningPtr.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unordered_map>
+#include <utility>
+
+namespace clang {
+class FileEntry;
+class FileManager;
+class FileSystemStatCache;
+class FrontendAction;
+}
+
+namespace llvm {
+class MemoryBuffer;
+}
+
+// The results of stat calls and the contents of the headers the
+// translation units of a run read, shared by all the workers, so that each
+// file is only looked up and read from disk once per run, however many
+// translation units include it. Files are assumed not to change during the
+// run, so the cache mustn't outlive it.
+//
+// Each worker's FileManager gets a stat cache that answers from here, and
+// each translation unit's headers are handed to its SourceManager from
+// here as buffers it doesn't own. Large files are memory-mapped.
+class SharedFileCache {
+public:
+  SharedFileCache() {}
+  ~SharedFileCache();
+
+  // Returns a stat cache to add to a worker's FileManager, which takes
+  // ownership of it.
+  clang::FileSystemStatCache *createStatCache();
+
+  // Wraps a tool's action so that its translation unit reads the headers it
+  // includes from the cache. Takes ownership of ToolAction.
+  clang::FrontendAction *wrapAction(clang::FrontendAction *ToolAction);
+
+  // Returns the contents of a file, reading it on the first call. The
+  // buffer belongs to the cache. Returns null if the file can't be read.
+  const llvm::MemoryBuffer *getBuffer(const clang::FileManager &FM,
+                                      const clang::FileEntry &File);
+
+  // Looks up a path, calling Stat for it on the first call. Returns whether
+  // the path exists.
+  bool getStat(const std::string &Path,
+               struct stat &Status,
+               const std::function<bool(struct stat &)> &Stat);
+
+private:
+  struct CachedStat {
+    std::once_flag Once;
+    bool Exists;
+    struct stat Status;
+  };
+  struct CachedBuffer {
+    std::once_flag Once;
+    llvm::OwningPtr<llvm::MemoryBuffer> Buffer;
+  };
+
+  // Stats are far more frequent than reads, so they're split into shards
+  // with their own locks. The locks are only held to find an entry: the
+  // stat or read itself happens outside them, once per entry.
+  enum { NumShards = 16 };
+  struct StatShard {
+    std::mutex Lock;
+    std::unordered_map<std::string, std::shared_ptr<CachedStat> > Stats;
+  };
+  StatShard StatShards[NumShards];
+
+  std::mutex BufferLock;
+  // Keyed by device and inode, so that different paths to the same file
+  // share a buffer.
+  std::map<std::pair<dev_t, ino_t>, std::shared_ptr<CachedBuffer> > Buffers;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "clang/AST/ASTConsumer.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Serialization/ASTWriter.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "CompileCommands.h"
+#include "SharedPreamble.h"
+#include <limits.h>
+#include <stdlib.h>
+using namespace clang;
+using namespace clang::tooling;
+using namespace llvm;
+
+// Returns the directive if the line is an #include of a header named in
+// quotes or angle brackets, or an empty string otherwise.
+static std::string GetIncludeDirective(StringRef Line) {
+  Line = Line.trim();
+  if (!Line.startswith("#")) return std::string();
+  Line = Line.drop_front().ltrim();
+  if (!Line.startswith("include")) return std::string();
+  Line = Line.drop_front(strlen("include")).ltrim();
+  if (Line.empty()) return std::string();
+
+  const char Close = Line[0] == '<' ? '>' : Line[0] == '"' ? '"' : 0;
+  if (!Close) return std::string();
+  size_t End = Line.find(Close, 1);
+  if (End == StringRef::npos) return std::string();
+  // Anything after the header name must be a comment.
+  StringRef Rest = Line.substr(End + 1).ltrim();
+  if (!Rest.empty() && !Rest.startswith("//") && !Rest.startswith("/*")) {
+    return std::string();
+  }
+  return "#include " + Line.substr(0, End + 1).str();
+}
+
+std::vector<std::string> GetLeadingIncludes(StringRef Contents) {
+  std::vector<std::string> Includes;
+  bool InBlockComment = false;
+  while (!Contents.empty()) {
+    std::pair<StringRef, StringRef> Split = Contents.split('\n');
+    StringRef Line = Split.first.trim();
+    Contents = Split.second;
+
+    if (InBlockComment) {
+      size_t End = Line.find("*/");
+      if (End == StringRef::npos) continue;
+      InBlockComment = false;
+      Line = Line.substr(End + 2).trim();
+    }
+    if (Line.empty() || Line.startswith("//")) continue;
+    if (Line.startswith("/*")) {
+      size_t End = Line.find("*/", 2);
+      if (End == StringRef::npos) {
+        InBlockComment = true;
+        continue;
+      }
+      Line = Line.substr(End + 2).trim();
+      if (Line.empty()) continue;
+    }
+
+    std::string Directive = GetIncludeDirective(Line);
+    if (Directive.empty()) break;
+    Includes.push_back(Directive);
+  }
+  return Includes;
+}
+
+namespace {
+  // Builds a precompiled header while also running the tool's action over
+  // the same parse.
+  class BuildPreambleAction : public WrapperFrontendAction {
+  public:
+    BuildPreambleAction(FrontendAction *ToolAction, StringRef PCHPath)
+      : WrapperFrontendAction(ToolAction)
+      , PCHPath(PCHPath)
+      {}
+
+  protected:
+    virtual ASTConsumer *CreateASTConsumer(CompilerInstance &CI,
+                                           StringRef InFile) {
+      // The driver drops -o from a syntax-only job, which would leave the
+      // precompiled header to be written to stdout.
+      CI.getFrontendOpts().OutputFile = PCHPath;
+      std::string Sysroot, OutputFile;
+      raw_ostream *OS = 0;
+      if (GeneratePCHAction::ComputeASTConsumerArguments(CI, InFile, Sysroot,
+                                                         OutputFile, OS)) {
+        return 0;
+      }
+      if (!CI.getFrontendOpts().RelocatablePCH) Sysroot.clear();
+
+      ASTConsumer *ToolConsumer =
+          WrapperFrontendAction::CreateASTConsumer(CI, InFile);
+      if (!ToolConsumer) return 0;
+
+      // The precompiled header needs every function body, even the ones
+      // the tool would rather skip.
+      CI.getFrontendOpts().SkipFunctionBodies = false;
+
+      std::vector<ASTConsumer*> Consumers;
+      Consumers.push_back(ToolConsumer);
+      Consumers.push_back(new PCHGenerator(CI.getPreprocessor(), OutputFile,
+                                           /*Module*/0, Sysroot, OS));
+      return new MultiplexConsumer(Consumers);
+    }
+
+    virtual TranslationUnitKind getTranslationUnitKind() {
+      return TU_Prefix;
+    }
+
+  private:
+    const std::string PCHPath;
+  };
+}
+
+// Returns the language to parse the preamble's header as, going by the
+// extension of the translation unit it came from.
+static const char *GetHeaderLanguage(StringRef MainFile) {
+  StringRef Extension = sys::path::extension(MainFile);
+  if (Extension == ".c") return "c-header";
+  if (Extension == ".m") return "objective-c-header";
+  if (Extension == ".mm") return "objective-c++-header";
+  return "c++-header";
+}
+
+bool BuildSharedPreamble(SharedPreamble &Preamble,
+                         FrontendAction *ToolAction,
+                         FileManager &Files) {
+  OwningPtr<FrontendAction> ScopedToolAction(ToolAction);
+  {
+    std::string ErrorInfo;
+    raw_fd_ostream OS(Preamble.HeaderPath.c_str(), ErrorInfo);
+    if (!ErrorInfo.empty()) return false;
+    for (auto II = Preamble.Includes.begin(), IE = Preamble.Includes.end();
+         II != IE; ++II) {
+      OS << *II << "\n";
+    }
+  }
+
+  // Quoted includes are looked up next to the file that includes them, so
+  // look next to the translation unit's main file before anywhere else.
+  const std::vector<std::string> &Original = Preamble.Command.CommandLine;
+  std::vector<std::string> CommandLine;
+  CommandLine.push_back(Original[0]);
+  CommandLine.push_back("-iquote");
+  CommandLine.push_back(sys::path::parent_path(Preamble.MainFile));
+  std::vector<std::string> Args =
+      GetSemanticArguments(Preamble.Command, Preamble.MainFile);
+  CommandLine.insert(CommandLine.end(), Args.begin(), Args.end());
+  CommandLine.push_back("-fsyntax-only");
+  CommandLine.push_back("-working-directory=" + Preamble.Command.Directory);
+  CommandLine.push_back("-x");
+  CommandLine.push_back(GetHeaderLanguage(Preamble.MainFile));
+  CommandLine.push_back(Preamble.HeaderPath);
+
+  ToolInvocation Invocation(
+      CommandLine,
+      new BuildPreambleAction(ScopedToolAction.take(), Preamble.PCHPath),
+      &Files);
+  if (!Invocation.run()) return false;
+
+  // The generated header is gone after this run, so it mustn't count as
+  // something the translation units depend on.
+  char Resolved[PATH_MAX];
+  if (realpath(Preamble.HeaderPath.c_str(), Resolved)) {
+    std::vector<FileDependency> &Deps = Preamble.Result.Dependencies;
+    std::vector<FileDependency> Kept;
+    for (auto DI = Deps.begin(), DE = Deps.end(); DI != DE; ++DI) {
+      if (DI->FilePath != Resolved) Kept.push_back(*DI);
+    }
+    Deps.swap(Kept);
+  }
+
+  Preamble.Built = true;
+  Preamble.Result.Succeeded = true;
+  return true;
+}
@@ -0,0 +1,52 @@
+#ifndef CPP_TOOLS_COMMON_SHARED_PREAMBLE_H
+#define CPP_TOOLS_COMMON_SHARED_PREAMBLE_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringRef.h"
+#include "ParallelTool.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+class FileManager;
+class FrontendAction;
+}
+
+// Returns the #include directives that a source file starts with, before
+// any other code. Blank lines and comments in between are skipped.
+std::vector<std::string> GetLeadingIncludes(llvm::StringRef Contents);
+
+// A precompiled header made from the #includes that a group of translation
+// units, all compiled with the same flags, start with. Each of those
+// translation units can then load the headers from it instead of parsing
+// them again.
+//
+// The tool's own action runs while the preamble is parsed, so the headers
+// in it are processed once for the whole group. Translation units that
+// use the preamble take on its edits and dependencies.
+struct SharedPreamble {
+  SharedPreamble() : Built(false) {}
+
+  // The directives the preamble is made of.
+  std::vector<std::string> Includes;
+  // The compile command and input file of one translation unit in the
+  // group. The preamble is built with the same flags.
+  clang::tooling::CompileCommand Command;
+  std::string MainFile;
+  // Where the generated header and the precompiled header go.
+  std::string HeaderPath;
+  std::string PCHPath;
+
+  bool Built;
+  // What the tool's action produced while parsing the preamble.
+  TUResult Result;
+};
+
+// Writes out the preamble's header, and builds the precompiled header from
+// it, running ToolAction at the same time. Takes ownership of ToolAction.
+// Returns whether the preamble can be used.
+bool BuildSharedPreamble(SharedPreamble &Preamble,
+                         clang::FrontendAction *ToolAction,
+                         clang::FileManager &Files);
+
+#endif
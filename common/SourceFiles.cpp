@@ -0,0 +1,85 @@
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "Edits.h"
+#include "SourceFiles.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+using namespace clang;
+using namespace llvm;
+
+std::string GetAbsolutePath(StringRef Path) {
+  SmallString<256> AbsolutePath(Path);
+  if (sys::fs::make_absolute(AbsolutePath)) {
+    return Path;
+  }
+  return AbsolutePath.str();
+}
+
+static std::string ResolvePath(const std::string &Path) {
+  char Resolved[PATH_MAX];
+  if (realpath(Path.c_str(), Resolved)) {
+    return Resolved;
+  }
+  return Path;
+}
+
+std::string GetRealPath(StringRef Path) {
+  return ResolvePath(GetAbsolutePath(Path));
+}
+
+bool StatFile(const std::string &Path, int64_t &MTime, uint64_t &Size) {
+  struct stat Status;
+  if (stat(Path.c_str(), &Status) != 0) return false;
+#if defined(__APPLE__)
+  const struct timespec &Time = Status.st_mtimespec;
+#else
+  const struct timespec &Time = Status.st_mtim;
+#endif
+  MTime = (int64_t)Time.tv_sec * 1000000000 + Time.tv_nsec;
+  Size = Status.st_size;
+  return true;
+}
+
+std::string GetCanonicalFilePath(const FileManager &FM,
+                                 const FileEntry &Entry) {
+  // Relative names are relative to the compile command's directory, which
+  // the file manager knows about, not to the current directory.
+  SmallString<256> Path(Entry.getName());
+  if (!sys::path::is_absolute(Path.str())) {
+    const std::string &WorkingDir = FM.getFileSystemOptions().WorkingDir;
+    if (!WorkingDir.empty()) {
+      SmallString<256> Joined(WorkingDir);
+      sys::path::append(Joined, Path.str());
+      Path = Joined;
+    } else {
+      sys::fs::make_absolute(Path);
+    }
+  }
+  return ResolvePath(Path.str());
+}
+
+std::string GetCanonicalFilePath(const SourceManager &SM, FileID FID) {
+  const FileEntry *Entry = SM.getFileEntryForID(FID);
+  if (!Entry) return std::string();
+  return GetCanonicalFilePath(SM.getFileManager(), *Entry);
+}
+
+void CollectDependencies(const SourceManager &SM,
+                         std::vector<FileDependency> &Deps) {
+  for (auto FI = SM.fileinfo_begin(), FE = SM.fileinfo_end();
+       FI != FE; ++FI) {
+    const FileEntry *Entry = FI->first;
+    const MemoryBuffer *Buffer = FI->second->getRawBuffer();
+    // Files that were looked up but never read don't affect the output.
+    if (!Entry || !Buffer) continue;
+
+    Deps.push_back(FileDependency(
+        GetCanonicalFilePath(SM.getFileManager(), *Entry),
+        HashFileContents(Buffer->getBufferStart(), Buffer->getBufferSize())));
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef CPP_TOOLS_COMMON_SOURCE_FILES_H
+#define CPP_TOOLS_COMMON_SOURCE_FILES_H
+
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/StringRef.h"
+#include "Edits.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace clang {
+class FileEntry;
+class FileManager;
+class SourceManager;
+}
+
+// Makes a path absolute relative to the current directory.
+std::string GetAbsolutePath(llvm::StringRef Path);
+
+// Makes a path absolute relative to the current directory, and resolves its
+// symlinks, "." and "..", so that every way of naming a file gives the same
+// path. Returns the absolute path if the file doesn't exist.
+std::string GetRealPath(llvm::StringRef Path);
+
+// Gets a file's modification time, in nanoseconds, and its size. Returns
+// false if the file doesn't exist.
+bool StatFile(const std::string &Path, int64_t &MTime, uint64_t &Size);
+
+// Returns the absolute, symlink-free path of a file, so that the same file
+// has the same name in every translation unit.
+std::string GetCanonicalFilePath(const clang::FileManager &FM,
+                                 const clang::FileEntry &Entry);
+std::string GetCanonicalFilePath(const clang::SourceManager &SM,
+                                 clang::FileID FID);
+
+// Appends every file the source manager has read, i.e. the main file and
+// everything it includes, to Deps.
+void CollectDependencies(const clang::SourceManager &SM,
+                         std::vector<FileDependency> &Deps);
+
+#endif
@@ -0,0 +1,95 @@
+#include "clang/AST/DeclBase.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "SourceFiles.h"
+#include "SourceFilter.h"
+#include <limits.h>
+#include <stdlib.h>
+using namespace clang;
+using namespace llvm;
+
+void ValidateSourceFilterOptions(const SourceFilterOptions &Opts) {
+  if (!Opts.HeaderRegex.empty()) {
+    std::string Error;
+    if (!Regex(Opts.HeaderRegex).isValid(Error)) {
+      report_fatal_error("Invalid header filter \"" + Opts.HeaderRegex
+                         + "\": " + Error);
+    }
+  }
+
+  if (!Opts.RootDir.empty()) {
+    bool IsDirectory = false;
+    if (sys::fs::is_directory(Opts.RootDir, IsDirectory) || !IsDirectory) {
+      report_fatal_error("Root \"" + Opts.RootDir + "\" is not a directory.");
+    }
+  }
+}
+
+// Returns the canonical form of a directory, ending in a separator, so that
+// it can be compared against the canonical paths of files in it.
+static std::string GetCanonicalDirPrefix(StringRef Dir) {
+  SmallString<256> Path(Dir);
+  sys::fs::make_absolute(Path);
+
+  std::string Result = Path.str();
+  char Resolved[PATH_MAX];
+  if (realpath(Path.c_str(), Resolved)) {
+    Result = Resolved;
+  }
+  if (Result.empty() || Result[Result.size()-1] != '/') {
+    Result += '/';
+  }
+  return Result;
+}
+
+SourceFilter::SourceFilter(const SourceManager &SM,
+                           const SourceFilterOptions &Opts)
+  : SM(SM)
+  , Enabled(Opts.isEnabled()) {
+  if (!Opts.HeaderRegex.empty()) {
+    HeaderRegex.reset(new Regex(Opts.HeaderRegex));
+  }
+  if (!Opts.RootDir.empty()) {
+    RootDir = GetCanonicalDirPrefix(Opts.RootDir);
+  }
+}
+
+bool SourceFilter::isInteresting(SourceLocation Loc) {
+  if (!Enabled) return true;
+  if (Loc.isInvalid()) return false;
+
+  // Code that comes from a macro belongs to wherever the macro was
+  // expanded.
+  return isInterestingFile(SM.getFileID(SM.getExpansionLoc(Loc)));
+}
+
+bool SourceFilter::isInteresting(const Decl *D) {
+  return isInteresting(D->getLocation());
+}
+
+bool SourceFilter::isInterestingFile(FileID FID) {
+  auto Found = FileCache.find(FID);
+  if (Found != FileCache.end()) return Found->second;
+
+  bool Interesting = false;
+  if (FID == SM.getMainFileID()) {
+    Interesting = true;
+  } else if (SM.isInSystemHeader(SM.getLocForStartOfFile(FID))) {
+    Interesting = false;
+  } else {
+    std::string Path = GetCanonicalFilePath(SM, FID);
+    if (!Path.empty()) {
+      if (HeaderRegex && HeaderRegex->match(Path)) {
+        Interesting = true;
+      }
+      if (!RootDir.empty() && StringRef(Path).startswith(RootDir)) {
+        Interesting = true;
+      }
+    }
+  }
+
+  FileCache[FID] = Interesting;
+  return Interesting;
+}
@@ -0,0 +1,57 @@
+#ifndef CPP_TOOLS_COMMON_SOURCE_FILTER_H
+#define CPP_TOOLS_COMMON_SOURCE_FILTER_H
+
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Regex.h"
+#include <string>
+
+namespace clang {
+class Decl;
+class SourceManager;
+}
+
+// Which headers the tools should look at, besides the main file.
+struct SourceFilterOptions {
+  // Headers whose paths match this regular expression are processed.
+  std::string HeaderRegex;
+  // Headers inside this directory are processed.
+  std::string RootDir;
+
+  // Whether any filtering was asked for. Without it, everything is
+  // processed.
+  bool isEnabled() const { return !HeaderRegex.empty() || !RootDir.empty(); }
+};
+
+// Checks the options, and reports a fatal error if they're invalid.
+void ValidateSourceFilterOptions(const SourceFilterOptions &Opts);
+
+// Decides whether code at a given location is code that we own, so that
+// decls outside of it can be skipped before they're traversed, and their
+// function bodies skipped before they're parsed. The main file always
+// passes the filter, and system headers never do.
+class SourceFilter {
+public:
+  SourceFilter(const clang::SourceManager &SM,
+               const SourceFilterOptions &Opts);
+
+  bool isEnabled() const { return Enabled; }
+
+  bool isInteresting(clang::SourceLocation Loc);
+  bool isInteresting(const clang::Decl *D);
+
+private:
+  const clang::SourceManager &SM;
+  const bool Enabled;
+  llvm::OwningPtr<llvm::Regex> HeaderRegex;
+  std::string RootDir;
+
+  // Every decl in a file gets the same answer, so only work it out once.
+  llvm::DenseMap<clang::FileID, bool> FileCache;
+
+  bool isInterestingFile(clang::FileID FID);
+};
+
+#endif
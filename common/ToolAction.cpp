@@ -0,0 +1,40 @@
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendOptions.h"
+#include "SourceFiles.h"
+#include "ToolAction.h"
+using namespace clang;
+using namespace llvm;
+
+RecordingFrontendAction::RecordingFrontendAction(
+    const TUContext &Context,
+    const SourceFilterOptions &FilterOpts)
+  : Context(Context)
+  , FilterOpts(FilterOpts)
+  {}
+
+RecordingFrontendAction::~RecordingFrontendAction() {
+  if (Recorder) Recorder->takeEdits(Context.Result->Edits);
+}
+
+ASTConsumer *RecordingFrontendAction::CreateASTConsumer(
+    CompilerInstance &Compiler, StringRef InFile) {
+  // The AST context has the options the code was parsed with, even when
+  // the AST was loaded from the AST cache.
+  Recorder.reset(new EditRecorder(Compiler.getSourceManager(),
+                                  Compiler.getASTContext().getLangOpts()));
+
+  // With a filter, most function bodies in headers are never looked at,
+  // so let the parser skip them.
+  if (FilterOpts.isEnabled()) {
+    Compiler.getFrontendOpts().SkipFunctionBodies = true;
+  }
+
+  return createConsumer(Compiler, *Recorder);
+}
+
+void RecordingFrontendAction::EndSourceFileAction() {
+  if (Context.CollectDependencies) {
+    CollectDependencies(getCompilerInstance().getSourceManager(),
+                        Context.Result->Dependencies);
+  }
+}
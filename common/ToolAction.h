@@ -0,0 +1,120 @@
+#ifndef CPP_TOOLS_COMMON_TOOL_ACTION_H
+#define CPP_TOOLS_COMMON_TOOL_ACTION_H
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/DeclGroup.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringRef.h"
+#include "EditRecorder.h"
+#include "ParallelTool.h"
+#include "ProcessedDecls.h"
+#include "SourceFilter.h"
+#include "Trace.h"
+#include "TraversalStats.h"
+#include <utility>
+
+namespace clang {
+class CompilerInstance;
+}
+
+// Runs an AST visitor on the top-level declarations that pass the source
+// filter and that no other translation unit has processed yet. The visitor
+// is constructed from the extra constructor arguments. Name is what the
+// visitor is called in the traversal stats.
+template <typename VisitorT>
+class FilteredASTConsumer : public clang::ASTConsumer {
+public:
+  template <typename... ArgsT>
+  FilteredASTConsumer(llvm::StringRef Name,
+                      const clang::SourceManager &SM,
+                      const SourceFilterOptions &FilterOpts,
+                      ProcessedDeclSet *ProcessedDecls,
+                      ArgsT&&... VisitorArgs)
+    : Visitor(std::forward<ArgsT>(VisitorArgs)...)
+    , SM(SM)
+    , Filter(SM, FilterOpts)
+    , Tracker(SM, ProcessedDecls)
+  {
+    if (GetTraversalStats()) {
+      Instrumented.reset(
+          new InstrumentedASTVisitor<VisitorT>(Name, SM, Visitor));
+    }
+  }
+
+  virtual bool HandleTopLevelDecl(clang::DeclGroupRef DR) {
+    TraceTimer::Scope Timing(TraversalTimer);
+    for (auto DB = DR.begin(), DE = DR.end(); DB != DE; ++DB) {
+      // Don't bother with code we don't own, like the standard library.
+      if (!Filter.isInteresting(*DB)) continue;
+      // Headers only need to be processed by one translation unit.
+      if (!Tracker.shouldProcess(*DB)) continue;
+
+      // Traverse the declaration using our AST visitor.
+      if (Instrumented) {
+        Instrumented->TraverseDecl(*DB);
+      } else {
+        Visitor.TraverseDecl(*DB);
+      }
+    }
+    return true;
+  }
+
+  // Only called when function bodies may be skipped, i.e. when there's a
+  // filter. Bodies we'd never visit don't need to be parsed.
+  virtual bool shouldSkipFunctionBody(clang::Decl *D) {
+    return !Filter.isInteresting(D);
+  }
+
+  // Traversal is interleaved with parsing, so it's timed separately.
+  virtual void HandleTranslationUnit(clang::ASTContext &Context) {
+    const clang::FileEntry *MainFile =
+        SM.getFileEntryForID(SM.getMainFileID());
+    TraversalTimer.report("traverse", MainFile ? MainFile->getName() : "");
+    // Adds what was counted to the traversal stats.
+    Instrumented.reset();
+  }
+
+private:
+  VisitorT Visitor;
+  const clang::SourceManager &SM;
+  SourceFilter Filter;
+  ProcessedDeclTracker Tracker;
+  TraceTimer TraversalTimer;
+  OwningPtr<InstrumentedASTVisitor<VisitorT> > Instrumented;
+};
+
+// Frontend action that records the edits of one translation unit and hands
+// them over to be merged with the others at the end of the run. Tools
+// derive from it and create their AST consumer in createConsumer().
+class RecordingFrontendAction : public clang::ASTFrontendAction {
+public:
+  RecordingFrontendAction(const TUContext &Context,
+                          const SourceFilterOptions &FilterOpts);
+
+  // Upon destruction, hand the recorded edits over to be merged with the
+  // other translation units and written to disk at the end of the run.
+  virtual ~RecordingFrontendAction();
+
+  virtual clang::ASTConsumer *CreateASTConsumer(
+    clang::CompilerInstance &Compiler, llvm::StringRef InFile);
+
+  // Records every file that was read, for the incremental cache.
+  virtual void EndSourceFileAction();
+
+protected:
+  // Creates the consumer that makes this action's edits with Recorder.
+  virtual clang::ASTConsumer *createConsumer(
+    clang::CompilerInstance &Compiler, EditRecorder &Recorder) = 0;
+
+  const TUContext &getContext() const { return Context; }
+  const SourceFilterOptions &getFilterOptions() const { return FilterOpts; }
+
+private:
+  OwningPtr<EditRecorder> Recorder;
+  const TUContext Context;
+  const SourceFilterOptions FilterOpts;
+};
+
+#endif
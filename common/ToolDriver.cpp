@@ -0,0 +1,383 @@
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+#include "ASTCache.h"
+#include "CompileCommands.h"
+#include "CostModel.h"
+#include "EditRecorder.h"
+#include "FileOverlay.h"
+#include "IncrementalCache.h"
+#include "ParallelTool.h"
+#include "RefactoringServer.h"
+#include "Shards.h"
+#include "ToolAction.h"
+#include "ToolDriver.h"
+#include "Trace.h"
+#include "TraversalStats.h"
+#include <string>
+#include <vector>
+using namespace clang;
+using namespace clang::tooling;
+using namespace llvm;
+
+namespace {
+  // The options every tool run by RunTool() has. They're registered when
+  // it's constructed rather than at startup, so that linking this file
+  // into a tool with options of the same names, like extract-method, is
+  // harmless.
+  struct ToolOptions {
+    ToolOptions();
+
+    SourceFilterOptions getSourceFilterOptions() const {
+      SourceFilterOptions Opts;
+      Opts.HeaderRegex = HeaderFilter;
+      Opts.RootDir = RootDir;
+      return Opts;
+    }
+
+    cl::opt<std::string> BuildPath;
+    cl::list<std::string> SourcePaths;
+    cl::opt<unsigned> NumThreads;
+    cl::opt<std::string> HeaderFilter;
+    cl::opt<std::string> RootDir;
+    cl::opt<bool> SharedPreambles;
+    cl::opt<bool> Isolate;
+    cl::opt<double> Timeout;
+    cl::opt<unsigned> MemoryLimit;
+    cl::opt<std::string> CostFile;
+    cl::opt<std::string> CacheDir;
+    cl::opt<std::string> ASTCacheDir;
+    cl::opt<unsigned> ASTCacheSize;
+    cl::opt<std::string> TraceFile;
+    cl::opt<bool> PrintStats;
+    cl::opt<std::string> TraversalStatsPath;
+    cl::opt<std::string> ServerSocket;
+    cl::opt<EditOutputMode> OutputMode;
+    cl::opt<std::string> UnsavedFiles;
+    cl::opt<std::string> Shard;
+    cl::opt<std::string> ShardOutput;
+    cl::opt<bool> MergeShardFiles;
+  };
+}
+
+ToolOptions::ToolOptions()
+  : BuildPath(
+      "p",
+      cl::value_desc("build-path"),
+      cl::desc("Build path for the compilation database"),
+      cl::Optional)
+  , SourcePaths(
+      cl::Positional,
+      cl::desc("<source0> [... <sourceN>]"),
+      cl::ZeroOrMore)
+  , NumThreads(
+      "j",
+      cl::desc("Number of translation units to process in parallel"),
+      cl::init(1))
+  , HeaderFilter(
+      "header-filter",
+      cl::value_desc("regex"),
+      cl::desc("Only process headers whose paths match this regex"),
+      cl::init(""))
+  , RootDir(
+      "root",
+      cl::value_desc("dir"),
+      cl::desc("Only process headers inside this directory"),
+      cl::init(""))
+  , SharedPreambles(
+      "preamble",
+      cl::desc("Precompile the #includes shared by translation units with "
+               "the same flags once, instead of parsing them for each one"))
+  , Isolate(
+      "isolate",
+      cl::desc("Run the translation units in -j forked worker processes, so "
+               "that one that crashes only fails itself"))
+  , Timeout(
+      "timeout",
+      cl::value_desc("seconds"),
+      cl::desc("Cancel any translation unit that takes longer than this, "
+               "and report it along with the slowest ones"),
+      cl::init(0))
+  , MemoryLimit(
+      "memory-limit",
+      cl::value_desc("MB"),
+      cl::desc("Cancel any translation unit whose worker process uses more "
+               "memory than this"),
+      cl::init(0))
+  , CostFile(
+      "cost-file",
+      cl::value_desc("file"),
+      cl::desc("Where to keep how long each translation unit took, so that "
+               "the slowest can be started first (default: "
+               "cpp-tools-costs.txt next to the compilation database)"),
+      cl::init(""))
+  , CacheDir(
+      "cache-dir",
+      cl::value_desc("dir"),
+      cl::desc("Directory for caching results between runs, so that "
+               "unchanged translation units aren't parsed again"),
+      cl::init(""))
+  , ASTCacheDir(
+      "ast-cache-dir",
+      cl::value_desc("dir"),
+      cl::desc("Directory for keeping the parsed ASTs between runs, so that "
+               "later runs over unchanged files, by any of the tools, load "
+               "them instead of parsing"),
+      cl::init(""))
+  , ASTCacheSize(
+      "ast-cache-size",
+      cl::value_desc("MB"),
+      cl::desc("How large the AST cache may grow before the least recently "
+               "used ASTs are deleted"),
+      cl::init(2048))
+  , TraceFile(
+      "trace",
+      cl::value_desc("file"),
+      cl::desc("Write a Chrome trace of how long each phase of each "
+               "translation unit took"),
+      cl::init(""))
+  , PrintStats(
+      "stats",
+      cl::desc("Print the median, 95th percentile and maximum time of each "
+               "phase"))
+  , TraversalStatsPath(
+      "traversal-stats",
+      cl::value_desc("file"),
+      cl::desc("Count the AST nodes each visitor sees by kind and file, and "
+               "write them as JSON to this file, or print them if it's -"),
+      cl::init(""))
+  , ServerSocket(
+      "server",
+      cl::value_desc("socket"),
+      cl::desc("Serve requests on this Unix socket instead, keeping the "
+               "parsed files around between requests"),
+      cl::init(""))
+  , OutputMode(
+      "output",
+      cl::desc("What to do with the edits"),
+      cl::values(
+        clEnumValN(OutputInPlace, "inplace",
+                   "Write the changed files (default)"),
+        clEnumValN(OutputDiff, "diff",
+                   "Print a unified diff, and leave the files alone"),
+        clEnumValN(OutputReplacements, "replacements",
+                   "Print the edits as replacement records, and leave the "
+                   "files alone"),
+        clEnumValEnd),
+      cl::init(OutputInPlace))
+  , UnsavedFiles(
+      "unsaved",
+      cl::value_desc("file"),
+      cl::desc("Read the unsaved contents of files from this file, or from "
+               "stdin if it's -, and parse them instead of what's on disk"),
+      cl::init(""))
+  , Shard(
+      "shard",
+      cl::value_desc("i/N"),
+      cl::desc("Only run the i-th of N shards of the translation units, "
+               "counting from 0, and write its edits to -shard-output for "
+               "-merge-shards"),
+      cl::init(""))
+  , ShardOutput(
+      "shard-output",
+      cl::value_desc("file"),
+      cl::desc("Where a shard writes its edits (default: "
+               "cpp-tools-shard-i-of-N.txt next to the compilation "
+               "database)"),
+      cl::init(""))
+  , MergeShardFiles(
+      "merge-shards",
+      cl::desc("Merge the edits in the shard files given instead of source "
+               "files, and output them as -output says"))
+  {}
+
+namespace {
+  // Frontend action that makes a tool's edits and records them.
+  class DefinedToolAction : public RecordingFrontendAction {
+  public:
+    DefinedToolAction(const TUContext &Context,
+                      const SourceFilterOptions &FilterOpts,
+                      const ToolDefinition &Tool)
+      : RecordingFrontendAction(Context, FilterOpts)
+      , Tool(Tool)
+      {}
+
+  protected:
+    virtual ASTConsumer *createConsumer(CompilerInstance &Compiler,
+                                        EditRecorder &Recorder) {
+      return Tool.createConsumer(Compiler.getSourceManager(),
+                                 getFilterOptions(),
+                                 getContext().ProcessedDecls,
+                                 Recorder);
+    }
+
+  private:
+    const ToolDefinition &Tool;
+  };
+
+  class DefinedToolActionFactory : public TUActionFactory {
+  public:
+    DefinedToolActionFactory(const SourceFilterOptions &FilterOpts,
+                             const ToolDefinition &Tool)
+      : FilterOpts(FilterOpts)
+      , Tool(Tool)
+      {}
+
+    virtual FrontendAction *create(const TUContext &Context) {
+      return new DefinedToolAction(Context, FilterOpts, Tool);
+    }
+
+  private:
+    const SourceFilterOptions FilterOpts;
+    const ToolDefinition &Tool;
+  };
+
+  // Makes a tool's edits in the file of each request.
+  class DefinedToolRequestHandler : public ConsumerRequestHandler {
+  public:
+    DefinedToolRequestHandler(const SourceFilterOptions &FilterOpts,
+                              const ToolDefinition &Tool)
+      : FilterOpts(FilterOpts)
+      , Tool(Tool)
+      {}
+
+  protected:
+    virtual ASTConsumer *createConsumer(const SourceManager &SM,
+                                        EditRecorder &Recorder) {
+      return Tool.createConsumer(SM, FilterOpts, /*ProcessedDecls*/0,
+                                 Recorder);
+    }
+
+  private:
+    const SourceFilterOptions FilterOpts;
+    const ToolDefinition &Tool;
+  };
+}
+
+int RunTool(int argc, char **argv, const char *Name,
+            ToolDefinition &Tool) {
+  ToolOptions Options;
+
+  // Try to create a fixed compile command database.
+  OwningPtr<CompilationDatabase> Compilations(
+      FixedCompilationDatabase::loadFromCommandLine(
+        argc, const_cast<const char**>(argv)));
+
+  // Next, use normal llvm command line parsing to get the tool specific
+  // parameters.
+  cl::ParseCommandLineOptions(argc, argv);
+  const SourceFilterOptions FilterOpts = Options.getSourceFilterOptions();
+  ValidateSourceFilterOptions(FilterOpts);
+  Tool.validateOptions();
+  const std::vector<std::string> SourcePaths(Options.SourcePaths.begin(),
+                                             Options.SourcePaths.end());
+  if (Options.MergeShardFiles) {
+    return MergeShards(SourcePaths, Options.OutputMode, outs()) ? 0 : 1;
+  }
+  unsigned ShardIndex = 0, ShardCount = 0;
+  if (!Options.Shard.empty() &&
+      !ParseShard(Options.Shard, ShardIndex, ShardCount)) {
+    llvm::report_fatal_error("-shard must be i/N, with i less than N.");
+  }
+  if (SourcePaths.empty() && Options.ServerSocket.empty()) {
+    llvm::report_fatal_error("No source files given.");
+  }
+
+  FileOverlay Overlay;
+  if (!Options.UnsavedFiles.empty()) {
+    if (Options.OutputMode == OutputInPlace) {
+      llvm::report_fatal_error(
+          "Unsaved files can only be used with -output=diff or "
+          "-output=replacements.");
+    }
+    if (!Overlay.readFile(Options.UnsavedFiles)) {
+      llvm::report_fatal_error("Couldn't read the unsaved files from " +
+                               Options.UnsavedFiles + ".");
+    }
+  }
+
+  TraceSession Session(Options.TraceFile, Options.PrintStats);
+  TraversalStatsSession StatsSession(Options.TraversalStatsPath);
+  std::string DatabaseDir;
+  {
+    TraceSpan Span("load compilation database");
+    // A server without sources looks for the compilation database from
+    // the current directory.
+    DatabaseDir = LoadCompilationDatabaseIfNotFound(
+        Compilations, Options.BuildPath,
+        SourcePaths.empty() ? std::string(".") : SourcePaths[0]);
+  }
+
+  if (!Options.ServerSocket.empty()) {
+    DefinedToolRequestHandler Handler(FilterOpts, Tool);
+    RefactoringServer Server(*Compilations, Handler, argv[0]);
+    Server.setOutputMode(Options.OutputMode);
+    return Server.serve(Options.ServerSocket) ? 0 : 1;
+  }
+
+  // With a compilation database given on the command line, there's nowhere
+  // to keep the costs by default, so they're only estimated.
+  std::string CostPath = Options.CostFile;
+  if (CostPath.empty() && !DatabaseDir.empty()) {
+    CostPath = DatabaseDir + "/cpp-tools-costs.txt";
+  }
+  TUCostModel CostModel(CostPath);
+  std::vector<std::string> Sources = SourcePaths;
+  if (ShardCount) {
+    TraceSpan Span("select shard");
+    Sources = SelectShard(*Compilations, CostModel, Sources, ShardIndex,
+                          ShardCount);
+    // The merge folds what each shard measured into the cost file.
+    if (!CostPath.empty()) {
+      CostModel.setSavePath(
+          GetShardCostPath(CostPath, ShardIndex, ShardCount));
+    }
+  }
+
+  ParallelClangTool ParallelTool(*Compilations, Sources, Options.NumThreads);
+  ParallelTool.setUseSharedPreambles(Options.SharedPreambles);
+  ParallelTool.setUseWorkerProcesses(Options.Isolate);
+  ParallelTool.setBudget(Options.Timeout,
+                         (uint64_t)Options.MemoryLimit << 20);
+  ParallelTool.setFileOverlay(&Overlay);
+  // A shard's edits are kept for the merge, which outputs them as asked.
+  std::string ShardReplacements;
+  raw_string_ostream ShardEdits(ShardReplacements);
+  if (ShardCount) {
+    ParallelTool.setOutputMode(OutputReplacements, &ShardEdits);
+  } else {
+    ParallelTool.setOutputMode(Options.OutputMode, &outs());
+  }
+  ParallelTool.setCostModel(&CostModel);
+  OwningPtr<IncrementalCache> Cache;
+  if (!Options.CacheDir.empty()) {
+    // Cached edits are only reused with the same settings.
+    const std::string Config = std::string(Name) + '\0' + Tool.getConfig()
+                             + '\0' + Options.HeaderFilter + '\0'
+                             + Options.RootDir;
+    Cache.reset(new IncrementalCache(Options.CacheDir, Config));
+    ParallelTool.setIncrementalCache(Cache.get());
+  }
+  OwningPtr<ASTCache> ASTs;
+  if (!Options.ASTCacheDir.empty()) {
+    ASTs.reset(new ASTCache(Options.ASTCacheDir,
+                            (uint64_t)Options.ASTCacheSize << 20));
+    ParallelTool.setASTCache(ASTs.get());
+  }
+  DefinedToolActionFactory Factory(FilterOpts, Tool);
+  int Result = ParallelTool.run(Factory);
+  if (ShardCount) {
+    std::string ShardPath = Options.ShardOutput;
+    if (ShardPath.empty()) {
+      ShardPath = GetDefaultShardPath(DatabaseDir, ShardIndex, ShardCount);
+    }
+    if (!WriteShardFile(ShardPath, ShardIndex, ShardCount, CostPath,
+                        ShardEdits.str())) {
+      errs() << "Couldn't write the shard's edits to " << ShardPath << ".\n";
+      return 1;
+    }
+  }
+  return Result;
+}
@@ -0,0 +1,49 @@
+#ifndef CPP_TOOLS_COMMON_TOOL_DRIVER_H
+#define CPP_TOOLS_COMMON_TOOL_DRIVER_H
+
+#include "ProcessedDecls.h"
+#include "SourceFilter.h"
+#include <string>
+
+class EditRecorder;
+
+namespace clang {
+class ASTConsumer;
+class SourceManager;
+}
+
+// What a tool that edits every translation unit it's given does; the rest,
+// from the command line to the output, is up to RunTool().
+class ToolDefinition {
+public:
+  virtual ~ToolDefinition() {}
+
+  // Checks the tool's own options once the command line has been parsed,
+  // and fills in the defaults that depend on each other.
+  virtual void validateOptions() {}
+
+  // Returns everything among the tool's own options that affects which
+  // edits are made, so that cached edits are only reused with the same
+  // settings.
+  virtual std::string getConfig() const = 0;
+
+  // Creates the consumer that makes the tool's edits with Recorder, on the
+  // decls that pass FilterOpts and that ProcessedDecls doesn't have yet.
+  // ProcessedDecls is null when serving requests.
+  virtual clang::ASTConsumer *createConsumer(
+      const clang::SourceManager &SM,
+      const SourceFilterOptions &FilterOpts,
+      ProcessedDeclSet *ProcessedDecls,
+      EditRecorder &Recorder) const = 0;
+};
+
+// The main() of a tool: registers the options every such tool has, parses
+// the command line along with the tool's own options, and then merges
+// shards, serves requests, or runs Tool over the source files given, with
+// the caches, cost model, sharding and tracing the options ask for. Name is
+// the tool's name, which keeps its cached edits apart from other tools'.
+// Returns the exit code.
+int RunTool(int argc, char **argv, const char *Name,
+            ToolDefinition &Tool);
+
+#endif
@@ -0,0 +1,161 @@
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Trace.h"
+#include <algorithm>
+using namespace llvm;
+
+static Trace *CurrentTrace = 0;
+
+Trace *GetTrace() {
+  return CurrentTrace;
+}
+
+Trace::Trace()
+  : Begin(Clock::now())
+  {}
+
+static long long ToMicroseconds(Trace::Clock::duration Duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      Duration).count();
+}
+
+void Trace::addSpan(StringRef Phase,
+                    StringRef Detail,
+                    Clock::time_point Start,
+                    Clock::time_point End) {
+  Event E;
+  E.Phase = Phase;
+  E.Detail = Detail;
+  E.Start = ToMicroseconds(Start - Begin);
+  E.Duration = ToMicroseconds(End - Start);
+  E.IsTotal = false;
+  addEvent(std::move(E));
+}
+
+void Trace::addTotal(StringRef Phase,
+                     StringRef Detail,
+                     Clock::duration Total) {
+  Event E;
+  E.Phase = Phase;
+  E.Detail = Detail;
+  E.Start = ToMicroseconds(Clock::now() - Begin);
+  E.Duration = ToMicroseconds(Total);
+  E.IsTotal = true;
+  addEvent(std::move(E));
+}
+
+void Trace::addEvent(Event E) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  // Number the threads in the order they're first seen, which reads better
+  // in the trace viewer than the system's thread IDs.
+  auto Inserted = ThreadIDs.insert(
+      std::make_pair(std::this_thread::get_id(), ThreadIDs.size() + 1));
+  E.Thread = Inserted.first->second;
+  Events.push_back(std::move(E));
+}
+
+void WriteJSONString(raw_ostream &OS, StringRef S) {
+  OS << '"';
+  for (size_t I = 0, E = S.size(); I != E; ++I) {
+    unsigned char C = S[I];
+    if (C == '"' || C == '\\') {
+      OS << '\\' << C;
+    } else if (C < 0x20) {
+      OS << format("\\u%04x", C);
+    } else {
+      OS << C;
+    }
+  }
+  OS << '"';
+}
+
+bool Trace::writeChromeTrace(StringRef Path) const {
+  std::string ErrorInfo;
+  raw_fd_ostream OS(Path.str().c_str(), ErrorInfo);
+  if (!ErrorInfo.empty()) {
+    errs() << "Couldn't write the trace to " << Path << ": "
+           << ErrorInfo << "\n";
+    return false;
+  }
+
+  std::lock_guard<std::mutex> Lock(Mutex);
+  OS << "{\"traceEvents\":[\n";
+  for (size_t I = 0, E = Events.size(); I != E; ++I) {
+    const Event &Ev = Events[I];
+    OS << "{\"name\":";
+    WriteJSONString(OS, Ev.Phase);
+    if (Ev.IsTotal) {
+      OS << ",\"ph\":\"i\",\"s\":\"t\"";
+    } else {
+      OS << ",\"ph\":\"X\",\"dur\":" << Ev.Duration;
+    }
+    OS << ",\"ts\":" << Ev.Start << ",\"pid\":1,\"tid\":" << Ev.Thread
+       << ",\"args\":{\"detail\":";
+    WriteJSONString(OS, Ev.Detail);
+    if (Ev.IsTotal) OS << ",\"total_us\":" << Ev.Duration;
+    OS << "}}" << (I + 1 != E ? ",\n" : "\n");
+  }
+  OS << "],\"displayTimeUnit\":\"ms\"}\n";
+  return true;
+}
+
+// Returns the element at the given percentile of sorted durations.
+static long long GetPercentile(const std::vector<long long> &Sorted,
+                               unsigned Percentile) {
+  size_t Rank = (Sorted.size() * Percentile + 99) / 100;
+  return Sorted[Rank ? Rank - 1 : 0];
+}
+
+void Trace::printStats(raw_ostream &OS) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+
+  // Group the durations by phase, keeping the phases in the order they
+  // first happened.
+  std::vector<std::string> Phases;
+  std::map<std::string, std::vector<const Event*> > ByPhase;
+  for (auto EI = Events.begin(), EE = Events.end(); EI != EE; ++EI) {
+    std::vector<const Event*> &PhaseEvents = ByPhase[EI->Phase];
+    if (PhaseEvents.empty()) Phases.push_back(EI->Phase);
+    PhaseEvents.push_back(&*EI);
+  }
+
+  OS << format("%-20s %7s %10s %10s %10s  %s\n",
+               "phase", "count", "p50 (ms)", "p95 (ms)", "max (ms)",
+               "slowest");
+  for (auto PI = Phases.begin(), PE = Phases.end(); PI != PE; ++PI) {
+    const std::vector<const Event*> &PhaseEvents = ByPhase[*PI];
+    std::vector<long long> Durations;
+    const Event *Slowest = PhaseEvents[0];
+    for (auto EI = PhaseEvents.begin(), EE = PhaseEvents.end();
+         EI != EE; ++EI) {
+      Durations.push_back((*EI)->Duration);
+      if ((*EI)->Duration > Slowest->Duration) Slowest = *EI;
+    }
+    std::sort(Durations.begin(), Durations.end());
+
+    OS << format("%-20s %7u %10.1f %10.1f %10.1f  ",
+                 PI->c_str(), unsigned(Durations.size()),
+                 GetPercentile(Durations, 50) / 1000.0,
+                 GetPercentile(Durations, 95) / 1000.0,
+                 Durations.back() / 1000.0)
+       << Slowest->Detail << "\n";
+  }
+}
+
+TraceSession::TraceSession(StringRef TracePath, bool PrintStats)
+  : TracePath(TracePath)
+  , PrintStats(PrintStats)
+  , TheTrace(0)
+{
+  if (TracePath.empty() && !PrintStats) return;
+  TheTrace = new Trace;
+  CurrentTrace = TheTrace;
+}
+
+TraceSession::~TraceSession() {
+  if (!TheTrace) return;
+  CurrentTrace = 0;
+  if (!TracePath.empty()) TheTrace->writeChromeTrace(TracePath);
+  if (PrintStats) TheTrace->printStats(errs());
+  delete TheTrace;
+}
@@ -0,0 +1,138 @@
+#ifndef CPP_TOOLS_COMMON_TRACE_H
+#define CPP_TOOLS_COMMON_TRACE_H
+
+#include "llvm/ADT/StringRef.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+}
+
+// Records how long each phase of a run took, for every translation unit,
+// so that it can be written out as a Chrome trace (chrome://tracing) and
+// summarized per phase. Safe to use from several threads.
+class Trace {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  Trace();
+
+  // Records that the calling thread spent [Start, End) in Phase. Detail
+  // says what it was working on, e.g. the translation unit.
+  void addSpan(llvm::StringRef Phase,
+               llvm::StringRef Detail,
+               Clock::time_point Start,
+               Clock::time_point End);
+
+  // Records time spent in a phase that's interleaved with others, like AST
+  // traversal, which happens while parsing. It's only summarized, and
+  // attached to the trace as an instant event.
+  void addTotal(llvm::StringRef Phase,
+                llvm::StringRef Detail,
+                Clock::duration Total);
+
+  // Writes the trace-event JSON. Returns false if the file can't be written.
+  bool writeChromeTrace(llvm::StringRef Path) const;
+
+  // Prints the median, 95th percentile and maximum time of each phase,
+  // along with what the slowest span was working on.
+  void printStats(llvm::raw_ostream &OS) const;
+
+private:
+  struct Event {
+    std::string Phase;
+    std::string Detail;
+    // Microseconds since the start of the trace.
+    long long Start, Duration;
+    unsigned Thread;
+    // Whether only the duration is meaningful.
+    bool IsTotal;
+  };
+
+  const Clock::time_point Begin;
+  mutable std::mutex Mutex;
+  std::vector<Event> Events;
+  std::map<std::thread::id, unsigned> ThreadIDs;
+
+  void addEvent(Event E);
+};
+
+// Writes a string as a quoted JSON string.
+void WriteJSONString(llvm::raw_ostream &OS, llvm::StringRef S);
+
+// The trace of the current run, or null if there's none. Tracing is off
+// unless the tool turns it on, and costs next to nothing when it's off.
+Trace *GetTrace();
+
+// Turns tracing on for as long as it exists, if a trace file or stats were
+// asked for, and writes them out when it's destroyed.
+class TraceSession {
+public:
+  TraceSession(llvm::StringRef TracePath, bool PrintStats);
+  ~TraceSession();
+
+private:
+  const std::string TracePath;
+  const bool PrintStats;
+  Trace *TheTrace;
+};
+
+// Records a span of a phase, from its construction to its destruction.
+class TraceSpan {
+public:
+  explicit TraceSpan(llvm::StringRef Phase, llvm::StringRef Detail = "")
+    : Phase(Phase)
+  {
+    if (!GetTrace()) return;
+    this->Detail = Detail;
+    Start = Trace::Clock::now();
+  }
+
+  ~TraceSpan() {
+    if (Trace *T = GetTrace()) {
+      T->addSpan(Phase, Detail, Start, Trace::Clock::now());
+    }
+  }
+
+private:
+  const llvm::StringRef Phase;
+  std::string Detail;
+  Trace::Clock::time_point Start;
+};
+
+// Adds up the time spent in a phase that's entered many times, like the
+// traversal of each top-level decl.
+class TraceTimer {
+public:
+  TraceTimer() : Total(Trace::Clock::duration::zero()) {}
+
+  // Times a scope, adding it to the timer's total.
+  class Scope {
+  public:
+    explicit Scope(TraceTimer &Timer) : Timer(Timer) {
+      if (GetTrace()) Start = Trace::Clock::now();
+    }
+    ~Scope() {
+      if (GetTrace()) Timer.Total += Trace::Clock::now() - Start;
+    }
+
+  private:
+    TraceTimer &Timer;
+    Trace::Clock::time_point Start;
+  };
+
+  // Records the total in the trace.
+  void report(llvm::StringRef Phase, llvm::StringRef Detail) const {
+    if (Trace *T = GetTrace()) T->addTotal(Phase, Detail, Total);
+  }
+
+private:
+  Trace::Clock::duration Total;
+};
+
+#endif
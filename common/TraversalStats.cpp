@@ -0,0 +1,144 @@
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Trace.h"
+#include "TraversalStats.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+using namespace llvm;
+
+static TraversalStats *CurrentStats = 0;
+
+TraversalStats *GetTraversalStats() {
+  return CurrentStats;
+}
+
+void TraversalStats::add(StringRef Visitor, const VisitorCounts &Counts) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  VisitorCounts &Total = Visitors[Visitor];
+  for (auto KI = Counts.Kinds.begin(), KE = Counts.Kinds.end();
+       KI != KE; ++KI) {
+    NodeKindCounts &Kind = Total.Kinds[KI->first];
+    Kind.Count += KI->second.Count;
+    Kind.Nanoseconds += KI->second.Nanoseconds;
+  }
+  for (auto FI = Counts.Files.begin(), FE = Counts.Files.end();
+       FI != FE; ++FI) {
+    FileCounts &File = Total.Files[FI->first];
+    File.Decls += FI->second.Decls;
+    File.Stmts += FI->second.Stmts;
+  }
+}
+
+// The number of node kinds and files printed per visitor in the table.
+static const size_t TableRows = 20;
+
+void TraversalStats::printTable(raw_ostream &OS) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  for (auto VI = Visitors.begin(), VE = Visitors.end(); VI != VE; ++VI) {
+    OS << VI->first << "\n";
+
+    // Node kinds, by the time spent on them and then by count.
+    std::vector<std::pair<const std::string*, const NodeKindCounts*> > Kinds;
+    for (auto KI = VI->second.Kinds.begin(), KE = VI->second.Kinds.end();
+         KI != KE; ++KI) {
+      Kinds.push_back(std::make_pair(&KI->first, &KI->second));
+    }
+    std::stable_sort(Kinds.begin(), Kinds.end(),
+                     [](const std::pair<const std::string*,
+                                        const NodeKindCounts*> &L,
+                        const std::pair<const std::string*,
+                                        const NodeKindCounts*> &R) {
+                       if (L.second->Nanoseconds != R.second->Nanoseconds) {
+                         return L.second->Nanoseconds > R.second->Nanoseconds;
+                       }
+                       return L.second->Count > R.second->Count;
+                     });
+    OS << format("  %-32s %12s %12s\n", "node kind", "count", "visit (ms)");
+    for (size_t I = 0, E = std::min(Kinds.size(), TableRows); I != E; ++I) {
+      OS << format("  %-32s %12llu %12.3f\n",
+                   Kinds[I].first->c_str(), Kinds[I].second->Count,
+                   Kinds[I].second->Nanoseconds / 1e6);
+    }
+
+    // Files, by the number of nodes in them.
+    std::vector<std::pair<const std::string*, const FileCounts*> > Files;
+    for (auto FI = VI->second.Files.begin(), FE = VI->second.Files.end();
+         FI != FE; ++FI) {
+      Files.push_back(std::make_pair(&FI->first, &FI->second));
+    }
+    std::stable_sort(Files.begin(), Files.end(),
+                     [](const std::pair<const std::string*,
+                                        const FileCounts*> &L,
+                        const std::pair<const std::string*,
+                                        const FileCounts*> &R) {
+                       return L.second->Decls + L.second->Stmts
+                            > R.second->Decls + R.second->Stmts;
+                     });
+    OS << format("  %12s %12s  %s\n", "decls", "stmts", "file");
+    for (size_t I = 0, E = std::min(Files.size(), TableRows); I != E; ++I) {
+      OS << format("  %12llu %12llu  ",
+                   Files[I].second->Decls, Files[I].second->Stmts)
+         << *Files[I].first << "\n";
+    }
+  }
+}
+
+bool TraversalStats::writeJSON(StringRef Path) const {
+  std::string ErrorInfo;
+  raw_fd_ostream OS(Path.str().c_str(), ErrorInfo);
+  if (!ErrorInfo.empty()) {
+    errs() << "Couldn't write the traversal stats to " << Path << ": "
+           << ErrorInfo << "\n";
+    return false;
+  }
+
+  std::lock_guard<std::mutex> Lock(Mutex);
+  OS << "{";
+  for (auto VI = Visitors.begin(), VE = Visitors.end(); VI != VE; ++VI) {
+    if (VI != Visitors.begin()) OS << ",";
+    OS << "\n";
+    WriteJSONString(OS, VI->first);
+    OS << ":{\"kinds\":{";
+    for (auto KI = VI->second.Kinds.begin(), KE = VI->second.Kinds.end();
+         KI != KE; ++KI) {
+      if (KI != VI->second.Kinds.begin()) OS << ",";
+      OS << "\n  ";
+      WriteJSONString(OS, KI->first);
+      OS << ":{\"count\":" << KI->second.Count
+         << ",\"visit_ns\":" << KI->second.Nanoseconds << "}";
+    }
+    OS << "},\"files\":{";
+    for (auto FI = VI->second.Files.begin(), FE = VI->second.Files.end();
+         FI != FE; ++FI) {
+      if (FI != VI->second.Files.begin()) OS << ",";
+      OS << "\n  ";
+      WriteJSONString(OS, FI->first);
+      OS << ":{\"decls\":" << FI->second.Decls
+         << ",\"stmts\":" << FI->second.Stmts << "}";
+    }
+    OS << "}}";
+  }
+  OS << "\n}\n";
+  return true;
+}
+
+TraversalStatsSession::TraversalStatsSession(StringRef Path)
+  : Path(Path)
+  , Stats(0)
+{
+  if (Path.empty()) return;
+  Stats = new TraversalStats;
+  CurrentStats = Stats;
+}
+
+TraversalStatsSession::~TraversalStatsSession() {
+  if (!Stats) return;
+  CurrentStats = 0;
+  if (Path == "-") {
+    Stats->printTable(errs());
+  } else {
+    Stats->writeJSON(Path);
+  }
+  delete Stats;
+}
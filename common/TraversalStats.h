@@ -0,0 +1,263 @@
+#ifndef CPP_TOOLS_COMMON_TRAVERSAL_STATS_H
+#define CPP_TOOLS_COMMON_TRAVERSAL_STATS_H
+
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+// How many nodes of one kind a visitor saw, and how long its Visit*
+// callbacks took on them.
+struct NodeKindCounts {
+  NodeKindCounts() : Count(0), Nanoseconds(0) {}
+
+  unsigned long long Count;
+  unsigned long long Nanoseconds;
+};
+
+// How many decls and stmts in one file a visitor saw.
+struct FileCounts {
+  FileCounts() : Decls(0), Stmts(0) {}
+
+  unsigned long long Decls, Stmts;
+};
+
+// What one visitor saw while traversing one AST.
+struct VisitorCounts {
+  // By the name of the node kind, e.g. "CXXMethod" or "DeclRefExpr".
+  std::map<std::string, NodeKindCounts> Kinds;
+  // By the path of the file the node is in.
+  std::map<std::string, FileCounts> Files;
+};
+
+// Adds up what every visitor saw over the whole run, and reports it at the
+// end. Safe to use from several threads.
+class TraversalStats {
+public:
+  void add(llvm::StringRef Visitor, const VisitorCounts &Counts);
+
+  // Prints a table per visitor of the node kinds and files it saw the most
+  // nodes of.
+  void printTable(llvm::raw_ostream &OS) const;
+
+  // Writes everything as JSON. Returns false if the file can't be written.
+  bool writeJSON(llvm::StringRef Path) const;
+
+private:
+  mutable std::mutex Mutex;
+  std::map<std::string, VisitorCounts> Visitors;
+};
+
+// The traversal stats of the current run, or null if they're off.
+TraversalStats *GetTraversalStats();
+
+// Turns the traversal stats on for as long as it exists, if a path was
+// given, and reports them when it's destroyed: as a table on stderr if the
+// path is "-", or as JSON in the file otherwise.
+class TraversalStatsSession {
+public:
+  explicit TraversalStatsSession(llvm::StringRef Path);
+  ~TraversalStatsSession();
+
+private:
+  const std::string Path;
+  TraversalStats *Stats;
+};
+
+// Runs the traversal for another visitor, passing every Visit* callback on
+// to it, and counts the decls and stmts it sees by kind and by file, along
+// with the time spent in the callbacks the visitor implements. Callbacks
+// the visitor doesn't implement are skipped at compile time, so they're
+// neither called nor timed. What was counted is added to the run's
+// TraversalStats when this is destroyed.
+//
+// Like CombinedASTVisitor, only the Visit* callbacks and the traversal
+// options of the visitor are used. A visitor that prunes the traversal can
+// also declare bool shouldTraverseStmt(clang::Stmt*), which is respected.
+template <typename VisitorT>
+class InstrumentedASTVisitor :
+  public clang::RecursiveASTVisitor<InstrumentedASTVisitor<VisitorT> > {
+  typedef std::chrono::steady_clock Clock;
+
+public:
+  InstrumentedASTVisitor(llvm::StringRef Name,
+                         const clang::SourceManager &SM,
+                         VisitorT &Inner)
+    : Name(Name)
+    , SM(SM)
+    , Inner(Inner)
+    , Current(0)
+  {}
+
+  ~InstrumentedASTVisitor() {
+    if (TraversalStats *Stats = GetTraversalStats()) {
+      VisitorCounts Counts;
+      for (auto KI = Kinds.begin(), KE = Kinds.end(); KI != KE; ++KI) {
+        NodeKindCounts &Total = Counts.Kinds[KI->second.Name];
+        Total.Count += KI->second.Counts.Count;
+        Total.Nanoseconds += KI->second.Counts.Nanoseconds;
+      }
+      for (auto FI = Files.begin(), FE = Files.end(); FI != FE; ++FI) {
+        const clang::FileEntry *File = FI->first.isInvalid()
+          ? 0 : SM.getFileEntryForID(FI->first);
+        FileCounts &Total = Counts.Files[File ? File->getName() : "<none>"];
+        Total.Decls += FI->second.Decls;
+        Total.Stmts += FI->second.Stmts;
+      }
+      Stats->add(Name, Counts);
+    }
+  }
+
+  bool shouldVisitTemplateInstantiations() const {
+    return Inner.shouldVisitTemplateInstantiations();
+  }
+  bool shouldWalkTypesOfTypeLocs() const {
+    return Inner.shouldWalkTypesOfTypeLocs();
+  }
+  bool shouldVisitImplicitCode() const {
+    return Inner.shouldVisitImplicitCode();
+  }
+
+  bool TraverseStmt(clang::Stmt *S) {
+    if (!shouldTraverseStmt(Inner, S, 0)) return true;
+    return clang::RecursiveASTVisitor<InstrumentedASTVisitor>::TraverseStmt(S);
+  }
+
+  // The first callback for every decl and stmt, which counts it.
+  bool VisitDecl(clang::Decl *D) {
+    count(D->getKind(), D->getDeclKindName(), D->getLocation()).Decls++;
+    return forward(&VisitorT::VisitDecl, D);
+  }
+  bool VisitStmt(clang::Stmt *S) {
+    count(S->getStmtClass() + FirstStmtKey, S->getStmtClassName(),
+          S->getLocStart()).Stmts++;
+    return forward(&VisitorT::VisitStmt, S);
+  }
+  // Types and type locs aren't in any file, and are counted as a kind
+  // each, so that the time spent on them isn't put down to the last decl
+  // or stmt.
+  bool VisitType(clang::Type *T) {
+    countKind(TypeKey, "Type");
+    return forward(&VisitorT::VisitType, T);
+  }
+  bool VisitTypeLoc(clang::TypeLoc TL) {
+    countKind(TypeLocKey, "TypeLoc");
+    return forward(&VisitorT::VisitTypeLoc, TL);
+  }
+  bool VisitUnqualTypeLoc(clang::UnqualTypeLoc TL) {
+    return forward(&VisitorT::VisitUnqualTypeLoc, TL);
+  }
+
+#define DECL(CLASS, BASE) \
+  bool Visit##CLASS##Decl(clang::CLASS##Decl *D) { \
+    return forward(&VisitorT::Visit##CLASS##Decl, D); \
+  }
+#include "clang/AST/DeclNodes.inc"
+
+#define STMT(CLASS, PARENT) \
+  bool Visit##CLASS(clang::CLASS *S) { \
+    return forward(&VisitorT::Visit##CLASS, S); \
+  }
+#include "clang/AST/StmtNodes.inc"
+
+#define TYPE(CLASS, BASE) \
+  bool Visit##CLASS##Type(clang::CLASS##Type *T) { \
+    return forward(&VisitorT::Visit##CLASS##Type, T); \
+  }
+#include "clang/AST/TypeNodes.def"
+
+#define TYPELOC(CLASS, BASE) \
+  bool Visit##CLASS##TypeLoc(clang::CLASS##TypeLoc TL) { \
+    return forward(&VisitorT::Visit##CLASS##TypeLoc, TL); \
+  }
+#include "clang/AST/TypeLocNodes.def"
+
+private:
+  // Stmt classes are keyed after the decl kinds, and types after both.
+  static const unsigned FirstStmtKey = 1 << 16;
+  static const unsigned TypeKey = 1 << 17;
+  static const unsigned TypeLocKey = TypeKey + 1;
+
+  struct KindEntry {
+    KindEntry() : Name(0) {}
+
+    const char *Name;
+    NodeKindCounts Counts;
+  };
+
+  const std::string Name;
+  const clang::SourceManager &SM;
+  VisitorT &Inner;
+  llvm::DenseMap<unsigned, KindEntry> Kinds;
+  llvm::DenseMap<clang::FileID, FileCounts> Files;
+  // The kind of the node whose callbacks are being run.
+  KindEntry *Current;
+
+  void countKind(unsigned Key, const char *KindName) {
+    Current = &Kinds[Key];
+    Current->Name = KindName;
+    Current->Counts.Count++;
+  }
+
+  FileCounts &count(unsigned Key, const char *KindName,
+                    clang::SourceLocation Loc) {
+    countKind(Key, KindName);
+    clang::FileID FID;
+    if (Loc.isValid()) FID = SM.getFileID(SM.getExpansionLoc(Loc));
+    return Files[FID];
+  }
+
+  // Whether a pointer to a Visit* method is one the visitor declares
+  // itself, rather than the do-nothing one it inherits.
+  template <typename MethodT>
+  struct IsImplemented;
+  template <typename ClassT, typename NodeT>
+  struct IsImplemented<bool (ClassT::*)(NodeT)> {
+    static const bool value = std::is_same<ClassT, VisitorT>::value;
+  };
+
+  // Calls the visitor's shouldTraverseStmt() if it has one.
+  template <typename V>
+  static auto shouldTraverseStmt(V &Visitor, clang::Stmt *S, int)
+      -> decltype(Visitor.shouldTraverseStmt(S)) {
+    return Visitor.shouldTraverseStmt(S);
+  }
+  template <typename V>
+  static bool shouldTraverseStmt(V &, clang::Stmt *, long) {
+    return true;
+  }
+
+  template <typename MethodT, typename NodeT>
+  bool forward(MethodT Method, NodeT Node) {
+    if (!IsImplemented<MethodT>::value) return true;
+
+    const Clock::time_point Start = Clock::now();
+    const bool Result = (Inner.*Method)(Node);
+    if (Current) {
+      Current->Counts.Nanoseconds +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              Clock::now() - Start).count();
+    }
+    return Result;
+  }
+};
+
+// Traverses a decl with a visitor, through an InstrumentedASTVisitor if the
+// traversal stats are on.
+template <typename VisitorT>
+bool TraverseDeclWithStats(llvm::StringRef Name,
+                           const clang::SourceManager &SM,
+                           VisitorT &Visitor,
+                           clang::Decl *D) {
+  if (!GetTraversalStats()) return Visitor.TraverseDecl(D);
+  InstrumentedASTVisitor<VisitorT> Instrumented(Name, SM, Visitor);
+  return Instrumented.TraverseDecl(D);
+}
+
+#endif
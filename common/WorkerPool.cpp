@@ -0,0 +1,385 @@
+#include "llvm/Support/raw_ostream.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+using namespace std;
+
+WorkStealingScheduler::WorkStealingScheduler(unsigned NumItems,
+                                             unsigned NumWorkers)
+  : Queues(NumWorkers ? NumWorkers : 1) {
+  // Give each worker a contiguous block of items, so that a worker that
+  // never has to steal processes its items in their original order.
+  const unsigned NumQueues = Queues.size();
+  for (unsigned Worker = 0; Worker != NumQueues; ++Worker) {
+    unsigned Begin = (unsigned long long)NumItems * Worker / NumQueues;
+    unsigned End = (unsigned long long)NumItems * (Worker + 1) / NumQueues;
+    for (unsigned Item = Begin; Item != End; ++Item) {
+      Queues[Worker].Items.push_back(Item);
+    }
+  }
+}
+
+WorkStealingScheduler::WorkStealingScheduler(const vector<unsigned> &Order,
+                                             unsigned NumWorkers)
+  : Queues(NumWorkers ? NumWorkers : 1) {
+  const unsigned NumQueues = Queues.size();
+  for (size_t I = 0, E = Order.size(); I != E; ++I) {
+    Queues[I % NumQueues].Items.push_back(Order[I]);
+  }
+}
+
+bool WorkStealingScheduler::getNextItem(unsigned Worker, unsigned &Item) {
+  if (popOwnItem(Worker, Item)) return true;
+  return stealItem(Worker, Item);
+}
+
+bool WorkStealingScheduler::popOwnItem(unsigned Worker, unsigned &Item) {
+  WorkerQueue &Queue = Queues[Worker];
+  lock_guard<mutex> Guard(Queue.Lock);
+  if (Queue.Items.empty()) return false;
+  Item = Queue.Items.front();
+  Queue.Items.pop_front();
+  return true;
+}
+
+bool WorkStealingScheduler::stealItem(unsigned Thief, unsigned &Item) {
+  // Items are never added after construction, so a single pass over the
+  // other queues that finds them all empty means we're done.
+  const unsigned NumQueues = Queues.size();
+  for (unsigned Offset = 1; Offset != NumQueues; ++Offset) {
+    WorkerQueue &Victim = Queues[(Thief + Offset) % NumQueues];
+    lock_guard<mutex> Guard(Victim.Lock);
+    if (Victim.Items.empty()) continue;
+    Item = Victim.Items.back();
+    Victim.Items.pop_back();
+    return true;
+  }
+  return false;
+}
+
+void RunOnWorkerThreads(unsigned NumWorkers,
+                        const function<void(unsigned)> &Body) {
+  if (NumWorkers <= 1) {
+    Body(0);
+    return;
+  }
+
+  vector<thread> Threads;
+  Threads.reserve(NumWorkers);
+  for (unsigned Worker = 0; Worker != NumWorkers; ++Worker) {
+    Threads.push_back(thread(Body, Worker));
+  }
+  for (auto TI = Threads.begin(), TE = Threads.end(); TI != TE; ++TI) {
+    TI->join();
+  }
+}
+
+namespace {
+  typedef chrono::steady_clock Clock;
+
+  // A worker process, and the pipes to and from it.
+  struct WorkerProcess {
+    WorkerProcess() : Pid(-1), ToWorker(-1), FromWorker(-1), Busy(false),
+                      Item(0), PeakMemoryBytes(0) {}
+
+    pid_t Pid;
+    int ToWorker;
+    int FromWorker;
+    bool Busy;
+    unsigned Item;
+    // When the worker was handed its current item, and the most memory
+    // it's been seen to use since.
+    Clock::time_point Started;
+    uint64_t PeakMemoryBytes;
+    // What the worker has sent back for its current item so far.
+    string Received;
+  };
+}
+
+static bool WriteFully(int FD, const char *Data, size_t Size) {
+  while (Size) {
+    ssize_t Written = write(FD, Data, Size);
+    if (Written < 0 && errno == EINTR) continue;
+    if (Written <= 0) return false;
+    Data += Written;
+    Size -= Written;
+  }
+  return true;
+}
+
+static bool ReadFully(int FD, char *Data, size_t Size) {
+  while (Size) {
+    ssize_t Read = read(FD, Data, Size);
+    if (Read < 0 && errno == EINTR) continue;
+    if (Read <= 0) return false;
+    Data += Read;
+    Size -= Read;
+  }
+  return true;
+}
+
+// What a worker process does: reads item numbers, and writes back each
+// item's result prefixed by its size, until the parent closes the pipe.
+static void RunWorkerProcess(int ToWorker,
+                             int FromWorker,
+                             const function<string(unsigned)> &Body) {
+  unsigned Item = 0;
+  while (ReadFully(ToWorker, reinterpret_cast<char*>(&Item), sizeof(Item))) {
+    const string Result = Body(Item);
+    const uint64_t Size = Result.size();
+    if (!WriteFully(FromWorker, reinterpret_cast<const char*>(&Size),
+                    sizeof(Size)) ||
+        !WriteFully(FromWorker, Result.data(), Result.size())) {
+      return;
+    }
+  }
+}
+
+static bool StartWorker(WorkerProcess &Worker,
+                        const vector<WorkerProcess> &Workers,
+                        const function<string(unsigned)> &Body) {
+  int ToPipe[2], FromPipe[2];
+  if (pipe(ToPipe) != 0) return false;
+  if (pipe(FromPipe) != 0) {
+    close(ToPipe[0]);
+    close(ToPipe[1]);
+    return false;
+  }
+
+  const pid_t Pid = fork();
+  if (Pid < 0) {
+    close(ToPipe[0]);
+    close(ToPipe[1]);
+    close(FromPipe[0]);
+    close(FromPipe[1]);
+    return false;
+  }
+  if (Pid == 0) {
+    // The other workers have to see their pipes close when the parent
+    // closes them, so this one mustn't hold them open.
+    for (auto WI = Workers.begin(), WE = Workers.end(); WI != WE; ++WI) {
+      if (WI->ToWorker >= 0) close(WI->ToWorker);
+      if (WI->FromWorker >= 0) close(WI->FromWorker);
+    }
+    close(ToPipe[1]);
+    close(FromPipe[0]);
+    RunWorkerProcess(ToPipe[0], FromPipe[1], Body);
+    // The destructors and exit handlers belong to the parent.
+    _exit(0);
+  }
+
+  close(ToPipe[0]);
+  close(FromPipe[1]);
+  Worker.Pid = Pid;
+  Worker.ToWorker = ToPipe[1];
+  Worker.FromWorker = FromPipe[0];
+  Worker.Busy = false;
+  Worker.Received.clear();
+  return true;
+}
+
+// Closes the pipes to a worker, which makes it exit if it's idle, and waits
+// for it. Returns its wait status.
+static int StopWorker(WorkerProcess &Worker) {
+  close(Worker.ToWorker);
+  close(Worker.FromWorker);
+  int Status = 0;
+  while (waitpid(Worker.Pid, &Status, 0) < 0 && errno == EINTR) {}
+  Worker.Pid = -1;
+  Worker.ToWorker = -1;
+  Worker.FromWorker = -1;
+  return Status;
+}
+
+// Returns the resident set size of a process, or zero if it can't be found
+// out.
+static uint64_t GetResidentMemory(pid_t Pid) {
+  char Path[64];
+  snprintf(Path, sizeof(Path), "/proc/%d/statm", (int)Pid);
+  FILE *Statm = fopen(Path, "r");
+  if (!Statm) return 0;
+  unsigned long long Size = 0, Resident = 0;
+  const int Fields = fscanf(Statm, "%llu %llu", &Size, &Resident);
+  fclose(Statm);
+  return Fields == 2 ? Resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+static double GetSecondsSince(Clock::time_point Start) {
+  return chrono::duration<double>(Clock::now() - Start).count();
+}
+
+void RunInWorkerProcesses(
+    unsigned NumItems,
+    unsigned NumWorkers,
+    const WorkerBudget &Budget,
+    const function<string(unsigned)> &Body,
+    const function<void(unsigned, const WorkerItemResult &)> &Done) {
+  if (!NumItems) return;
+  NumWorkers = max(1u, min(NumWorkers, NumItems));
+  // Handing an item to a worker that has just died mustn't kill the parent.
+  void (*OldHandler)(int) = signal(SIGPIPE, SIG_IGN);
+
+  vector<WorkerProcess> Workers(NumWorkers);
+  unsigned NextItem = 0;
+  unsigned Remaining = NumItems;
+
+  // Hands the next item to a worker, starting it first if need be.
+  auto Assign = [&](WorkerProcess &Worker) {
+    while (NextItem < NumItems) {
+      const unsigned Item = NextItem++;
+      if (Worker.Pid < 0 && !StartWorker(Worker, Workers, Body)) {
+        llvm::errs() << "Couldn't start a worker process: "
+                     << strerror(errno) << "; running the item in this one.\n";
+        const Clock::time_point Started = Clock::now();
+        WorkerItemResult Result;
+        Result.Output = Body(Item);
+        Result.State = WorkerItemResult::Finished;
+        Result.Seconds = GetSecondsSince(Started);
+        Done(Item, Result);
+        --Remaining;
+        continue;
+      }
+      // If the worker is gone, this fails, and so does reading the
+      // result, which reports the item as crashed.
+      WriteFully(Worker.ToWorker, reinterpret_cast<const char*>(&Item),
+                 sizeof(Item));
+      Worker.Item = Item;
+      Worker.Busy = true;
+      Worker.Started = Clock::now();
+      Worker.PeakMemoryBytes = 0;
+      Worker.Received.clear();
+      return;
+    }
+  };
+
+  // Reports how a worker's item went, and moves it on to the next one.
+  auto Complete = [&](WorkerProcess &Worker, WorkerItemResult &Result) {
+    Result.Seconds = GetSecondsSince(Worker.Started);
+    Result.PeakMemoryBytes = Worker.PeakMemoryBytes;
+    Worker.Busy = false;
+    Done(Worker.Item, Result);
+    --Remaining;
+    Assign(Worker);
+  };
+
+  // Kills a worker that went over its budget.
+  auto Cancel = [&](WorkerProcess &Worker,
+                    WorkerItemResult::ItemState State) {
+    kill(Worker.Pid, SIGKILL);
+    StopWorker(Worker);
+    WorkerItemResult Result;
+    Result.State = State;
+    Complete(Worker, Result);
+  };
+
+  for (auto WI = Workers.begin(), WE = Workers.end(); WI != WE; ++WI) {
+    Assign(*WI);
+  }
+
+  while (Remaining) {
+    vector<pollfd> Polled;
+    vector<WorkerProcess*> PolledWorkers;
+    // Wake up in time for the first deadline, and often enough to see
+    // memory use growing.
+    int Timeout = Budget.MemoryBytes ? 100 : -1;
+    for (auto WI = Workers.begin(), WE = Workers.end(); WI != WE; ++WI) {
+      if (!WI->Busy) continue;
+      pollfd Entry = { WI->FromWorker, POLLIN, 0 };
+      Polled.push_back(Entry);
+      PolledWorkers.push_back(&*WI);
+      if (Budget.Seconds) {
+        const double Left = Budget.Seconds - GetSecondsSince(WI->Started);
+        const int LeftMs = Left > 0 ? (int)(Left * 1000) + 1 : 0;
+        Timeout = Timeout < 0 ? LeftMs : min(Timeout, LeftMs);
+      }
+    }
+    if (Polled.empty()) break;
+    if (poll(Polled.data(), Polled.size(), Timeout) < 0) {
+      if (errno == EINTR) continue;
+      llvm::errs() << "Couldn't wait for the worker processes: "
+                   << strerror(errno) << "\n";
+      break;
+    }
+
+    for (size_t I = 0, E = Polled.size(); I != E; ++I) {
+      if (!Polled[I].revents) continue;
+      WorkerProcess &Worker = *PolledWorkers[I];
+
+      char Chunk[65536];
+      const ssize_t Read = read(Worker.FromWorker, Chunk, sizeof(Chunk));
+      if (Read < 0 && errno == EINTR) continue;
+      if (Read > 0) {
+        Worker.Received.append(Chunk, Read);
+        uint64_t Size = 0;
+        if (Worker.Received.size() < sizeof(Size)) continue;
+        memcpy(&Size, Worker.Received.data(), sizeof(Size));
+        if (Worker.Received.size() - sizeof(Size) < Size) continue;
+
+        WorkerItemResult Result;
+        Result.State = WorkerItemResult::Finished;
+        Result.Output = Worker.Received.substr(sizeof(Size), Size);
+        // Memory freed by the item isn't necessarily given back, so a
+        // worker that grew large would start the next item with less
+        // room. Replace it instead.
+        if (Budget.MemoryBytes &&
+            GetResidentMemory(Worker.Pid) > Budget.MemoryBytes / 2) {
+          StopWorker(Worker);
+        }
+        Complete(Worker, Result);
+        continue;
+      }
+
+      // The worker died before it finished its item. Start another one
+      // for the rest.
+      const int Status = StopWorker(Worker);
+      if (WIFSIGNALED(Status)) {
+        llvm::errs() << "A worker process was killed by signal "
+                     << WTERMSIG(Status) << " ("
+                     << strsignal(WTERMSIG(Status)) << ").\n";
+      } else {
+        llvm::errs() << "A worker process exited with status "
+                     << WEXITSTATUS(Status) << ".\n";
+      }
+      WorkerItemResult Result;
+      Result.State = WorkerItemResult::Crashed;
+      Complete(Worker, Result);
+    }
+
+    for (auto WI = Workers.begin(), WE = Workers.end(); WI != WE; ++WI) {
+      if (!WI->Busy) continue;
+      if (Budget.MemoryBytes) {
+        WI->PeakMemoryBytes = max(WI->PeakMemoryBytes,
+                                  GetResidentMemory(WI->Pid));
+        if (WI->PeakMemoryBytes > Budget.MemoryBytes) {
+          Cancel(*WI, WorkerItemResult::OutOfMemory);
+          continue;
+        }
+      }
+      if (Budget.Seconds && GetSecondsSince(WI->Started) >= Budget.Seconds) {
+        Cancel(*WI, WorkerItemResult::TimedOut);
+      }
+    }
+  }
+
+  // Anything left over couldn't be waited for.
+  const WorkerItemResult Lost;
+  for (auto WI = Workers.begin(), WE = Workers.end(); WI != WE; ++WI) {
+    if (WI->Busy) Done(WI->Item, Lost);
+  }
+  while (NextItem < NumItems) {
+    Done(NextItem++, Lost);
+  }
+  for (auto WI = Workers.begin(), WE = Workers.end(); WI != WE; ++WI) {
+    if (WI->Pid >= 0) StopWorker(*WI);
+  }
+  signal(SIGPIPE, OldHandler);
+}
@@ -0,0 +1,94 @@
+#ifndef CPP_TOOLS_COMMON_WORKER_POOL_H
+#define CPP_TOOLS_COMMON_WORKER_POOL_H
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Hands out work items to a fixed number of workers. Each worker owns a
+// queue that it takes items from in order; when its queue runs dry, it
+// steals from the back of another worker's queue, so that a few slow items
+// don't leave the rest of the workers idle.
+class WorkStealingScheduler {
+public:
+  WorkStealingScheduler(unsigned NumItems, unsigned NumWorkers);
+  // Hands the items out in the given order, e.g. most expensive first, by
+  // dealing them out to the workers in turn. Workers steal the items that
+  // come last in it.
+  WorkStealingScheduler(const std::vector<unsigned> &Order,
+                        unsigned NumWorkers);
+
+  // Gets the next item for the given worker. Returns false once there is
+  // no work left anywhere.
+  bool getNextItem(unsigned Worker, unsigned &Item);
+
+private:
+  struct WorkerQueue {
+    std::mutex Lock;
+    std::deque<unsigned> Items;
+  };
+  std::vector<WorkerQueue> Queues;
+
+  bool popOwnItem(unsigned Worker, unsigned &Item);
+  bool stealItem(unsigned Thief, unsigned &Item);
+};
+
+// Runs Body on NumWorkers threads, passing each its worker index, and waits
+// for all of them to finish. With a single worker, Body runs on the calling
+// thread.
+void RunOnWorkerThreads(unsigned NumWorkers,
+                        const std::function<void(unsigned)> &Body);
+
+// Limits on what a worker process may use for a single item. Zero means no
+// limit.
+struct WorkerBudget {
+  WorkerBudget() : Seconds(0), MemoryBytes(0) {}
+
+  double Seconds;
+  // Compared against the worker's resident set size, which is sampled while
+  // it runs the item. It can only be found out on systems with /proc.
+  uint64_t MemoryBytes;
+};
+
+// How running an item in a worker process went.
+struct WorkerItemResult {
+  enum ItemState {
+    Finished,
+    Crashed,
+    TimedOut,
+    OutOfMemory
+  };
+
+  WorkerItemResult() : State(Crashed), Seconds(0), PeakMemoryBytes(0) {}
+
+  ItemState State;
+  // What Body returned, if the item finished.
+  std::string Output;
+  double Seconds;
+  // The largest resident set size the worker was seen to have while it ran
+  // the item, if there's a memory budget, or zero.
+  uint64_t PeakMemoryBytes;
+};
+
+// Runs Body on each item in [0, NumItems) in a pool of NumWorkers forked
+// worker processes, so that an item that crashes, e.g. on an assertion,
+// only takes down its own worker. Each worker runs many items, in the order
+// they're handed out. Body returns the item's result as a string, which is
+// sent back to the parent over a pipe and passed to Done there.
+//
+// A worker that dies before sending a result, or that goes over the budget
+// and is killed for it, is replaced by a new one for the rest of the items.
+//
+// Done is only ever called from the calling thread. The process mustn't
+// have any other threads running when this is called.
+void RunInWorkerProcesses(
+    unsigned NumItems,
+    unsigned NumWorkers,
+    const WorkerBudget &Budget,
+    const std::function<std::string(unsigned)> &Body,
+    const std::function<void(unsigned, const WorkerItemResult &)> &Done);
+
+#endif
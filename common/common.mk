@@ -0,0 +1,32 @@
+# Sources shared by the tools. Include this after setting COMMON_PATH.
+COMMON_SRCS = $(COMMON_PATH)/ASTCache.cpp \
+              $(COMMON_PATH)/CompilationIndex.cpp \
+              $(COMMON_PATH)/CompileCommands.cpp \
+              $(COMMON_PATH)/CostModel.cpp \
+              $(COMMON_PATH)/EditRecorder.cpp $(COMMON_PATH)/Edits.cpp \
+              $(COMMON_PATH)/FileOverlay.cpp \
+              $(COMMON_PATH)/IncrementalCache.cpp \
+              $(COMMON_PATH)/ParallelTool.cpp $(COMMON_PATH)/ProcessedDecls.cpp \
+              $(COMMON_PATH)/RefactoringServer.cpp \
+              $(COMMON_PATH)/Shards.cpp \
+              $(COMMON_PATH)/SharedFileCache.cpp \
+              $(COMMON_PATH)/SharedPreamble.cpp \
+              $(COMMON_PATH)/SourceFiles.cpp $(COMMON_PATH)/SourceFilter.cpp \
+              $(COMMON_PATH)/ToolAction.cpp $(COMMON_PATH)/ToolDriver.cpp \
+              $(COMMON_PATH)/Trace.cpp \
+              $(COMMON_PATH)/TraversalStats.cpp $(COMMON_PATH)/WorkerPool.cpp
+COMMON_HDRS = $(COMMON_PATH)/ASTCache.h $(COMMON_PATH)/CombinedASTVisitor.h \
+              $(COMMON_PATH)/CompilationIndex.h \
+              $(COMMON_PATH)/CompileCommands.h $(COMMON_PATH)/CostModel.h \
+              $(COMMON_PATH)/EditRecorder.h $(COMMON_PATH)/Edits.h \
+              $(COMMON_PATH)/FileOverlay.h \
+              $(COMMON_PATH)/IncrementalCache.h \
+              $(COMMON_PATH)/ParallelTool.h $(COMMON_PATH)/ProcessedDecls.h \
+              $(COMMON_PATH)/RefactoringServer.h \
+              $(COMMON_PATH)/Shards.h \
+              $(COMMON_PATH)/SharedFileCache.h \
+              $(COMMON_PATH)/SharedPreamble.h \
+              $(COMMON_PATH)/SourceFiles.h $(COMMON_PATH)/SourceFilter.h \
+              $(COMMON_PATH)/ToolAction.h $(COMMON_PATH)/ToolDriver.h \
+              $(COMMON_PATH)/Trace.h \
+              $(COMMON_PATH)/TraversalStats.h $(COMMON_PATH)/WorkerPool.h
@@ -0,0 +1,82 @@
+#include "clang/AST/ASTConsumer.h"
+#include "llvm/Support/CommandLine.h"
+#include "AddOverrideASTVisitor.h"
+#include "CombinedASTVisitor.h"
+#include "FixUnusedArgsASTVisitor.h"
+#include "ToolAction.h"
+#include "ToolDriver.h"
+#include <string>
+using namespace clang;
+using namespace llvm;
+
+cl::opt<bool> FixUnusedArgs(
+  "fix-unused-args",
+  cl::desc("Comment out the names of unused arguments"));
+cl::opt<bool> AddVirtualOverride(
+  "add-virtual-override",
+  cl::desc("Add implicit virtual and override to methods"));
+cl::opt<std::string> UnusedPrefix(
+  "unused-prefix",
+  cl::desc("Prefix for removing unused parameters"),
+  cl::init("/*"));
+cl::opt<std::string> UnusedSuffix(
+  "unused-suffix",
+  cl::desc("Suffix for removing unused parameters"),
+  cl::init("*/"));
+cl::opt<std::string> OverrideString(
+  "override",
+  cl::desc("Alternate override specifier, i.e. a macro."),
+  cl::init("override"));
+
+typedef CombinedASTVisitor<FixUnusedArgsASTVisitor, AddOverrideASTVisitor>
+  AllTransformsASTVisitor;
+
+// Runs every enabled transform in one traversal of each parse, and records
+// all of their changes with the same recorder.
+class CleanupTool : public ToolDefinition {
+public:
+  // Without any transforms named on the command line, all of them are run.
+  virtual void validateOptions() {
+    if (FixUnusedArgs || AddVirtualOverride) return;
+    FixUnusedArgs = true;
+    AddVirtualOverride = true;
+  }
+
+  virtual std::string getConfig() const {
+    std::string Config;
+    if (FixUnusedArgs) {
+      Config += std::string("fix-unused-args\0", 16) + UnusedPrefix + '\0'
+              + UnusedSuffix + '\0';
+    }
+    if (AddVirtualOverride) {
+      Config += std::string("add-virtual-override\0", 21) + OverrideString;
+    }
+    return Config;
+  }
+
+  virtual ASTConsumer *createConsumer(const SourceManager &SM,
+                                      const SourceFilterOptions &FilterOpts,
+                                      ProcessedDeclSet *ProcessedDecls,
+                                      EditRecorder &Recorder) const {
+    if (!AddVirtualOverride) {
+      return new FilteredASTConsumer<FixUnusedArgsASTVisitor>(
+          "FixUnusedArgsASTVisitor", SM, FilterOpts, ProcessedDecls,
+          Recorder, UnusedPrefix, UnusedSuffix);
+    }
+    if (!FixUnusedArgs) {
+      return new FilteredASTConsumer<AddOverrideASTVisitor>(
+          "AddOverrideASTVisitor", SM, FilterOpts, ProcessedDecls,
+          Recorder, OverrideString);
+    }
+    return new FilteredASTConsumer<AllTransformsASTVisitor>(
+        "FixUnusedArgsASTVisitor+AddOverrideASTVisitor",
+        SM, FilterOpts, ProcessedDecls,
+        FixUnusedArgsASTVisitor(Recorder, UnusedPrefix, UnusedSuffix),
+        AddOverrideASTVisitor(Recorder, OverrideString));
+  }
+};
+
+int main(int argc, char **argv) {
+  CleanupTool Tool;
+  return RunTool(argc, argv, "cpp-cleanup", Tool);
+}
@@ -0,0 +1,96 @@
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+#include "Edits.h"
+#include "Extraction.h"
+#include "SourceFiles.h"
+#include <map>
+#include <sstream>
+using namespace llvm;
+using namespace std;
+
+vector<Extraction> ReadExtractionsFile(const string &Path) {
+  string Contents;
+  if (!ReadFileContents(Path, Contents)) {
+    report_fatal_error("Couldn't read the batch file " + Path + ".");
+  }
+
+  vector<Extraction> Extractions;
+  istringstream In(Contents);
+  string Line;
+  for (unsigned LineNumber = 1; getline(In, Line); ++LineNumber) {
+    istringstream Fields(Line);
+    string First;
+    if (!(Fields >> First) || First[0] == '#') continue;
+
+    Extraction E;
+    E.File = GetRealPath(First);
+    E.Path = GetAbsolutePath(First);
+    string Rest;
+    if (!(Fields >> E.FirstLine >> E.LastLine >> E.Name) || Fields >> Rest) {
+      report_fatal_error(Path + ":" + utostr(LineNumber) + ": Expected "
+                         "<file> <first line> <last line> <name>.");
+    }
+    Extractions.push_back(E);
+  }
+  return Extractions;
+}
+
+static void ReportRemoved(const Extraction &E, const string &Reason) {
+  errs() << E.File << ":" << E.FirstLine << "-" << E.LastLine << ": "
+         << Reason << " Not extracting " << E.Name << ".\n";
+}
+
+bool RemoveConflictingExtractions(vector<Extraction> &Extractions) {
+  vector<Extraction> Kept;
+  for (auto EI = Extractions.begin(), EE = Extractions.end();
+       EI != EE; ++EI) {
+    if (EI->FirstLine == 0 || EI->FirstLine > EI->LastLine) {
+      ReportRemoved(*EI, "The first line must be at least 1, and no later "
+                         "than the last line.");
+      continue;
+    }
+
+    bool Conflicts = false;
+    for (auto KI = Kept.begin(), KE = Kept.end(); KI != KE; ++KI) {
+      if (KI->File != EI->File) continue;
+
+      if (EI->FirstLine <= KI->LastLine && KI->FirstLine <= EI->LastLine) {
+        ReportRemoved(*EI, "Overlaps lines " + utostr(KI->FirstLine) + "-" +
+                           utostr(KI->LastLine) + ", which are extracted "
+                           "into " + KI->Name + ".");
+        Conflicts = true;
+        break;
+      }
+      if (EI->Name == KI->Name) {
+        ReportRemoved(*EI, "Lines " + utostr(KI->FirstLine) + "-" +
+                           utostr(KI->LastLine) + " are already extracted "
+                           "into a function with that name.");
+        Conflicts = true;
+        break;
+      }
+    }
+    if (!Conflicts) {
+      Kept.push_back(*EI);
+    }
+  }
+
+  const bool RemovedAny = Kept.size() != Extractions.size();
+  Extractions.swap(Kept);
+  return !RemovedAny;
+}
+
+vector<vector<Extraction> > GroupExtractionsByFile(
+    const vector<Extraction> &Extractions) {
+  vector<vector<Extraction> > Groups;
+  map<string, size_t> GroupIndices;
+  for (auto EI = Extractions.begin(), EE = Extractions.end();
+       EI != EE; ++EI) {
+    auto Inserted = GroupIndices.insert(make_pair(EI->File, Groups.size()));
+    if (Inserted.second) {
+      Groups.push_back(vector<Extraction>());
+    }
+    Groups[Inserted.first->second].push_back(*EI);
+  }
+  return Groups;
+}
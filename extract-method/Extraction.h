@@ -0,0 +1,42 @@
+#ifndef CPP_TOOLS_EXTRACT_METHOD_EXTRACTION_H
+#define CPP_TOOLS_EXTRACT_METHOD_EXTRACTION_H
+
+#include <string>
+#include <vector>
+
+// A range of lines of a file to extract into a new function.
+struct Extraction {
+  // The file's real path, as given by GetRealPath(), so that the same file
+  // is only parsed once and checked for conflicts against itself, however
+  // it was named.
+  std::string File;
+  // The file as it was named, made absolute, which is how the compilation
+  // database knows it if it's reached through a symlink.
+  std::string Path;
+  unsigned FirstLine;
+  unsigned LastLine;
+  // Name of the new function to create.
+  std::string Name;
+};
+
+// Reads the extractions in a batch file, which has one per line:
+//
+//   <file> <first line> <last line> <new function name>
+//
+// Blank lines and lines starting with '#' are ignored. Reports a fatal error
+// if the file can't be read or has a malformed line.
+std::vector<Extraction> ReadExtractionsFile(const std::string &Path);
+
+// Removes the extractions that can't be made: ones with invalid line
+// numbers, ones whose lines overlap those of an earlier extraction from the
+// same file, and ones whose new function has the same name as that of an
+// earlier one in the same file. Reports each one that's removed, and returns
+// whether there were none.
+bool RemoveConflictingExtractions(std::vector<Extraction> &Extractions);
+
+// Groups the extractions by file, keeping the files in the order they first
+// appear in, so that each file only has to be parsed once.
+std::vector<std::vector<Extraction> > GroupExtractionsByFile(
+    const std::vector<Extraction> &Extractions);
+
+#endif
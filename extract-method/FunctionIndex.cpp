@@ -0,0 +1,179 @@
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/DeclTemplate.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Lexer.h"
+#include "FunctionIndex.h"
+#include "LineTable.h"
+#include <algorithm>
+#include <utility>
+using namespace clang;
+using namespace llvm;
+
+// Lexes the next token. Returns false at the end of the file, and at
+// preprocessor directives, which could hide braces or add more.
+static bool LexRawToken(Lexer &Lex, Token &Tok) {
+  Lex.LexFromRawLexer(Tok);
+  return !Tok.is(tok::eof) && !(Tok.is(tok::hash) && Tok.isAtStartOfLine());
+}
+
+static bool IsOpeningBracket(const Token &Tok) {
+  return Tok.is(tok::l_paren) || Tok.is(tok::l_brace) ||
+         Tok.is(tok::l_square);
+}
+
+static bool IsClosingBracket(const Token &Tok) {
+  return Tok.is(tok::r_paren) || Tok.is(tok::r_brace) ||
+         Tok.is(tok::r_square);
+}
+
+static bool IsRawIdentifier(const Token &Tok, StringRef Name) {
+  return Tok.is(tok::raw_identifier) &&
+         StringRef(Tok.getRawIdentifierData(), Tok.getLength()) == Name;
+}
+
+// With Tok on an opening bracket, lexes up to the bracket that closes it.
+static bool SkipBrackets(Lexer &Lex, Token &Tok) {
+  unsigned Depth = 0;
+  do {
+    if (IsOpeningBracket(Tok)) {
+      ++Depth;
+    } else if (IsClosingBracket(Tok) && --Depth == 0) {
+      return true;
+    }
+  } while (LexRawToken(Lex, Tok));
+  return false;
+}
+
+bool FindFunctionBodyEnd(const SourceManager &SM,
+                         const LangOptions &LangOpts,
+                         const Decl *D,
+                         unsigned &BodyEnd) {
+  const SourceLocation DeclaratorEnd = D->getSourceRange().getEnd();
+  if (DeclaratorEnd.isInvalid() || !DeclaratorEnd.isFileID()) return false;
+
+  const std::pair<FileID, unsigned> Decomposed =
+      SM.getDecomposedLoc(DeclaratorEnd);
+  bool Invalid = false;
+  const StringRef Buffer = SM.getBufferData(Decomposed.first, &Invalid);
+  if (Invalid) return false;
+  Lexer Lex(SM.getLocForStartOfFile(Decomposed.first), LangOpts,
+            Buffer.begin(), Buffer.begin() + Decomposed.second,
+            Buffer.end());
+
+  // The first token is the last one of the declarator.
+  Token Tok;
+  if (!LexRawToken(Lex, Tok) || !LexRawToken(Lex, Tok)) return false;
+
+  // Virt-specifiers and attributes, which may well be macros.
+  while (Tok.is(tok::raw_identifier) && !IsRawIdentifier(Tok, "try")) {
+    if (!LexRawToken(Lex, Tok)) return false;
+    if (Tok.is(tok::l_paren) &&
+        (!SkipBrackets(Lex, Tok) || !LexRawToken(Lex, Tok))) {
+      return false;
+    }
+  }
+
+  const bool IsTryBlock = IsRawIdentifier(Tok, "try");
+  if (IsTryBlock && !LexRawToken(Lex, Tok)) return false;
+
+  // Braces that follow the name of a member or base in a constructor's
+  // initializers initialize it. Any other brace starts the body.
+  if (Tok.is(tok::colon)) {
+    Token Prev = Tok;
+    for (;;) {
+      if (!LexRawToken(Lex, Tok)) return false;
+      if (Tok.is(tok::l_brace) && !Prev.is(tok::raw_identifier) &&
+          !Prev.is(tok::greater)) {
+        break;
+      }
+      if (IsOpeningBracket(Tok) && !SkipBrackets(Lex, Tok)) return false;
+      Prev = Tok;
+    }
+  }
+
+  if (!Tok.is(tok::l_brace) || !SkipBrackets(Lex, Tok)) return false;
+  BodyEnd = SM.getFileOffset(Tok.getLocation());
+
+  // The handlers of a function-try-block are part of the function too.
+  while (IsTryBlock && LexRawToken(Lex, Tok) &&
+         IsRawIdentifier(Tok, "catch")) {
+    if (!LexRawToken(Lex, Tok) || !Tok.is(tok::l_paren) ||
+        !SkipBrackets(Lex, Tok)) {
+      return false;
+    }
+    if (!LexRawToken(Lex, Tok) || !Tok.is(tok::l_brace) ||
+        !SkipBrackets(Lex, Tok)) {
+      return false;
+    }
+    BodyEnd = SM.getFileOffset(Tok.getLocation());
+  }
+  return true;
+}
+
+void FunctionIndex::addDecl(Decl *D) {
+  if (D->isImplicit()) return;
+  const SourceLocation Loc = SM.getExpansionLoc(D->getLocStart());
+  if (SM.getFileID(Loc) != FID) return;
+
+  if (TemplateDecl *TD = dyn_cast<TemplateDecl>(D)) {
+    if (TD->getTemplatedDecl()) addDecl(TD->getTemplatedDecl());
+    return;
+  }
+  // Code can't be extracted out of a lambda into a method.
+  if (CXXRecordDecl *RD = dyn_cast<CXXRecordDecl>(D)) {
+    if (RD->isLambda()) return;
+  }
+  if (FunctionDecl *FD = dyn_cast<FunctionDecl>(D)) {
+    addFunction(FD);
+  }
+
+  // Methods are in classes and namespaces, and local classes in functions.
+  if (DeclContext *DC = dyn_cast<DeclContext>(D)) {
+    for (auto DI = DC->decls_begin(), DE = DC->decls_end(); DI != DE; ++DI) {
+      addDecl(*DI);
+    }
+  }
+}
+
+void FunctionIndex::addFunction(FunctionDecl *FD) {
+  // Functions whose bodies were skipped don't have any.
+  if (!FD->doesThisDeclarationHaveABody() || FD->isLateTemplateParsed()) {
+    return;
+  }
+
+  const SourceRange Range = FD->getSourceRange();
+  const std::pair<FileID, unsigned> Begin =
+      SM.getDecomposedLoc(SM.getExpansionLoc(Range.getBegin()));
+  const std::pair<FileID, unsigned> End =
+      SM.getDecomposedLoc(SM.getExpansionRange(Range.getEnd()).second);
+  if (Begin.first != FID || End.first != FID) return;
+
+  const Entry E = { Lines.getLineStartForOffset(Begin.second), End.second,
+                    FD };
+  if (!Entries.empty() && E < Entries.back()) {
+    Sorted = false;
+  }
+  Entries.push_back(E);
+}
+
+FunctionDecl *FunctionIndex::findEnclosing(unsigned BeginOffset,
+                                           unsigned EndOffset) {
+  if (!Sorted) {
+    std::sort(Entries.begin(), Entries.end());
+    Sorted = true;
+  }
+
+  // Functions either nest or don't overlap, so of the ones that start on or
+  // before the first line, the last one that reaches the last line is the
+  // innermost.
+  auto EI = std::upper_bound(Entries.begin(), Entries.end(), BeginOffset,
+                             [](unsigned Offset, const Entry &E) {
+                               return Offset < E.Begin;
+                             });
+  while (EI != Entries.begin()) {
+    --EI;
+    if (EI->End >= EndOffset) return EI->FD;
+  }
+  return 0;
+}
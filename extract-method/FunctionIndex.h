@@ -0,0 +1,68 @@
+#ifndef CPP_TOOLS_EXTRACT_METHOD_FUNCTION_INDEX_H
+#define CPP_TOOLS_EXTRACT_METHOD_FUNCTION_INDEX_H
+
+#include "clang/Basic/SourceLocation.h"
+#include <vector>
+
+namespace clang {
+class Decl;
+class FunctionDecl;
+class LangOptions;
+class SourceManager;
+}
+class LineTable;
+
+// Finds the end of the body of a function whose declarator has been parsed
+// but whose body hasn't, by lexing the file from the end of the declarator
+// and matching braces. Sets BodyEnd to the offset of the closing brace.
+// Returns false if the end can't be told without preprocessing, e.g. when
+// there's a directive in the body.
+bool FindFunctionBodyEnd(const clang::SourceManager &SM,
+                         const clang::LangOptions &LangOpts,
+                         const clang::Decl *D,
+                         unsigned &BodyEnd);
+
+// The functions defined in one file, including methods defined in classes
+// and in namespaces, indexed by the file offsets they span, so that the
+// innermost one containing a range of lines can be looked up.
+class FunctionIndex {
+public:
+  FunctionIndex(const clang::SourceManager &SM, const LineTable &Lines)
+    : SM(SM)
+    , Lines(Lines)
+    , FID(Lines.getFileID())
+    , Sorted(true)
+  {}
+
+  // Adds the function definitions in the file under D.
+  void addDecl(clang::Decl *D);
+
+  // Returns the innermost function that spans every line from the one that
+  // starts at BeginOffset to the one that starts at EndOffset, or null.
+  clang::FunctionDecl *findEnclosing(unsigned BeginOffset,
+                                     unsigned EndOffset);
+
+private:
+  struct Entry {
+    // Offset of the start of the first line of the function.
+    unsigned Begin;
+    // Offset of its closing brace.
+    unsigned End;
+    clang::FunctionDecl *FD;
+
+    // Functions that start on the same line are ordered outermost first.
+    bool operator<(const Entry &RHS) const {
+      return Begin < RHS.Begin || (Begin == RHS.Begin && End > RHS.End);
+    }
+  };
+
+  const clang::SourceManager &SM;
+  const LineTable &Lines;
+  const clang::FileID FID;
+  std::vector<Entry> Entries;
+  bool Sorted;
+
+  void addFunction(clang::FunctionDecl *FD);
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "clang/Basic/SourceManager.h"
+#include "LineTable.h"
+#include <algorithm>
+#include <cctype>
+#include <string.h>
+using namespace clang;
+using namespace llvm;
+
+static const char *FindChar(const char *Begin, const char *End, char C) {
+  return static_cast<const char*>(memchr(Begin, C, End - Begin));
+}
+
+LineTable::LineTable(const SourceManager &SM, FileID FID)
+  : FID(FID)
+  , FileStart(SM.getLocForStartOfFile(FID))
+  , HasCarriageReturns(false) {
+  bool Invalid = false;
+  Buffer = SM.getBufferData(FID, &Invalid);
+  if (Invalid) Buffer = StringRef();
+
+  LineStarts.push_back(0);
+  if (Buffer.empty()) return;
+  const char *const Begin = Buffer.begin(), *const End = Buffer.end();
+  HasCarriageReturns = FindChar(Begin, End, '\r') != 0;
+
+  // memchr() goes through the buffer a word or a vector at a time, which
+  // only works for one kind of line ending.
+  if (!HasCarriageReturns) {
+    for (const char *P = Begin; (P = FindChar(P, End, '\n')); ) {
+      LineStarts.push_back(++P - Begin);
+    }
+    return;
+  }
+
+  for (const char *P = Begin; P != End; ++P) {
+    if (*P == '\r') {
+      if (P + 1 != End && P[1] == '\n') ++P;
+    } else if (*P != '\n') {
+      continue;
+    }
+    LineStarts.push_back(P + 1 - Begin);
+  }
+}
+
+unsigned LineTable::getLineStart(unsigned Line) const {
+  assert(Line > 0 && "Lines are counted from 1");
+  if (Line > LineStarts.size()) return Buffer.size();
+  return LineStarts[Line - 1];
+}
+
+unsigned LineTable::getLineStartForOffset(unsigned Offset) const {
+  auto LI = std::upper_bound(LineStarts.begin(), LineStarts.end(), Offset);
+  return *--LI;
+}
+
+unsigned LineTable::findLineEnding(unsigned Offset) const {
+  if (Offset >= Buffer.size()) return Buffer.size();
+  const char *Begin = Buffer.begin() + Offset;
+  const char *LineEnding = FindChar(Begin, Buffer.end(), '\n');
+  if (HasCarriageReturns) {
+    const char *CR = FindChar(Begin, LineEnding ? LineEnding : Buffer.end(),
+                              '\r');
+    if (CR) LineEnding = CR;
+  }
+  return LineEnding ? LineEnding - Buffer.begin() : Buffer.size();
+}
+
+unsigned LineTable::findNotLineEnding(unsigned Offset) const {
+  while (Offset < Buffer.size() &&
+         (Buffer[Offset] == '\n' || Buffer[Offset] == '\r')) {
+    ++Offset;
+  }
+  return std::min<unsigned>(Offset, Buffer.size());
+}
+
+unsigned LineTable::findNotSpace(unsigned Offset) const {
+  while (Offset < Buffer.size() &&
+         std::isspace(static_cast<unsigned char>(Buffer[Offset]))) {
+    ++Offset;
+  }
+  return std::min<unsigned>(Offset, Buffer.size());
+}
@@ -0,0 +1,55 @@
+#ifndef CPP_TOOLS_EXTRACT_METHOD_LINE_TABLE_H
+#define CPP_TOOLS_EXTRACT_METHOD_LINE_TABLE_H
+
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/StringRef.h"
+#include <vector>
+
+namespace clang {
+class SourceManager;
+}
+
+// The offsets at which the lines of a file start, found with one scan of
+// its buffer, along with scans for the characters that end and start
+// lines. Lets ranges of lines be worked out without asking the
+// SourceManager about every line or character. Lines end at "\n", "\r\n"
+// or a lone "\r", like they do for the SourceManager.
+class LineTable {
+public:
+  LineTable(const clang::SourceManager &SM, clang::FileID FID);
+
+  clang::FileID getFileID() const { return FID; }
+  unsigned getNumLines() const { return LineStarts.size(); }
+
+  // Returns the offset of the start of a line, counting from 1, or the size
+  // of the file for lines past its end.
+  unsigned getLineStart(unsigned Line) const;
+  // Returns the offset of the start of the line that an offset is on.
+  unsigned getLineStartForOffset(unsigned Offset) const;
+
+  // Each of these returns the offset of the first character at or after
+  // an offset that is a line ending, that isn't one, or that isn't
+  // whitespace, respectively, or the size of the file if there's none.
+  unsigned findLineEnding(unsigned Offset) const;
+  unsigned findNotLineEnding(unsigned Offset) const;
+  unsigned findNotSpace(unsigned Offset) const;
+
+  // Converts between offsets and locations in the file. Locations have to
+  // be file locations in it.
+  clang::SourceLocation getLocation(unsigned Offset) const {
+    return FileStart.getLocWithOffset(Offset);
+  }
+  unsigned getOffset(clang::SourceLocation Loc) const {
+    return Loc.getRawEncoding() - FileStart.getRawEncoding();
+  }
+
+private:
+  const clang::FileID FID;
+  const clang::SourceLocation FileStart;
+  llvm::StringRef Buffer;
+  // Whether there are any "\r"s, which memchr() for "\n" alone misses.
+  bool HasCarriageReturns;
+  std::vector<unsigned> LineStarts;
+};
+
+#endif
@@ -4,57 +4,32 @@
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Rewrite/Rewriter.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "LineTable.h"
 #include "MethodExtractor.h"
-#include <cctype>
+#include "TraversalStats.h"
+#include <algorithm>
 #include <iterator>
 #include <map>
 #include <sstream>
-#include <set>
 #include <utility>
+#include <vector>
 using namespace clang;
 using namespace std;
 
-// Advances a source location until some predicate is true on the first
-// character that it corresponds to.
-template <class Pred>
-static SourceLocation AdvanceSourceLocationUntil(SourceLocation SL,
-                                                 const SourceManager &SM,
-                                                 Pred pred) {
-  for (bool Invalid = false;;) {
-    const char* CharData = SM.getCharacterData(SL, &Invalid);
-    if (Invalid) break;
-    if (pred(*CharData)) break;
-    SL = SL.getLocWithOffset(1);
-  }
-
-  assert(SL.isValid());
-  return SL;
-}
-
-static bool IsNotSpace(char c) { return !std::isspace(c); }
-static bool IsLineEnding(char c) { return c == '\n' || c == '\r'; }
-static bool IsNotLineEnding(char c) { return !IsLineEnding(c); }
-
-// Takes two line numbers and a file ID, and returns the corresponding
-// source range.
-static SourceRange GetSourceRangeForLines(SourceManager &SM,
-                                          FileID FID,
+// Takes two line numbers, and returns the source range from the start of
+// the first line to the last character of the last one.
+static SourceRange GetSourceRangeForLines(const LineTable &Lines,
                                           unsigned FirstLine,
                                           unsigned LastLine) {
   assert(FirstLine <= LastLine);
 
-  SourceLocation StartLoc = SM.translateLineCol(FID, FirstLine, /*Col*/1);
-  assert(StartLoc.isValid());
-
-  // Advance the end location until the end of the line is hit.
-  SourceLocation EndLoc = SM.translateLineCol(FID, LastLine, /*Col*/1);
-  EndLoc = AdvanceSourceLocationUntil(EndLoc, SM, IsLineEnding);
-  EndLoc = EndLoc.getLocWithOffset(-1);
-  assert(EndLoc.isValid());
+  const unsigned Begin = Lines.getLineStart(FirstLine);
+  const unsigned End = Lines.findLineEnding(Lines.getLineStart(LastLine));
+  assert(Begin + 1 < End);
 
-  assert(SM.isBeforeInTranslationUnit(StartLoc, EndLoc));
-
-  return SourceRange(StartLoc, EndLoc);
+  return SourceRange(Lines.getLocation(Begin), Lines.getLocation(End - 1));
 }
 
 // Returns a string containing all the source code from the given source range.
@@ -74,17 +49,14 @@ static StringRef GetSourceRangeAsString(const SourceManager &SM,
 // level is preserved.
 static void ReplaceSourceRangeWithCode(const SourceRange &Range,
                                        const string& NewCode,
-                                       const SourceManager &SourceMgr,
+                                       const LineTable &Lines,
                                        Rewriter &TheRewriter) {
   // The range should skip all leading whitespace, and extend all the
   // way until the end of the line.
   SourceRange SkipLeadingWhitespace(
-      AdvanceSourceLocationUntil(Range.getBegin(),
-                                 SourceMgr,
-                                 IsNotSpace),
-      AdvanceSourceLocationUntil(Range.getEnd(),
-                                 SourceMgr,
-                                 IsLineEnding));
+      Lines.getLocation(Lines.findNotSpace(Lines.getOffset(Range.getBegin()))),
+      Lines.getLocation(
+          Lines.findLineEnding(Lines.getOffset(Range.getEnd()))));
   TheRewriter.ReplaceText(SkipLeadingWhitespace, NewCode);
 }
 
@@ -108,17 +80,39 @@ static void InsertNewFunctionWithBody(Decl &BeforeDecl,
 }
 
 namespace {
-  // Searches for all DeclRefs in a given source range.
+  // A use of a decl in the source range, along with its offset in the
+  // range's file.
+  struct DeclUse {
+    unsigned Offset;
+    Expr *Use;
+    DeclaratorDecl *D;
+  };
+
+  // Searches for all DeclRefs in a given source range. Only the statements
+  // that overlap the range are traversed, and everything is compared by
+  // its offset in the range's file, so the cost depends on the size of the
+  // range rather than the size of the function it's in.
   class DeclRefFinder : public RecursiveASTVisitor<DeclRefFinder> {
   public:
     DeclRefFinder(const SourceRange &Range,
                   const SourceManager &SourceMgr)
-      : Range(Range)
-      , SourceMgr(SourceMgr)
+      : SourceMgr(SourceMgr)
       , FID(SourceMgr.getFileID(Range.getBegin()))
-      , FoundDecls(order_decl_by_location(&SourceMgr))
+      , BeginOffset(SourceMgr.getFileOffset(Range.getBegin()))
+      , EndOffset(SourceMgr.getFileOffset(Range.getEnd()))
     {}
 
+    bool TraverseStmt(Stmt *S) {
+      if (!shouldTraverseStmt(S)) return true;
+      return RecursiveASTVisitor<DeclRefFinder>::TraverseStmt(S);
+    }
+
+    // Nothing outside of the range is of interest, and neither is anything
+    // inside a statement that's outside of it.
+    bool shouldTraverseStmt(Stmt *S) const {
+      return !S || MayOverlapRange(S);
+    }
+
     bool VisitDeclRefExpr(DeclRefExpr *DRE) {
       if (!IsExprInRange(DRE)) return true;
 
@@ -143,55 +137,106 @@ namespace {
       return true;
     }
 
+    // Puts the found decls in declaration order, and the uses in the order
+    // they appear in. Must be called after the traversal, before the
+    // results are used.
+    void SortByLocation() {
+      vector<unsigned> Order(FoundDecls.size());
+      for (unsigned I = 0, E = Order.size(); I != E; ++I) Order[I] = I;
+      order_decl_by_location Compare(SourceMgr, FID);
+      stable_sort(Order.begin(), Order.end(),
+                  [&](unsigned L, unsigned R) {
+                    return Compare(FoundDecls[L], FoundDecls[R]);
+                  });
+
+      vector<DeclaratorDecl*> SortedDecls;
+      vector<Expr*> SortedUses;
+      SortedDecls.reserve(Order.size());
+      SortedUses.reserve(Order.size());
+      for (auto OI = Order.begin(), OE = Order.end(); OI != OE; ++OI) {
+        SortedDecls.push_back(FoundDecls[*OI]);
+        SortedUses.push_back(FirstUses[*OI]);
+      }
+      FoundDecls.swap(SortedDecls);
+      FirstUses.swap(SortedUses);
+
+      // The traversal mostly finds uses in order already.
+      stable_sort(Uses.begin(), Uses.end(),
+                  [](const DeclUse &L, const DeclUse &R) {
+                    return L.Offset < R.Offset;
+                  });
+    }
+
   private:
-    const SourceRange Range;
     const SourceManager &SourceMgr;
     const FileID FID;
+    // Offsets in FID of the first and last characters of the range.
+    const unsigned BeginOffset, EndOffset;
 
+    // Orders decls by where they're declared. Decls in the range's file are
+    // compared by offset, and only the others need the SourceManager.
     struct order_decl_by_location {
-      const SourceManager *SourceMgr;
-      order_decl_by_location(const SourceManager *SourceMgr)
+      const SourceManager &SourceMgr;
+      const FileID FID;
+      order_decl_by_location(const SourceManager &SourceMgr, FileID FID)
         : SourceMgr(SourceMgr)
+        , FID(FID)
       {}
 
-      bool operator()( const Decl* lhs, const Decl* rhs ) {
-        return SourceMgr->isBeforeInTranslationUnit(lhs->getLocation(),
-                                                    rhs->getLocation());
+      bool operator()(const Decl* lhs, const Decl* rhs) const {
+        pair<FileID, unsigned> L =
+            SourceMgr.getDecomposedLoc(lhs->getLocation());
+        pair<FileID, unsigned> R =
+            SourceMgr.getDecomposedLoc(rhs->getLocation());
+        if (L.first == FID && R.first == FID) return L.second < R.second;
+        return SourceMgr.isBeforeInTranslationUnit(lhs->getLocation(),
+                                                   rhs->getLocation());
       }
     };
 
-    set<DeclaratorDecl*, order_decl_by_location> FoundDecls;
-    map<DeclaratorDecl*, Expr*> DeclExprMap;
-    map<Expr*, DeclaratorDecl*> UsesToDeclMap;
+    // The found decls, and the first use of each, in parallel.
+    vector<DeclaratorDecl*> FoundDecls;
+    vector<Expr*> FirstUses;
+    // Where each found decl is in FoundDecls.
+    llvm::DenseMap<DeclaratorDecl*, unsigned> FoundDeclIndices;
+    vector<DeclUse> Uses;
 
     // When we encounter a use of a decl, this updates our data structures.
     void AddFoundDecl(DeclaratorDecl *D, Expr *E) {
-      auto lb = FoundDecls.lower_bound(D);
-
-      // Only update the two containers that are keyed on the decl if
-      // this is a completely new decl. This preserves the invariant that
-      // we store the first use of a decl.
-      if (lb == FoundDecls.end() || FoundDecls.key_comp()(D, *lb)) {
-        FoundDecls.insert(lb, D);
-        DeclExprMap.insert(make_pair(D, E));
+      // Only add the decl if this is a completely new decl. This preserves
+      // the invariant that we store the first use of a decl.
+      auto Inserted = FoundDeclIndices.insert(
+          make_pair(D, unsigned(FoundDecls.size())));
+      if (Inserted.second) {
+        FoundDecls.push_back(D);
+        FirstUses.push_back(E);
       }
 
-      // Always update the map of uses, whether this is the first time we've
-      // seen this decl, or not.
-      UsesToDeclMap.insert(make_pair(E, D));
+      // Always add the use, whether this is the first time we've seen this
+      // decl, or not.
+      DeclUse Entry = { SourceMgr.getFileOffset(E->getLocStart()), E, D };
+      Uses.push_back(Entry);
     }
 
-
     bool IsExprInRange(Expr *E) const {
       SourceLocation Loc = E->getLocStart();
-      if (SourceMgr.getFileID(Loc) != FID) return false;
-      if (SourceMgr.isBeforeInTranslationUnit(Loc, Range.getBegin())) {
-        return false;
-      }
-      if (SourceMgr.isBeforeInTranslationUnit(Range.getEnd(), Loc)) {
-        return false;
-      }
-      return true;
+      if (!Loc.isFileID()) return false;
+      pair<FileID, unsigned> Decomposed = SourceMgr.getDecomposedLoc(Loc);
+      if (Decomposed.first != FID) return false;
+      return Decomposed.second >= BeginOffset
+          && Decomposed.second <= EndOffset;
+    }
+
+    // Returns false only if the statement is certainly outside the range.
+    bool MayOverlapRange(Stmt *S) const {
+      SourceLocation Begin = SourceMgr.getExpansionLoc(S->getLocStart());
+      SourceLocation End =
+          SourceMgr.getExpansionRange(S->getLocEnd()).second;
+      if (Begin.isInvalid() || End.isInvalid()) return true;
+      pair<FileID, unsigned> B = SourceMgr.getDecomposedLoc(Begin);
+      pair<FileID, unsigned> E = SourceMgr.getDecomposedLoc(End);
+      if (B.first != FID || E.first != FID) return true;
+      return B.second <= EndOffset && E.second >= BeginOffset;
     }
 
     // If the canonical decl is a declarator decl, returns that.
@@ -201,35 +246,19 @@ namespace {
       return dyn_cast<DeclaratorDecl>(CanDecl);
     }
   public:
-    // Set of all the decls that were found, ordered by declaration order.
-    typedef set<DeclaratorDecl*, order_decl_by_location> decl_set;
-    typedef decl_set::const_iterator decl_set_iterator;
-    decl_set_iterator found_decls_begin() const { return FoundDecls.begin(); }
-    decl_set_iterator found_decls_end() const { return FoundDecls.end(); }
-    const decl_set& found_decls() const { return FoundDecls; }
-
-    // Map from all found decls to the first usage of it as an expression.
-    typedef map<DeclaratorDecl*, Expr*> decl_expr_map;
-    typedef decl_expr_map::const_iterator decl_expr_map_iterator;
-    decl_expr_map_iterator decl_to_expr_begin() const {
-      return DeclExprMap.begin();
-    }
-    decl_expr_map_iterator decl_to_expr_end() const {
-      return DeclExprMap.end();
-    }
-    const decl_expr_map decl_to_expr() const { return DeclExprMap; }
-
-    // Map from all uses of found decls back to the decl. This is useful
-    // for rewriting all uses in the code.
-    typedef map<Expr*, DeclaratorDecl*> uses_to_decl_map;
-    typedef uses_to_decl_map::const_iterator uses_to_decl_map_iterator;
-    uses_to_decl_map_iterator uses_to_decl_begin() const {
-      return UsesToDeclMap.begin();
-    }
-    uses_to_decl_map_iterator uses_to_decl_end() const {
-      return UsesToDeclMap.end();
-    }
-    const uses_to_decl_map& uses_to_decl() const { return UsesToDeclMap; }
+    // All the decls that were found, ordered by declaration order.
+    typedef vector<DeclaratorDecl*>::const_iterator decl_iterator;
+    decl_iterator found_decls_begin() const { return FoundDecls.begin(); }
+    decl_iterator found_decls_end() const { return FoundDecls.end(); }
+    const vector<DeclaratorDecl*>& found_decls() const { return FoundDecls; }
+
+    // The first use of each found decl as an expression, in the same order
+    // as the found decls.
+    const vector<Expr*>& first_uses() const { return FirstUses; }
+
+    // All uses of found decls, along with the decl, in the order they
+    // appear in. This is useful for rewriting all uses in the code.
+    const vector<DeclUse>& uses_to_decl() const { return Uses; }
 
   };
 }
@@ -253,37 +282,40 @@ static string PrintAsReferenceType(DeclaratorDecl &DD,
 }
 
 // Takes a range of decls that should turn into a function declaration
-// formal parameter list, and builds that list.
-template <class DeclNameIterator>
-static string BuildFunctionDeclParameterList(DeclNameIterator BeginDecl,
-                                             DeclNameIterator EndDecl,
-                                             const SourceManager &SourceMgr) {
-  DeclNameIterator LastDecl = prev(EndDecl);
+// formal parameter list, along with their names, and builds that list.
+template <class DeclIterator>
+static string BuildFunctionDeclParameterList(
+    DeclIterator BeginDecl,
+    DeclIterator EndDecl,
+    const map<DeclaratorDecl*, std::string> &DeclNames,
+    const SourceManager &SourceMgr) {
+  DeclIterator LastDecl = prev(EndDecl);
   stringstream params;
 
   for (; BeginDecl != EndDecl; ++BeginDecl) {
+    auto Name = DeclNames.find(*BeginDecl);
+    assert(Name != DeclNames.end());
 
-    params << PrintAsReferenceType(*BeginDecl->first, SourceMgr) 
-           << " " << BeginDecl->second;
+    params << PrintAsReferenceType(**BeginDecl, SourceMgr) 
+           << " " << Name->second;
     if (BeginDecl != LastDecl) params << ", ";
   }
   return params.str();
 }
 
-// Takes a range of decls that should get passed as function arguments,
-// and builds the comma-separated list of arguments.
-template <class DeclExprIterator>
-static string BuildFunctionCallArgumentList(DeclExprIterator BeginDecl,
-                                            DeclExprIterator EndDecl,
+// Takes a range of expressions that should get passed as function
+// arguments, and builds the comma-separated list of arguments.
+template <class ExprIterator>
+static string BuildFunctionCallArgumentList(ExprIterator BeginExpr,
+                                            ExprIterator EndExpr,
                                             const SourceManager &SourceMgr) {
-  DeclExprIterator LastDecl = prev(EndDecl);
+  ExprIterator LastExpr = prev(EndExpr);
   stringstream args;
-  for (; BeginDecl != EndDecl; ++BeginDecl) {
-    Expr *UseExpr = BeginDecl->second;
-    SourceRange UseRange = UseExpr->getSourceRange();
+  for (; BeginExpr != EndExpr; ++BeginExpr) {
+    SourceRange UseRange = (*BeginExpr)->getSourceRange();
 
     args << GetSourceRangeAsString(SourceMgr, UseRange).str();
-    if (BeginDecl != LastDecl) args << ", ";
+    if (BeginExpr != LastExpr) args << ", ";
   }
   return args.str();
 }
@@ -365,36 +397,40 @@ MapDeclsToParamNames(DeclExprIterator BeginDecl,
 }
 
 // Rewrites all expressions using the given decls with their new names.
-void RewriteDeclUses(const map<Expr*, DeclaratorDecl*>& UsesMap,
-                     const map<DeclaratorDecl*, std::string>& NamesMap,
-                     Rewriter &R) {
+static void RewriteDeclUses(const vector<DeclUse>& Uses,
+                            const map<DeclaratorDecl*, std::string>& NamesMap,
+                            Rewriter &R) {
 
-  for (auto CurUse = UsesMap.begin(), EndUse = UsesMap.end();
+  for (auto CurUse = Uses.begin(), EndUse = Uses.end();
        CurUse != EndUse; ++CurUse) {
 
-    auto NewNameEntry = NamesMap.find(CurUse->second);
+    auto NewNameEntry = NamesMap.find(CurUse->D);
     assert(NewNameEntry != NamesMap.end());
-    R.ReplaceText(CurUse->first->getSourceRange(), NewNameEntry->second);
+    R.ReplaceText(CurUse->Use->getSourceRange(), NewNameEntry->second);
   }
 }
 
 void MethodExtractor::Run() {
   FileID FID = SourceMgr.getFileID(FnDecl.getSourceRange().getBegin());
-  SourceRange Range = GetSourceRangeForLines(SourceMgr,
-                                             FID,
-                                             FirstLine,
-                                             LastLine);
+  OwningPtr<LineTable> OwnLines;
+  if (!Lines || Lines->getFileID() != FID) {
+    OwnLines.reset(new LineTable(SourceMgr, FID));
+  }
+  const LineTable &FileLines = OwnLines.get() ? *OwnLines : *Lines;
+  SourceRange Range = GetSourceRangeForLines(FileLines, FirstLine, LastLine);
 
   // Find all references to declarations inside this source range.
   // We'll need to thread those through to the new function.
   DeclRefFinder Finder(Range, SourceMgr);
-  Finder.TraverseDecl(&FnDecl);
+  TraverseDeclWithStats("DeclRefFinder", SourceMgr, Finder, &FnDecl);
+  Finder.SortByLocation();
 
-  // Build the new function call, but don't use it yet.
+  // Build the new function call, but don't use it yet. The arguments are
+  // passed in declaration order.
   std::stringstream callstr;
   callstr << NewFunctionName << "("
-          << BuildFunctionCallArgumentList(Finder.decl_to_expr_begin(),
-                                           Finder.decl_to_expr_end(),
+          << BuildFunctionCallArgumentList(Finder.first_uses().begin(),
+                                           Finder.first_uses().end(),
                                            SourceMgr)
           << ");";
 
@@ -405,13 +441,13 @@ void MethodExtractor::Run() {
   // Create the new function with the extracted code as its body.
   // Again, don't use it yet.
   SourceRange SkipLeadingNewline(
-      AdvanceSourceLocationUntil(Range.getBegin(),
-                                 SourceMgr,
-                                 IsNotLineEnding),
+      FileLines.getLocation(
+          FileLines.findNotLineEnding(FileLines.getOffset(Range.getBegin()))),
       Range.getEnd());
   const string NewFunctionParamList = 
-      BuildFunctionDeclParameterList(DeclNames.begin(),
-                                     DeclNames.end(),
+      BuildFunctionDeclParameterList(Finder.found_decls_begin(),
+                                     Finder.found_decls_end(),
+                                     DeclNames,
                                      SourceMgr);
 
   // Rewrite all uses of the decls that we're threading through, as
@@ -424,7 +460,7 @@ void MethodExtractor::Run() {
       TheRewriter.getRewrittenText(SkipLeadingNewline);
 
   // Finally, perform all the replacements.
-  ReplaceSourceRangeWithCode(Range, callstr.str(), SourceMgr, TheRewriter);
+  ReplaceSourceRangeWithCode(Range, callstr.str(), FileLines, TheRewriter);
   InsertNewFunctionWithBody(FnDecl,
                             NewFunctionName,
                             NewFunctionParamList,
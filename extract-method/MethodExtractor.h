@@ -1,3 +1,5 @@
+class LineTable;
+
 class MethodExtractor {
 public:
   MethodExtractor(clang::FunctionDecl &FnDecl,
@@ -5,13 +7,15 @@ public:
                   clang::Rewriter &TheRewriter,
                   unsigned FirstLine,
                   unsigned LastLine,
-                  std::string NewFunctionName)
+                  std::string NewFunctionName,
+                  const LineTable *Lines = 0)
     : FnDecl(FnDecl)
     , SourceMgr(SourceMgr)
     , TheRewriter(TheRewriter)
     , FirstLine(FirstLine)
     , LastLine(LastLine)
     , NewFunctionName(std::move(NewFunctionName))
+    , Lines(Lines)
   {}
 
   void Run();
@@ -21,5 +25,7 @@ private:
   clang::Rewriter &TheRewriter;
   const unsigned FirstLine, LastLine;
   const std::string NewFunctionName;
+  // Line starts of the function's file, if the caller already has them.
+  const LineTable *Lines;
 };
 
@@ -0,0 +1,266 @@
+// Microbenchmarks for the stages of MethodExtractor::Run. The stages are
+// static functions and classes private to MethodExtractor.cpp, so it's
+// included here rather than linked in.
+#include "MethodExtractor.cpp"
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+using namespace clang::tooling;
+using namespace llvm;
+
+cl::list<unsigned> LineCounts(
+  "lines",
+  cl::desc("Lengths of the function to extract from, in lines"),
+  cl::CommaSeparated);
+cl::list<unsigned> DeclCounts(
+  "decls",
+  cl::desc("Numbers of decls the extracted code refers to"),
+  cl::CommaSeparated);
+cl::opt<double> MinSeconds(
+  "min-time",
+  cl::desc("Minimum time to run each stage for, in seconds"),
+  cl::init(0.2));
+cl::opt<bool> JSONOutput(
+  "json",
+  cl::desc("Print one line of JSON per measurement instead of a table"));
+
+// Name of the function that's extracted from.
+static const char *const FunctionName = "extract_me";
+
+// A generated input, and the lines to extract from it.
+struct BenchmarkInput {
+  std::string Code;
+  unsigned FirstLine, LastLine;
+};
+
+// Generates a method that's NumLines long, whose body refers to NumDecls
+// decls: a quarter of them fields, used through "this->", and the rest
+// locals. Some of the locals have the same names as fields, so that the
+// parameter names have to be uniqued. The lines after the declarations of
+// the locals are extracted.
+static BenchmarkInput GenerateInput(unsigned NumLines, unsigned NumDecls) {
+  const unsigned NumFields = std::max(1u, NumDecls / 4);
+  const unsigned NumLocals = std::max(1u, NumDecls - NumFields);
+
+  std::string Code = "struct Extract {\n";
+  for (unsigned I = 0; I < NumFields; ++I) {
+    Code += "  int v" + utostr(I) + ";\n";
+  }
+  Code += "  void " + std::string(FunctionName) + "(int input);\n};\n";
+  unsigned Line = NumFields + 3;
+
+  Code += "void Extract::" + std::string(FunctionName) + "(int input) {\n";
+  ++Line;
+  for (unsigned I = 0; I < NumLocals; ++I) {
+    Code += "  int v" + utostr(I) + " = input;\n";
+    ++Line;
+  }
+
+  BenchmarkInput Input;
+  Input.FirstLine = Line + 1;
+  const unsigned BodyLines =
+      NumLines > NumLocals + 2 ? NumLines - NumLocals - 2 : 1;
+  for (unsigned I = 0; I < BodyLines; ++I) {
+    // Go through the locals and the fields in order, so that every one of
+    // them is referred to when there are enough lines.
+    const unsigned Local = I % NumLocals;
+    const unsigned Field = (I / 2) % NumFields;
+    Code += "  v" + utostr(Local) + " = v" + utostr((Local + 1) % NumLocals)
+          + " + this->v" + utostr(Field) + ";\n";
+    ++Line;
+  }
+  Input.LastLine = Line;
+  Code += "}\n";
+
+  Input.Code = Code;
+  return Input;
+}
+
+// Runs a stage repeatedly for at least MinSeconds, and returns the average
+// time of a run in microseconds.
+static double TimeStage(const std::function<void()> &Stage) {
+  typedef std::chrono::steady_clock Clock;
+  unsigned Runs = 0;
+  const Clock::time_point Start = Clock::now();
+  Clock::duration Elapsed;
+  do {
+    Stage();
+    ++Runs;
+    Elapsed = Clock::now() - Start;
+  } while (Elapsed < std::chrono::duration<double>(MinSeconds));
+  return std::chrono::duration<double, std::micro>(Elapsed).count() / Runs;
+}
+
+static void Report(unsigned Lines, unsigned Decls, const char *Stage,
+                   double Microseconds) {
+  if (JSONOutput) {
+    outs() << "{\"lines\":" << Lines << ",\"decls\":" << Decls
+           << ",\"stage\":\"" << Stage << "\",\"microseconds\":"
+           << format("%.3f", Microseconds) << "}\n";
+  } else {
+    outs() << format("%8u %8u  %-28s %14.3f\n",
+                     Lines, Decls, Stage, Microseconds);
+  }
+}
+
+// Times each stage of MethodExtractor::Run on the function in the main
+// file once it's been parsed.
+class BenchmarkASTConsumer : public ASTConsumer {
+public:
+  BenchmarkASTConsumer(SourceManager &SM,
+                       const LangOptions &LangOpts,
+                       unsigned Lines,
+                       unsigned Decls,
+                       const BenchmarkInput &Input)
+    : SM(SM)
+    , LangOpts(LangOpts)
+    , Lines(Lines)
+    , Decls(Decls)
+    , Input(Input)
+  {}
+
+  virtual void HandleTranslationUnit(ASTContext &Context) {
+    FunctionDecl *FD = findFunction(Context);
+    if (!FD) {
+      errs() << "Couldn't find " << FunctionName << " in the input.\n";
+      return;
+    }
+    const FileID FID = SM.getMainFileID();
+
+    Report(Lines, Decls, "LineTable", TimeStage([&] {
+      LineTable Table(SM, FID);
+    }));
+
+    const LineTable Table(SM, FID);
+    SourceRange Range;
+    Report(Lines, Decls, "GetSourceRangeForLines", TimeStage([&] {
+      Range = GetSourceRangeForLines(Table, Input.FirstLine, Input.LastLine);
+    }));
+
+    // Scan every line of the extracted range for its ending.
+    const unsigned RangeEnd = Table.getOffset(Range.getEnd());
+    Report(Lines, Decls, "LineTable::findLineEnding", TimeStage([&] {
+      unsigned Offset = Table.getOffset(Range.getBegin());
+      while (Offset < RangeEnd) {
+        Offset = Table.findLineEnding(Offset) + 1;
+      }
+    }));
+
+    Report(Lines, Decls, "DeclRefFinder", TimeStage([&] {
+      DeclRefFinder Finder(Range, SM);
+      Finder.TraverseDecl(FD);
+      Finder.SortByLocation();
+    }));
+
+    DeclRefFinder Finder(Range, SM);
+    Finder.TraverseDecl(FD);
+    Finder.SortByLocation();
+
+    map<DeclaratorDecl*, std::string> DeclNames;
+    Report(Lines, Decls, "MapDeclsToParamNames", TimeStage([&] {
+      DeclNames = MapDeclsToParamNames(Finder.found_decls_begin(),
+                                       Finder.found_decls_end());
+    }));
+
+    Report(Lines, Decls, "RewriteDeclUses", TimeStage([&] {
+      Rewriter R(SM, LangOpts);
+      RewriteDeclUses(Finder.uses_to_decl(), DeclNames, R);
+    }));
+
+    Report(Lines, Decls, "MethodExtractor::Run", TimeStage([&] {
+      Rewriter R(SM, LangOpts);
+      MethodExtractor(*FD, SM, R, Input.FirstLine, Input.LastLine,
+                      "extracted", &Table).Run();
+    }));
+  }
+
+private:
+  SourceManager &SM;
+  const LangOptions &LangOpts;
+  const unsigned Lines, Decls;
+  const BenchmarkInput &Input;
+
+  FunctionDecl *findFunction(ASTContext &Context) {
+    TranslationUnitDecl *TU = Context.getTranslationUnitDecl();
+    for (auto DI = TU->decls_begin(), DE = TU->decls_end(); DI != DE; ++DI) {
+      FunctionDecl *FD = dyn_cast<FunctionDecl>(*DI);
+      if (FD && FD->getNameAsString() == FunctionName && FD->hasBody()) {
+        return FD;
+      }
+    }
+    return 0;
+  }
+};
+
+class BenchmarkAction : public ASTFrontendAction {
+public:
+  BenchmarkAction(unsigned Lines,
+                  unsigned Decls,
+                  const BenchmarkInput &Input)
+    : Lines(Lines)
+    , Decls(Decls)
+    , Input(Input)
+    {}
+
+  virtual clang::ASTConsumer *CreateASTConsumer(
+    clang::CompilerInstance &Compiler, llvm::StringRef InFile) {
+    return new BenchmarkASTConsumer(Compiler.getSourceManager(),
+                                    Compiler.getLangOpts(),
+                                    Lines,
+                                    Decls,
+                                    Input);
+  }
+
+private:
+  const unsigned Lines, Decls;
+  const BenchmarkInput &Input;
+};
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv);
+
+  std::vector<unsigned> Lines(LineCounts.begin(), LineCounts.end());
+  if (Lines.empty()) {
+    const unsigned Default[] = { 10, 100, 1000, 10000, 50000 };
+    Lines.assign(Default, Default + sizeof(Default) / sizeof(Default[0]));
+  }
+  std::vector<unsigned> Decls(DeclCounts.begin(), DeclCounts.end());
+  if (Decls.empty()) {
+    const unsigned Default[] = { 4, 32, 256, 2048, 8192 };
+    Decls.assign(Default, Default + sizeof(Default) / sizeof(Default[0]));
+  }
+
+  if (!JSONOutput) {
+    outs() << format("%8s %8s  %-28s %14s\n",
+                     "lines", "decls", "stage", "time (us)");
+  }
+  bool Succeeded = true;
+  for (auto LI = Lines.begin(), LE = Lines.end(); LI != LE; ++LI) {
+    for (auto DI = Decls.begin(), DE = Decls.end(); DI != DE; ++DI) {
+      // Every local is declared on a line of its own, and there has to be
+      // at least one line left to extract.
+      if (*DI * 3 / 4 + 3 > *LI) continue;
+
+      const BenchmarkInput Input = GenerateInput(*LI, *DI);
+      if (!runToolOnCode(new BenchmarkAction(*LI, *DI, Input),
+                         Input.Code, "benchmark.cc")) {
+        errs() << "Couldn't parse the input with " << *LI << " lines and "
+               << *DI << " decls.\n";
+        Succeeded = false;
+      }
+    }
+  }
+  return Succeeded ? 0 : 1;
+}
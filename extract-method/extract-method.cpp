@@ -1,80 +1,140 @@
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclGroup.h"
+#include "clang/AST/DeclTemplate.h"
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/ASTUnit.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Rewrite/Rewriter.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/OwningPtr.h"
 #include "llvm/Support/raw_ostream.h"
+#include "ASTCache.h"
+#include "CompileCommands.h"
+#include "Edits.h"
+#include "Extraction.h"
+#include "FileOverlay.h"
+#include "FunctionIndex.h"
+#include "LineTable.h"
 #include "MethodExtractor.h"
-#include <iostream>
+#include "RefactoringServer.h"
+#include "SourceFiles.h"
+#include "Trace.h"
+#include "TraversalStats.h"
+#include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace clang;
 using namespace clang::tooling;
 using namespace llvm;
 
-// Runs our AST visitor on top-level declarations.
+// Finds the functions that contain the lines to extract, and extracts them
+// once the translation unit has been parsed. The bodies of all the other
+// functions in the main file, and in the headers, are skipped by the
+// parser.
 class ExtractMethodASTConsumer : public ASTConsumer {
 public:
   ExtractMethodASTConsumer(Rewriter &R,
                            SourceManager &SM,
-                           unsigned FirstLine,
-                           unsigned LastLine,
-                           std::string NewFunctionName)
+                           const LangOptions &LangOpts,
+                           const std::vector<Extraction> &Extractions)
     : TheRewriter(R)
     , SM(SM)
-    , DoneExtracting(false)
-    , FirstLine(FirstLine)
-    , LastLine(LastLine)
-    , NewFunctionName(std::move(NewFunctionName))
+    , LangOpts(LangOpts)
+    , Extractions(Extractions)
   {}
 
-  virtual ~ExtractMethodASTConsumer() {
-    if (!DoneExtracting) {
-      std::cerr << "Did not find any function that contains the given "
-                << "range of line numbers. No code was extracted.\n";
+  // The main file is only known once parsing starts.
+  virtual void Initialize(ASTContext &Context) {
+    MainLines.reset(new LineTable(SM, SM.getMainFileID()));
+    Index.reset(new FunctionIndex(SM, *MainLines));
+    for (auto EI = Extractions.begin(), EE = Extractions.end();
+         EI != EE; ++EI) {
+      Ranges.push_back(getRange(*EI));
     }
+    std::sort(Ranges.begin(), Ranges.end());
   }
 
   virtual bool HandleTopLevelDecl(DeclGroupRef DR) {
-    for (auto DB = DR.begin(), DE=DR.end(); DB != DE; ++DB) {
-      // We need a function decl that contains the specified range of lines.
-      if (!isa<FunctionDecl>(*DB)) continue;
-      FunctionDecl *FD = dyn_cast<FunctionDecl>(*DB);
-      if (!DoesDeclContainLineRange(FD)) continue;
+    for (auto DB = DR.begin(), DE = DR.end(); DB != DE; ++DB) {
+      Index->addDecl(*DB);
+    }
+    return true;
+  }
+
+  // Only the functions that contain lines to extract need their bodies
+  // parsed.
+  virtual bool shouldSkipFunctionBody(Decl *D) {
+    if (IsConstexprFunction(D)) return false;
+
+    const std::pair<FileID, unsigned> Begin =
+        SM.getDecomposedLoc(SM.getExpansionLoc(D->getLocStart()));
+    if (Begin.first != SM.getMainFileID()) return true;
+    const std::pair<unsigned, unsigned> FirstRange(
+        MainLines->getLineStartForOffset(Begin.second), 0);
+    auto RI = std::lower_bound(Ranges.begin(), Ranges.end(), FirstRange);
+    if (RI == Ranges.end()) return true;
+
+    unsigned BodyEnd = 0;
+    if (!FindFunctionBodyEnd(SM, LangOpts, D, BodyEnd)) return false;
+    for (auto RE = Ranges.end(); RI != RE && RI->first <= BodyEnd; ++RI) {
+      if (RI->second <= BodyEnd) return false;
+    }
+    return true;
+  }
+
+  virtual void HandleTranslationUnit(ASTContext &Context) {
+    for (auto EI = Extractions.begin(), EE = Extractions.end();
+         EI != EE; ++EI) {
+      const std::pair<unsigned, unsigned> Range = getRange(*EI);
+      FunctionDecl *FD = Index->findEnclosing(Range.first, Range.second);
+      if (!FD) {
+        errs() << EI->File << ":" << EI->FirstLine << "-" << EI->LastLine
+               << ": Did not find any function that contains the given "
+               << "range of line numbers. No code was extracted.\n";
+        continue;
+      }
 
       MethodExtractor MethodEx(*FD,
                                SM,
                                TheRewriter,
-                               FirstLine,
-                               LastLine,
-                               NewFunctionName);
+                               EI->FirstLine,
+                               EI->LastLine,
+                               EI->Name,
+                               MainLines.get());
+      TraceSpan Span("extract", FD->getNameAsString());
       MethodEx.Run();
-      DoneExtracting = true;
-      return true;
     }
-
-    return true;
   }
 
 private:
   Rewriter& TheRewriter;
   SourceManager& SM;
-  bool DoneExtracting;
-
-  // First and last lines of the code to extract.
-  const unsigned FirstLine, LastLine;
-  // Name of the new function to create.
-  const std::string NewFunctionName;
-
-  // Returns whether D contains the range of lines of code to extract.
-  bool DoesDeclContainLineRange(Decl* D) {
-    const SourceRange Range = D->getSourceRange();
-    if (FirstLine < SM.getSpellingLineNumber(Range.getBegin())) return false;
-    if (LastLine > SM.getSpellingLineNumber(Range.getEnd())) return false;
-    return true;
+  const LangOptions &LangOpts;
+  const std::vector<Extraction> &Extractions;
+
+  OwningPtr<LineTable> MainLines;
+  // The functions in the main file whose bodies were parsed.
+  OwningPtr<FunctionIndex> Index;
+  // Offsets of the starts of the first and last lines of each extraction,
+  // sorted.
+  std::vector<std::pair<unsigned, unsigned> > Ranges;
+
+  std::pair<unsigned, unsigned> getRange(const Extraction &E) const {
+    return std::make_pair(MainLines->getLineStart(E.FirstLine),
+                          MainLines->getLineStart(E.LastLine));
+  }
+
+  // The bodies of constexpr functions may be needed to parse the rest of
+  // the file.
+  static bool IsConstexprFunction(Decl *D) {
+    if (FunctionTemplateDecl *FTD = dyn_cast<FunctionTemplateDecl>(D)) {
+      D = FTD->getTemplatedDecl();
+    }
+    FunctionDecl *FD = dyn_cast<FunctionDecl>(D);
+    return FD && FD->isConstexpr();
   }
 };
 
@@ -86,67 +146,264 @@ cl::opt<std::string> BuildPath(
 cl::opt<std::string> SourcePath(
   cl::Positional,
   cl::desc("Source file to refactor"),
-  cl::Required);
+  cl::Optional);
 cl::opt<unsigned> FirstLine(
   "first",
   cl::desc("The first line of the code to extract"),
-  cl::Required);
+  cl::Optional);
 cl::opt<unsigned> LastLine(
   "last",
   cl::desc("The last line of the code to extract"),
-  cl::Required);
+  cl::Optional);
 cl::opt<std::string> FunctionName(
   "name",
   cl::desc("Name of the new function to create"),
-  cl::Required);
+  cl::Optional);
+cl::opt<std::string> BatchFile(
+  "batch",
+  cl::value_desc("file"),
+  cl::desc("Make every extraction listed in this file, one per line as "
+           "<source> <first> <last> <name>, parsing each source file once"),
+  cl::init(""));
+cl::opt<std::string> ServerSocket(
+  "server",
+  cl::value_desc("socket"),
+  cl::desc("Serve extraction requests on this Unix socket, keeping the "
+           "parsed files around between requests"),
+  cl::init(""));
+cl::opt<EditOutputMode> OutputMode(
+  "output",
+  cl::desc("What to do with the extracted code"),
+  cl::values(
+    clEnumValN(OutputInPlace, "inplace", "Write the changed files (default)"),
+    clEnumValN(OutputDiff, "diff",
+               "Print a unified diff, and leave the files alone"),
+    clEnumValN(OutputReplacements, "replacements",
+               "Print the edits as replacement records, and leave the files "
+               "alone"),
+    clEnumValEnd),
+  cl::init(OutputInPlace));
+cl::opt<std::string> UnsavedFiles(
+  "unsaved",
+  cl::value_desc("file"),
+  cl::desc("Read the unsaved contents of files from this file, or from stdin "
+           "if it's -, and parse them instead of what's on disk"),
+  cl::init(""));
+cl::opt<std::string> ASTCacheDir(
+  "ast-cache-dir",
+  cl::value_desc("dir"),
+  cl::desc("Directory for keeping the parsed ASTs between runs, so that "
+           "later runs over unchanged files, by any of the tools, load them "
+           "instead of parsing"),
+  cl::init(""));
+cl::opt<unsigned> ASTCacheSize(
+  "ast-cache-size",
+  cl::value_desc("MB"),
+  cl::desc("How large the AST cache may grow before the least recently used "
+           "ASTs are deleted"),
+  cl::init(2048));
+cl::opt<std::string> TraceFile(
+  "trace",
+  cl::value_desc("file"),
+  cl::desc("Write a Chrome trace of how long each phase took"),
+  cl::init(""));
+cl::opt<bool> PrintStats(
+  "stats",
+  cl::desc("Print the median, 95th percentile and maximum time of each "
+           "phase"));
+cl::opt<std::string> TraversalStatsPath(
+  "traversal-stats",
+  cl::value_desc("file"),
+  cl::desc("Count the AST nodes each visitor sees by kind and file, and "
+           "write them as JSON to this file, or print them if it's -"),
+  cl::init(""));
+
+// Turns the Rewriter's changes into edits, so that they're applied like the
+// other tools' edits. Each file gets a single edit, which only covers the
+// bytes between the first and the last that changed.
+static void GetRewriterEdits(Rewriter &R, std::vector<FileEdits> &Edits) {
+  const SourceManager &SM = R.getSourceMgr();
+  for (auto BI = R.buffer_begin(), BE = R.buffer_end(); BI != BE; ++BI) {
+    const std::string FilePath = GetCanonicalFilePath(SM, BI->first);
+    bool Invalid = false;
+    const StringRef Original = SM.getBufferData(BI->first, &Invalid);
+    if (FilePath.empty() || Invalid) continue;
 
-// Frontend action to extract a method
-class FixUnusedParamAction : public ASTFrontendAction {
+    const std::string Rewritten(BI->second.begin(), BI->second.end());
+    size_t Prefix = 0;
+    const size_t MaxLength = std::min(Original.size(), Rewritten.size());
+    while (Prefix < MaxLength && Original[Prefix] == Rewritten[Prefix]) {
+      ++Prefix;
+    }
+    size_t Suffix = 0;
+    while (Suffix < MaxLength - Prefix &&
+           Original[Original.size() - Suffix - 1] ==
+           Rewritten[Rewritten.size() - Suffix - 1]) {
+      ++Suffix;
+    }
+    if (Prefix == Original.size() && Prefix == Rewritten.size()) continue;
+
+    FileEdits File;
+    File.FilePath = FilePath;
+    File.ContentHash = HashFileContents(Original.data(), Original.size());
+    File.Edits.push_back(Edit(Prefix, Original.size() - Prefix - Suffix,
+                              Rewritten.substr(Prefix, Rewritten.size() -
+                                                       Prefix - Suffix),
+                              /*InsertBefore*/false));
+    Edits.push_back(File);
+  }
+}
+
+// Frontend action to extract methods from one file. The changes are added
+// to Edits, and written once every configuration of the file is done, so
+// that no configuration parses what another one already rewrote.
+class ExtractMethodAction : public ASTFrontendAction {
 public:
+  ExtractMethodAction(const std::vector<Extraction> &Extractions,
+                      std::vector<FileEdits> &Edits)
+    : Extractions(Extractions)
+    , Edits(Edits)
+    {}
+
   virtual clang::ASTConsumer *CreateASTConsumer(
     clang::CompilerInstance &Compiler, llvm::StringRef InFile) {
-    TheRewriter.setSourceMgr(Compiler.getSourceManager(),
-                             Compiler.getLangOpts());
+    // The AST context has the options the code was parsed with, even when
+    // the AST was loaded from the AST cache.
+    const LangOptions &LangOpts = Compiler.getASTContext().getLangOpts();
+    TheRewriter.setSourceMgr(Compiler.getSourceManager(), LangOpts);
+    Compiler.getFrontendOpts().SkipFunctionBodies = true;
     return new ExtractMethodASTConsumer(TheRewriter,
                                         Compiler.getSourceManager(),
-                                        FirstLine,
-                                        LastLine,
-                                        FunctionName);
+                                        LangOpts,
+                                        Extractions);
   }
 
-  // Upon destruction, write all changes to disk.
-  virtual ~FixUnusedParamAction() {
-    TheRewriter.overwriteChangedFiles();
+  // Collect the changes while the source manager is still around, which a
+  // loaded AST's isn't by the time the action is destroyed.
+  virtual void EndSourceFileAction() {
+    GetRewriterEdits(TheRewriter, Edits);
   }
 
 private:
+  const std::vector<Extraction> &Extractions;
+  std::vector<FileEdits> &Edits;
   Rewriter TheRewriter;
 };
 
-void LoadCompilationDatabaseIfNotFound(
-    OwningPtr<CompilationDatabase>& Compilations) {
+class ExtractMethodActionFactory : public FrontendActionFactory {
+public:
+  ExtractMethodActionFactory(const std::vector<Extraction> &Extractions,
+                             std::vector<FileEdits> &Edits)
+    : Extractions(Extractions)
+    , Edits(Edits)
+    {}
+
+  virtual FrontendAction *create() {
+    return new ExtractMethodAction(Extractions, Edits);
+  }
 
-  if (Compilations) return;
+private:
+  const std::vector<Extraction> &Extractions;
+  std::vector<FileEdits> &Edits;
+};
 
-  std::string ErrorMessage;
-  if (!BuildPath.empty()) {
-    Compilations.reset(
-        CompilationDatabase::autoDetectFromDirectory(BuildPath,
-                                                     ErrorMessage));
-  } else {
-    Compilations.reset(CompilationDatabase::autoDetectFromSource(
-        SourcePath, ErrorMessage));
+// Makes the extractions from a file with the AST cache: from its cached AST
+// if there is one, or else by parsing it like the other tools do, so that
+// they share the cached ASTs.
+static bool ExtractWithASTCache(ASTCache &ASTs,
+                                const CompilationDatabase &Compilations,
+                                const std::vector<Extraction> &Extractions,
+                                std::vector<FileEdits> &Edits) {
+  const std::string &File = Extractions.front().Path;
+  std::vector<CompileCommand> Commands =
+      GetDistinctCommands(Compilations.getCompileCommands(File), File);
+  if (Commands.empty()) {
+    errs() << "Skipping " << File << ". Command line not found.\n";
+    return true;
   }
-  if (!Compilations) {
-    llvm::report_fatal_error(ErrorMessage);
+
+  bool Succeeded = true;
+  for (auto CI = Commands.begin(), CE = Commands.end(); CI != CE; ++CI) {
+    std::vector<std::string> CommandLine = CI->CommandLine;
+    CommandLine.push_back("-fsyntax-only");
+    CommandLine.push_back("-working-directory=" + CI->Directory);
+    std::vector<FileDependency> Deps;
+    if (!ASTs.run(File, CI->Directory, CommandLine,
+                  [&] { return new ExtractMethodAction(Extractions, Edits); },
+                  Deps)) {
+      Succeeded = false;
+    }
   }
+  return Succeeded;
 }
 
-void ValidateCommandLineOptions() {
-  if (FirstLine > LastLine) {
+// Extracts the lines given in each request, which has the same fields as a
+// line of a batch file.
+class ExtractMethodRequestHandler : public ServerRequestHandler {
+public:
+  virtual bool handle(ASTUnit &AST,
+                      const ServerRequest &Request,
+                      std::vector<FileEdits> &Edits,
+                      std::string &Error) {
+    unsigned First = 0, Last = 0;
+    if (Request.Args.size() != 3 ||
+        StringRef(Request.Args[0]).getAsInteger(10, First) ||
+        StringRef(Request.Args[1]).getAsInteger(10, Last) ||
+        First == 0 || First > Last) {
+      Error = "Expected <first line> <last line> <name> after the file name.";
+      return false;
+    }
+
+    SourceManager &SM = AST.getSourceManager();
+    LineTable Lines(SM, SM.getMainFileID());
+    FunctionIndex Index(SM, Lines);
+    for (auto DI = AST.top_level_begin(), DE = AST.top_level_end();
+         DI != DE; ++DI) {
+      Index.addDecl(*DI);
+    }
+    FunctionDecl *FD = Index.findEnclosing(Lines.getLineStart(First),
+                                           Lines.getLineStart(Last));
+    if (!FD) {
+      Error = "Did not find any function that contains the given range of "
+              "line numbers.";
+      return false;
+    }
+
+    Rewriter R(SM, AST.getASTContext().getLangOpts());
+    MethodExtractor(*FD, SM, R, First, Last, Request.Args[2], &Lines).Run();
+    GetRewriterEdits(R, Edits);
+    return true;
+  }
+};
+
+// Returns the extractions to make, either from the batch file, or the
+// single one given on the command line.
+std::vector<Extraction> GetExtractions() {
+  const bool HasSingleExtraction =
+      !SourcePath.empty() || FirstLine.getNumOccurrences() ||
+      LastLine.getNumOccurrences() || !FunctionName.empty();
+  if (!BatchFile.empty()) {
+    if (HasSingleExtraction) {
+      llvm::report_fatal_error(
+          "A source file, -first, -last and -name can't be given with "
+          "-batch.");
+    }
+    return ReadExtractionsFile(BatchFile);
+  }
+
+  if (SourcePath.empty() || !FirstLine.getNumOccurrences() ||
+      !LastLine.getNumOccurrences() || FunctionName.empty()) {
     llvm::report_fatal_error(
-        "The beginning line number must come before the end line number.");
+        "A source file, -first, -last and -name are required without "
+        "-batch.");
   }
+  Extraction E;
+  E.File = GetRealPath(SourcePath);
+  E.Path = GetAbsolutePath(SourcePath);
+  E.FirstLine = FirstLine;
+  E.LastLine = LastLine;
+  E.Name = FunctionName;
+  return std::vector<Extraction>(1, E);
 }
 
 int main(int argc, char **argv) {
@@ -158,14 +415,85 @@ int main(int argc, char **argv) {
   // Next, use normal llvm command line parsing to get the tool specific
   // parameters.
   cl::ParseCommandLineOptions(argc, argv);
-  ValidateCommandLineOptions();
 
-  LoadCompilationDatabaseIfNotFound(Compilations);
+  if (!ServerSocket.empty()) {
+    // Without a source file, look for the compilation database from the
+    // current directory.
+    LoadCompilationDatabaseIfNotFound(
+        Compilations, BuildPath,
+        SourcePath.empty() ? std::string(".") : std::string(SourcePath));
+    ExtractMethodRequestHandler Handler;
+    RefactoringServer Server(*Compilations, Handler, argv[0]);
+    Server.setOutputMode(OutputMode);
+    return Server.serve(ServerSocket) ? 0 : 1;
+  }
+
+  FileOverlay Overlay;
+  if (!UnsavedFiles.empty()) {
+    if (OutputMode == OutputInPlace) {
+      llvm::report_fatal_error(
+          "Unsaved files can only be used with -output=diff or "
+          "-output=replacements.");
+    }
+    if (!Overlay.readFile(UnsavedFiles)) {
+      llvm::report_fatal_error("Couldn't read the unsaved files from " +
+                               UnsavedFiles + ".");
+    }
+  }
 
-  std::vector<std::string> SourcePaths;
-  SourcePaths.push_back(std::string(SourcePath));
-  ClangTool Tool(*Compilations, SourcePaths);
+  std::vector<Extraction> Extractions = GetExtractions();
+  bool Succeeded = RemoveConflictingExtractions(Extractions);
+  if (Extractions.empty()) return Succeeded ? 0 : 1;
 
-  return Tool.run(newFrontendActionFactory<FixUnusedParamAction>());
-}
+  TraceSession Session(TraceFile, PrintStats);
+  TraversalStatsSession StatsSession(TraversalStatsPath);
+  {
+    TraceSpan Span("load compilation database");
+    LoadCompilationDatabaseIfNotFound(Compilations, BuildPath,
+                                      Extractions.front().Path);
+  }
+
+  // Unsaved files aren't what the cached ASTs were parsed from.
+  OwningPtr<ASTCache> ASTs;
+  if (!ASTCacheDir.empty() && Overlay.empty()) {
+    ASTs.reset(new ASTCache(ASTCacheDir, (uint64_t)ASTCacheSize << 20));
+  }
 
+  // Every extraction from a file is made from the same parse of it.
+  const std::vector<std::vector<Extraction> > Groups =
+      GroupExtractionsByFile(Extractions);
+  std::vector<FileEdits> Edits;
+  for (auto GI = Groups.begin(), GE = Groups.end(); GI != GE; ++GI) {
+    // The group is keyed by the real path, but the compilation database
+    // is searched by the path the file was named by.
+    const std::string &File = GI->front().Path;
+    if (ASTs) {
+      TraceSpan Span("translation unit", File);
+      if (!ExtractWithASTCache(*ASTs, *Compilations, *GI, Edits)) {
+        Succeeded = false;
+      }
+      continue;
+    }
+
+    ClangTool Tool(*Compilations, std::vector<std::string>(1, File));
+    for (auto OI = Overlay.begin(), OE = Overlay.end(); OI != OE; ++OI) {
+      Tool.mapVirtualFile(OI->first, OI->second);
+    }
+    ExtractMethodActionFactory Factory(*GI, Edits);
+
+    TraceSpan Span("translation unit", File);
+    if (Tool.run(&Factory) != 0) {
+      Succeeded = false;
+    }
+  }
+
+  // A file compiled in several configurations has the same extraction
+  // from each of them, which the merge makes once.
+  EditMerger Merger;
+  Merger.addEdits(Edits);
+  TraceSpan Span("write files");
+  if (!Merger.output(OutputMode, Overlay, outs())) {
+    Succeeded = false;
+  }
+  return Succeeded ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+#ifndef CPP_TOOLS_FIX_UNUSED_ARGS_AST_VISITOR_H
+#define CPP_TOOLS_FIX_UNUSED_ARGS_AST_VISITOR_H
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "EditRecorder.h"
+#include <string>
+
+// Traverses the AST, finding named function arguments that are unused,
+// and making them unnamed by commenting out the name.
+class FixUnusedArgsASTVisitor :
+  public clang::RecursiveASTVisitor<FixUnusedArgsASTVisitor> {
+public:
+  FixUnusedArgsASTVisitor(EditRecorder &E,
+                          std::string UnusedPrefix,
+                          std::string UnusedSuffix)
+    : TheEdits(E)
+    , UnusedPrefix(std::move(UnusedPrefix))
+    , UnusedSuffix(std::move(UnusedSuffix))
+    {}
+
+  bool VisitFunctionDecl(clang::FunctionDecl *f) {
+    // Only visit function definitions (with bodies), not declarations.
+    // We don't want to modify the declaration at all, just the definition.
+    if (!f->getBody()) return true;
+
+    for (auto PI=f->param_begin(), PE=f->param_end(); PI != PE; ++PI) {
+      const clang::ParmVarDecl *Param = *PI;
+
+      if (Param->isUsed()) continue;
+      if (Param->getName().empty()) continue;
+      makeParamDeclUnnamed(Param);
+    }
+
+    return true;
+  }
+
+private:
+  EditRecorder &TheEdits;
+  const std::string UnusedPrefix, UnusedSuffix;
+
+  // Makes a param decl unnamed by commenting the name out. A parameter can
+  // be unused in one configuration of the file and used in another, so it's
+  // only commented out if it's unused in all of them.
+  void makeParamDeclUnnamed(const clang::ParmVarDecl *Param) {
+    clang::SourceLocation NameLoc = Param->getLocation();
+    TheEdits.setRequiresAllConfigurations(true);
+    TheEdits.InsertTextBefore(NameLoc, UnusedPrefix);
+    TheEdits.InsertTextAfterToken(NameLoc, UnusedSuffix);
+    TheEdits.setRequiresAllConfigurations(false);
+  }
+};
+
+#endif